@@ -23,7 +23,28 @@ set(FSPROPFAKER_MAJOR_VERSION 0)
 set(FSPROPFAKER_MINOR_VERSION 2) # !-U-!
 set(FSPROPFAKER_VERSION "${FSPROPFAKER_MAJOR_VERSION}.${FSPROPFAKER_MINOR_VERSION}.0")
 
-set(FSPROPFAKER_REQ_FUSE_VERSION "2.9.7")
+if ("${CMAKE_SCRIPT_MODE_FILE}" STREQUAL "")
+    option(BUILD_WITH_FUSE3 "Build against libfuse 3 instead of libfuse 2" OFF)
+    option(BUILD_WITH_IO_URING "Build with io_uring support (needs liburing)" OFF)
+    option(BUILD_WITHOUT_LOGGING "Build without logging, the log file path is ignored" OFF)
+endif()
+
+if (BUILD_WITH_FUSE3)
+    # 1 MiB requests (max_pages), readdirplus, no_rofd_flush
+    set(FSPROPFAKER_REQ_FUSE_PKG     "fuse3")
+    set(FSPROPFAKER_REQ_FUSE_VERSION "3.10.0")
+    set(FSPROPFAKER_FUSE_USE_VERSION 35)
+else()
+    set(FSPROPFAKER_REQ_FUSE_PKG     "fuse")
+    set(FSPROPFAKER_REQ_FUSE_VERSION "2.9.7")
+    set(FSPROPFAKER_FUSE_USE_VERSION 26)
+endif()
+set(FSPROPFAKER_PC_REQUIRES "${FSPROPFAKER_REQ_FUSE_PKG} >= ${FSPROPFAKER_REQ_FUSE_VERSION}")
+
+set(FSPROPFAKER_REQ_URING_VERSION "2.0")
+if (BUILD_WITH_IO_URING)
+    set(FSPROPFAKER_PC_REQUIRES "${FSPROPFAKER_PC_REQUIRES}, liburing >= ${FSPROPFAKER_REQ_URING_VERSION}")
+endif()
 
 if ("${CMAKE_SCRIPT_MODE_FILE}" STREQUAL "")
     include(FindPkgConfig)
@@ -31,11 +52,17 @@ if ("${CMAKE_SCRIPT_MODE_FILE}" STREQUAL "")
         message(FATAL_ERROR "Mandatory 'pkg-config' not found!")
     endif()
     # Beware! The prefix passed to pkg_check_modules(PREFIX ...) shouldn't contain underscores!
-    pkg_check_modules(FUSE    REQUIRED  fuse>=${FSPROPFAKER_REQ_FUSE_VERSION})
+    pkg_check_modules(FUSE    REQUIRED  ${FSPROPFAKER_REQ_FUSE_PKG}>=${FSPROPFAKER_REQ_FUSE_VERSION})
+    if (BUILD_WITH_IO_URING)
+        pkg_check_modules(URING   REQUIRED  liburing>=${FSPROPFAKER_REQ_URING_VERSION})
+    endif()
 endif()
 
 # include dirs
 list(APPEND FSPROPFAKER_EXTRA_INCLUDE_DIRS  "${FUSE_INCLUDE_DIRS}")
+if (BUILD_WITH_IO_URING)
+    list(APPEND FSPROPFAKER_EXTRA_INCLUDE_DIRS  "${URING_INCLUDE_DIRS}")
+endif()
 
 set(STMMI_TEMP_INCLUDE_DIR "${PROJECT_SOURCE_DIR}/../libfspropfaker/include")
 
@@ -45,6 +72,9 @@ list(APPEND FSPROPFAKER_INCLUDE_DIRS  "${FSPROPFAKER_EXTRA_INCLUDE_DIRS}")
 # libs
 set(        STMMI_TEMP_EXTERNAL_LIBRARIES    "")
 list(APPEND STMMI_TEMP_EXTERNAL_LIBRARIES    "${FUSE_LIBRARIES}")
+if (BUILD_WITH_IO_URING)
+    list(APPEND STMMI_TEMP_EXTERNAL_LIBRARIES    "${URING_LIBRARIES}")
+endif()
 
 set(        FSPROPFAKER_EXTRA_LIBRARIES      "")
 list(APPEND FSPROPFAKER_EXTRA_LIBRARIES      "${STMMI_TEMP_EXTERNAL_LIBRARIES}")
@@ -0,0 +1,109 @@
+/*
+ * Copyright © 2020  Stefano Marsili, <stemars@gmx.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+/*
+ * File:   fsdispatcher.h
+ */
+
+#ifndef FS_DISPATCHER_H
+#define FS_DISPATCHER_H
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+
+#include <stdint.h>
+
+struct fuse_session;
+struct fuse_chan;
+
+namespace fspf
+{
+
+using std::unique_ptr;
+using std::shared_ptr;
+
+class OverFs;
+class LowFs;
+
+/** Thread pool serving the requests of several file systems.
+ * Instead of each FsPropFaker having its own fuse thread(s), the fakers
+ * created with the same dispatcher (see FsPropFaker::Options::m_refDispatcher)
+ * share its threads, which wait for the requests of all of them at once.
+ *
+ * The fakers keep a reference to the dispatcher, so it is only destroyed
+ * after all of them.
+ */
+class FsDispatcher
+{
+public:
+	~FsDispatcher() noexcept;
+	struct CreateResult
+	{
+		shared_ptr<FsDispatcher> m_refDispatcher; /**< If null an error occurred. */
+		std::string m_sError; /**< The error. If empty no error occurred. */
+	};
+	/** Creates a dispatcher and starts its threads.
+	 * @param nThreads The number of threads. Must be positive.
+	 * @return The result.
+	 */
+	static CreateResult create(int32_t nThreads) noexcept;
+
+	/** The number of threads.
+	 * @return The number of threads. Is positive.
+	 */
+	int32_t getTotThreads() const noexcept;
+	/** The number of file systems currently served.
+	 * @return The number of sessions.
+	 */
+	int32_t getTotSessions() noexcept;
+protected:
+	FsDispatcher() noexcept;
+private:
+	friend class OverFs;
+	friend class LowFs;
+	struct Session;
+	// return empty if ok, error otherwise
+	std::string init(int32_t nThreads) noexcept;
+	// Serves the session until the kernel ends the connection, then calls oOnEnd
+	// from one of the threads once no other thread is processing its requests.
+	// p0Chan must be null with libfuse 3.
+	// return empty if ok, error otherwise
+	std::string addSession(struct fuse_session* p0Session, struct fuse_chan* p0Chan
+							, std::function<void()>&& oOnEnd) noexcept;
+	void run(int32_t nThreadIdx) noexcept;
+	bool rearm(Session* p0Session) noexcept;
+	void releaseSession(Session* p0Session) noexcept;
+private:
+	int m_nEpollFd = -1;
+	int m_nStopFd = -1; // eventfd that wakes up all the threads when the dispatcher is destroyed
+	std::vector<std::thread> m_aThreads;
+
+	std::mutex m_oSessionsMutex;
+	std::unordered_map<Session*, unique_ptr<Session>> m_oSessions;
+
+private:
+	FsDispatcher(const FsDispatcher& oSource) = delete;
+	FsDispatcher& operator=(const FsDispatcher& oSource) = delete;
+};
+
+} // namespace fspf
+
+#endif /* FS_DISPATCHER_H */
@@ -21,13 +21,18 @@
 #ifndef FS_PROP_FAKER_H
 #define FS_PROP_FAKER_H
 
+#include "fsdispatcher.h"
+
 #include <utility>
 #include <memory>
 #include <string>
 #include <thread>
+#include <vector>
 #include <atomic>
 #include <condition_variable>
 
+#include <sys/types.h>
+
 namespace fspf
 {
 
@@ -35,7 +40,7 @@ using std::unique_ptr;
 using std::shared_ptr;
 using std::weak_ptr;
 
-class OverFs;
+class FakeFs;
 
 /** File system property faker.
  */
@@ -48,6 +53,91 @@ public:
 		unique_ptr<FsPropFaker> m_refFaker; /**< If null an error occurred. */
 		std::string m_sError; /**< The error. If empty no error occurred. */
 	};
+	/** The verbosity of the text log.
+	 */
+	enum LOG_LEVEL
+	{
+		LOG_LEVEL_ERRORS = 0, /**< Only the failed requests, with their path or node. */
+		LOG_LEVEL_OPS = 1, /**< Also each request with its arguments and the results of the calls it makes. */
+		LOG_LEVEL_FULL = 2 /**< Also the content of the structures (stat, statvfs, fuse_file_info, ...). */
+	};
+	/** The categories of requests in the text log. Can be or-ed.
+	 */
+	enum LOG_CATEGORY
+	{
+		LOG_CATEGORY_META = 0x01, /**< Lookups, attributes, links, renames, creation and removal of nodes. */
+		LOG_CATEGORY_DATA = 0x02, /**< Opening, reading, writing, syncing and releasing files. */
+		LOG_CATEGORY_XATTR = 0x04, /**< Extended attributes. */
+		LOG_CATEGORY_DIR = 0x08, /**< Opening, reading and releasing folders. */
+		LOG_CATEGORY_STATFS = 0x10, /**< File system statistics. */
+		LOG_CATEGORY_ALL = 0x1f /**< All the categories. */
+	};
+	/** The fuse mount and session options.
+	 * Sizes that are `0`, the readahead and the timeouts that are negative
+	 * leave the libfuse default. Unlike libfuse 2, big_writes is enabled
+	 * by default (see m_bBigWrites).
+	 *
+	 * By default the requests are served by libfuse's thread pool, which
+	 * starts and stops threads as needed. With m_bSingleThreaded a single
+	 * thread is used. With m_nWorkerThreads a fixed number of threads is used.
+	 * With m_refDispatcher the threads of a dispatcher are used.
+	 */
+	struct Options
+	{
+		int32_t m_nMaxRead = 0; /**< The maximum size of a read request in bytes (max_read). If not 0 must be at least 4096
+								 * and at most 128 KiB (1 MiB with libfuse 3). */
+		int32_t m_nMaxWrite = 0; /**< The maximum size of a write request in bytes (max_write). If not 0 must be at least 4096
+								 * and at most 128 KiB (1 MiB with libfuse 3, which is also its default). */
+		bool m_bBigWrites = true; /**< Whether write requests bigger than 4096 bytes are allowed (big_writes). Default: true. */
+		bool m_bAsyncRead = true; /**< Whether read requests are asynchronous (async_read) or not (sync_read). Default: true. */
+		int32_t m_nMaxReadahead = -1; /**< The maximum readahead in bytes (max_readahead). */
+		bool m_bKernelCache = false; /**< Whether the kernel keeps the file data cached between opens (kernel_cache).
+									 * Cannot be used together with m_bAutoCache. */
+		bool m_bAutoCache = false; /**< Whether the cached file data is discarded when the modification time changes (auto_cache).
+									 * Cannot be used together with m_bKernelCache. */
+		double m_fEntryTimeout = -1.0; /**< The seconds names are cached (entry_timeout). */
+		double m_fAttrTimeout = -1.0; /**< The seconds file attributes are cached (attr_timeout). */
+		double m_fNegativeTimeout = -1.0; /**< The seconds names that don't exist are cached (negative_timeout). */
+		bool m_bSingleThreaded = false; /**< Whether the requests are served by a single thread. Default: false. */
+		int32_t m_nWorkerThreads = 0; /**< The fixed number of threads serving the requests. If 0 libfuse's thread pool is used. */
+		bool m_bCloneFd = false; /**< Whether each thread of libfuse's pool reads its own copy of the fuse device (clone_fd).
+								 * Needs libfuse 3. Default: false. */
+		int32_t m_nMaxIdleThreads = -1; /**< The maximum number of idle threads in libfuse's pool (max_idle_threads).
+										 * Needs libfuse 3. If negative the libfuse default. */
+		double m_fRealStatsTTL = 0.0; /**< The seconds the statistics of the underlying file system are cached.
+									 * A background thread refreshes them. If 0 they are read at each request.
+									 * Must not be bigger than a day (86400). */
+		shared_ptr<FsDispatcher> m_refDispatcher; /**< If not null the requests are served by the threads of the dispatcher,
+												 * which can be shared with other fakers, instead of by threads of this faker.
+												 * Cannot be used together with the other thread options. */
+		int32_t m_nMountTimeoutMillisec = 5000; /**< The maximum time create() waits for the file system to be mounted. Must be positive. */
+		bool m_bLowLevel = false; /**< Whether the low level (inode based) fuse API is used instead of the path based one.
+								 * Spares libfuse and the faker the path lookups. Default: false. */
+		bool m_bIoUring = false; /**< Whether the low level backend reads, writes, syncs and closes the underlying files
+								 * through io_uring, so that its threads don't wait for them. Needs m_bLowLevel,
+								 * Linux 5.6 and the library built with io_uring support. If the kernel refuses
+								 * to create the ring the blocking calls are used. Default: false. */
+		bool m_bWritebackCache = false; /**< Whether the kernel collects the writes in its page cache and writes them
+										 * back in bigger chunks (writeback_cache). The underlying files, their size and
+										 * modification time included, are updated when the data is written back, at the
+										 * latest by close or fsync. Needs libfuse 3. Default: false. */
+		bool m_bPassthrough = false; /**< Whether the kernel reads and writes the open files directly (fuse passthrough),
+									 * only the metadata and statfs requests reach the faker. Needs m_bLowLevel,
+									 * libfuse 3.16 and a kernel supporting it (6.9 or later). If the kernel refuses
+									 * a file (ex. the process lacks CAP_SYS_ADMIN) the faker serves its data.
+									 * Cannot be used together with m_bWritebackCache. Default: false. */
+		bool m_bBinaryTrace = false; /**< Whether the log file is a compact binary trace with a fixed size record
+									 * per request (op, time, duration, thread, caller pid, paths, arguments and result)
+									 * instead of text. The paths are stored once, but after 64K distinct paths
+									 * the faker forgets them and those used again are stored again.
+									 * Ignored if there is no log file.
+									 * Use the fspropfaker-trace tool to turn it into text or CSV. Default: false. */
+		LOG_LEVEL m_eLogLevel = LOG_LEVEL_FULL; /**< The verbosity of the text log. Can be changed with setLogLevel(). */
+		int32_t m_nLogCategories = LOG_CATEGORY_ALL; /**< The or-ed LOG_CATEGORY values of the requests logged
+													 * with LOG_LEVEL_OPS and LOG_LEVEL_FULL. The failed requests
+													 * of the other categories are logged as with LOG_LEVEL_ERRORS.
+													 * Can be changed with setLogCategories(). */
+	};
 	/** Creates an instance.
 	 * If sMountPath is empty '/tmp/fsprofakerNNNNN/' (where N is a random digit) will be created and used.
 	 *
@@ -56,12 +146,27 @@ public:
 	 * @param sFsFolderPath The absolute path of the folder that will be seen as a new fake filesystem.
 	 * @param sMountPath The absolute path of the folder that will mount the new fake filesystem. Can be empty.
 	 * @param sLogFilePath The file path of the log file. If empty no logging will take place.
+	 * Ignored if the library was built without logging (BUILD_WITHOUT_LOGGING).
 	 * @return The result.
 	 */
 	static CreateResult create(const std::string& sMountName
 								, const std::string& sFsFolderPath
 								, const std::string& sMountPath
 								, const std::string& sLogFilePath) noexcept;
+	/** Creates an instance with fuse options.
+	 * See the other create function.
+	 * @param sMountName The name of the file system. If empty some default is chosen.
+	 * @param sFsFolderPath The absolute path of the folder that will be seen as a new fake filesystem.
+	 * @param sMountPath The absolute path of the folder that will mount the new fake filesystem. Can be empty.
+	 * @param sLogFilePath The file path of the log file. If empty no logging will take place.
+	 * @param oOptions The fuse options. If invalid an error is returned.
+	 * @return The result.
+	 */
+	static CreateResult create(const std::string& sMountName
+								, const std::string& sFsFolderPath
+								, const std::string& sMountPath
+								, const std::string& sLogFilePath
+								, const Options& oOptions) noexcept;
 
 	/** The name of the mounted file system.
 	 * @return The name. Is not empty.
@@ -79,6 +184,10 @@ public:
 	 * @return The log file path. If empty no logging.
 	 */
 	const std::string& getLogFilePath() const noexcept;
+	/** The fuse options.
+	 * @return The options passed to create().
+	 */
+	const Options& getOptions() const noexcept;
 	/** The block size of the underlying file system.
 	 * @return The size of a block in bytes.
 	 */
@@ -108,6 +217,11 @@ public:
 	 * @return The real free size in MB.
 	 */
 	int64_t getRealFreeSizeInMB() noexcept;
+	/** Refreshes the cached statistics of the underlying filesystem now.
+	 * Only needed if Options::m_fRealStatsTTL is positive and the caller
+	 * knows the underlying filesystem has changed.
+	 */
+	void refreshRealStats() noexcept;
 
 	/** Sets the fake fixed disk size in blocks.
 	 * @param nSizeBlocks The new requested fake fixed size in blocks. Must be positive.
@@ -174,11 +288,46 @@ public:
 	 */
 	int64_t setFakeDiskFreeSizeDiffInMB(int64_t nFreeSizeMB) noexcept;
 
+	/** Sets the verbosity of the text log.
+	 * Applies to the requests received from now on.
+	 * @param eLogLevel The level.
+	 */
+	void setLogLevel(LOG_LEVEL eLogLevel) noexcept;
+	/** The verbosity of the text log.
+	 * @return The level.
+	 */
+	LOG_LEVEL getLogLevel() const noexcept;
+	/** Sets the categories of requests that are logged with the current level.
+	 * The messages of the other categories aren't even formatted, except for failures.
+	 * Applies to the requests received from now on.
+	 * @param nLogCategories The or-ed LOG_CATEGORY values.
+	 */
+	void setLogCategories(int32_t nLogCategories) noexcept;
+	/** The categories of requests that are logged with the current level.
+	 * @return The or-ed LOG_CATEGORY values.
+	 */
+	int32_t getLogCategories() const noexcept;
+
 	/** Unmount the file system.
-	 * This should stop the fuse thread.
+	 * Like unmount(int32_t) with a timeout of 5 seconds.
 	 * @return An empty string if successful, an error string otherwise.
 	 */
 	std::string unmount() noexcept;
+	struct UnmountResult
+	{
+		std::string m_sError; /**< The error. If empty no error occurred. */
+		std::vector<std::string> m_aOpenPaths; /**< The paths within the mount of the files and folders
+												 * that were open when unmounting started. */
+	};
+	/** Unmount the file system and wait for the fuse thread to stop.
+	 * The fuse session is exited and the mount point lazily detached.
+	 * If files are still open the detached file system stays alive until they
+	 * are closed. When the timeout expires the fuse connection is aborted
+	 * (the open files become unusable) and an error is returned.
+	 * @param nTimeoutMillisec The maximum time to wait. If negative waits indefinitely.
+	 * @return The result.
+	 */
+	UnmountResult unmount(int32_t nTimeoutMillisec) noexcept;
 protected:
 	FsPropFaker() noexcept;
 private:
@@ -186,23 +335,38 @@ private:
 	std::string init(const std::string& sMountName
 					, const std::string& sFsFolderPath
 					, const std::string& sMountPath
-					, const std::string& sLogFilePath) noexcept;
+					, const std::string& sLogFilePath
+					, const Options& oOptions) noexcept;
 	// return empty if ok, error otherwise
 	std::string createThread() noexcept;
+	std::vector<std::string> getFuseArgs() const noexcept;
 	void fuseInitialized() noexcept;
+	void fuseFinished(const std::string& sError) noexcept;
+	// returns whether the fuse thread stopped within the timeout
+	bool waitFuseFinished(int32_t nTimeoutMillisec) noexcept;
+	// return empty if ok, error otherwise
+	std::string abortConnection() noexcept;
 private:
 	std::string m_sMountName;
 	std::string m_sMountPath;
 	std::string m_sRootPath;
 	std::string m_sLogFilePath;
+	Options m_oOptions;
 	int64_t m_nBlockSize = 1;
+	int m_nRootFd = -1; // m_sRootPath opened with O_PATH
+	dev_t m_nFuseDev = 0; // the device of the mounted file system, if 0 not mounted yet
+
+	friend class FakeFs;
 
-	shared_ptr<OverFs> m_refFs;
+	shared_ptr<FakeFs> m_refFs;
 
-	unique_ptr<std::thread> m_refFsThread;
+	unique_ptr<std::thread> m_refFsThread; // null if served by a dispatcher
+	bool m_bFsLaunched = false; // whether the fuse thread was started or the session added to the dispatcher
 
 	std::mutex m_oFsStartedMutex;
 	std::atomic<bool> m_bFileSystemStarted = ATOMIC_VAR_INIT(false);
+	bool m_bFileSystemFinished = false; // the fuse thread has ended, protected by m_oFsStartedMutex
+	std::string m_sFsThreadError; // why the fuse thread has ended, protected by m_oFsStartedMutex
 	std::condition_variable m_oFileSystemStarted;
 
 private:
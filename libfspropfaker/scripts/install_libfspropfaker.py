@@ -49,6 +49,12 @@ def main():
 						, default=False, dest="bDontSudo")
 	oParser.add_argument("--sanitize", help="compile with -fsanitize=address (Debug only)", action="store_true"\
 						, default=False, dest="bSanitize")
+	oParser.add_argument("--fuse3", help="build against libfuse 3 instead of libfuse 2", action="store_true"\
+						, default=False, dest="bFuse3")
+	oParser.add_argument("--io-uring", help="build with io_uring support (needs liburing)", action="store_true"\
+						, default=False, dest="bIoUring")
+	oParser.add_argument("--no-logging", help="build without logging (the log file path is ignored)", action="store_true"\
+						, default=False, dest="bNoLogging")
 	oArgs = oParser.parse_args()
 
 	sInstallDir = os.path.abspath(os.path.expanduser(oArgs.sInstallDir))
@@ -103,6 +109,24 @@ def main():
 	else:
 		sSanitize = ""
 	#print("sSanitize:" + sSanitize)
+	#
+	if oArgs.bFuse3:
+		sFuse3 = "-D BUILD_WITH_FUSE3=ON"
+	else:
+		sFuse3 = ""
+	#print("sFuse3:" + sFuse3)
+	#
+	if oArgs.bIoUring:
+		sIoUring = "-D BUILD_WITH_IO_URING=ON"
+	else:
+		sIoUring = ""
+	#print("sIoUring:" + sIoUring)
+	#
+	if oArgs.bNoLogging:
+		sNoLogging = "-D BUILD_WITHOUT_LOGGING=ON"
+	else:
+		sNoLogging = ""
+	#print("sNoLogging:" + sNoLogging)
 
 	#
 	if oArgs.bDontSudo:
@@ -117,9 +141,9 @@ def main():
 	os.chdir("build")
 
 	if not oArgs.bDontConfigure:
-		subprocess.check_call("cmake {} {} {} {} {} {} {} ..".format(\
+		subprocess.check_call("cmake {} {} {} {} {} {} {} {} {} {} ..".format(\
 				sBuildSharedLib, sBuildTests, sBuildDocs, sDocsWarningsToLog, sBuildType\
-				, sInstallDir, sSanitize).split())
+				, sInstallDir, sSanitize, sFuse3, sIoUring, sNoLogging).split())
 
 	if not oArgs.bDontMake:
 		subprocess.check_call("make $STMM_MAKE_OPTIONS", shell=True)
@@ -76,6 +76,7 @@ def main():
 		subprocess.check_call("{} rm    -f              {}/lib/libfspropfaker.so*".format(sSudo, sInstallDir), shell=True)
 		subprocess.check_call("{} rm    -f              {}/lib/libfspropfaker.a".format(sSudo, sInstallDir).split())
 		subprocess.check_call("{} rm    -f       {}/lib/pkgconfig/fspropfaker.pc".format(sSudo, sInstallDir).split())
+		subprocess.check_call("{} rm    -f              {}/bin/fspropfaker-trace".format(sSudo, sInstallDir).split())
 		subprocess.check_call("{} rm -r -f        {}/share/doc/libfspropfaker".format(sSudo, sInstallDir).split())
 
 	if not oArgs.bNoClean:
@@ -0,0 +1,318 @@
+/*
+ * Copyright © 2020  Stefano Marsili, <stemars@gmx.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+/*
+ * File:   fakefs.cc
+ */
+
+#include "fakefs.h"
+
+#include "fspropfaker.h"
+#include "fsutil.h"
+
+#include "fusepp/Fuse.h"
+
+#include <cassert>
+#include <algorithm>
+#include <chrono>
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+namespace fspf
+{
+
+FakeFs::FakeFs(FsPropFaker* p0FsPropFaker, std::function<void()>&& oCallback) noexcept
+: m_p0FsPropFaker(p0FsPropFaker)
+, m_sMountName(p0FsPropFaker->getMountName())
+, m_sRootPath(p0FsPropFaker->getRootPath())
+, m_nRootFd(p0FsPropFaker->m_nRootFd)
+, m_sLogFilePath(p0FsPropFaker->getLogFilePath())
+, m_nBlockSize(p0FsPropFaker->getBlockSize())
+, m_oCallback(std::move(oCallback))
+{
+}
+std::string FakeFs::initInstance() noexcept
+{
+	const FsPropFaker::Options& oOptions = m_p0FsPropFaker->getOptions();
+	auto oPair = FsLogger::create(m_sMountName, m_sLogFilePath, oOptions.m_bBinaryTrace
+								, (oOptions.m_bLowLevel ? TRACE_BACKEND_LOW : TRACE_BACKEND_OVER));
+	if (! oPair.second.empty()) {
+		return oPair.second;
+	}
+	m_refLogger = std::move(oPair.first);
+	m_refLogger->setLogLevel(oOptions.m_eLogLevel);
+	m_refLogger->setLogCategories(oOptions.m_nLogCategories);
+	const double fRealStatsTTL = oOptions.m_fRealStatsTTL;
+	if (fRealStatsTTL > 0.0) {
+		startStatsPoller(fRealStatsTTL);
+	}
+	return "";
+}
+FakeFs::~FakeFs() noexcept
+{
+	stopStatsPoller();
+}
+
+void FakeFs::unmountLazily() noexcept
+{
+	if (m_bUnmounted.exchange(true)) {
+		return; //--------------------------------------------------------------
+	}
+	// the mount point of libfuse might be freed by teardown() meanwhile
+	#if FUSE_USE_VERSION < 35
+	// without the channel libfuse just calls 'fusermount -u -z'
+	::fuse_unmount(m_p0FsPropFaker->getMountPath().c_str(), nullptr);
+	#else
+	// fuse_unmount would close the device that the other threads are reading
+	const std::string sErr = execAndWait({"fusermount3", "-u", "-q", "-z", "--", m_p0FsPropFaker->getMountPath()});
+	if (! sErr.empty()) {
+		m_refLogger->log_msg("\nfake:unmountLazily %s\n", sErr.c_str());
+	}
+	#endif
+}
+
+std::vector<std::string> FakeFs::getOpenPaths() const noexcept
+{
+	std::vector<std::string> aPaths;
+	std::lock_guard<std::mutex> oLock(m_oOpenHandlesMutex);
+	aPaths.reserve(m_oOpenHandles.size());
+	for (const auto& oPair : m_oOpenHandles) {
+		aPaths.push_back(oPair.second);
+	}
+	return aPaths;
+}
+void FakeFs::addOpenHandle(uint64_t nFh, const char* p0Path) noexcept
+{
+	std::lock_guard<std::mutex> oLock(m_oOpenHandlesMutex);
+	m_oOpenHandles[nFh] = p0Path;
+}
+void FakeFs::removeOpenHandle(uint64_t nFh) noexcept
+{
+	std::lock_guard<std::mutex> oLock(m_oOpenHandlesMutex);
+	m_oOpenHandles.erase(nFh);
+}
+
+int FakeFs::getUnderlyingOpenFlags(int nFlags) const noexcept
+{
+	if (! m_bWritebackCache) {
+		return nFlags; //-------------------------------------------------------
+	}
+	// the kernel reads the pages it only partially writes, also through
+	// a file opened write only
+	if ((nFlags & O_ACCMODE) == O_WRONLY) {
+		nFlags = (nFlags & ~O_ACCMODE) | O_RDWR;
+	}
+	// the kernel writes back at the offsets it determined itself,
+	// with O_APPEND the data would end up at the end of the file
+	return (nFlags & ~O_APPEND);
+}
+
+FsPropFaker* FakeFs::getFsPropFaker() const noexcept
+{
+	return m_p0FsPropFaker;
+}
+FsLogger* FakeFs::getFsLogger() const noexcept
+{
+	return m_refLogger.get();
+}
+
+std::string FakeFs::getStatVFS(struct ::statvfs& oStatFs) noexcept
+{
+	const int nErrno = readRealStatVFS(oStatFs);
+	if (nErrno != 0) {
+		return m_sRootPath + ": " + std::string("Error ") + std::string(::strerror(nErrno)); //--
+	}
+	return "";
+}
+int FakeFs::readRealStatVFS(struct ::statvfs& oStatFs) noexcept
+{
+	if (m_refStatsPoller) {
+		const RealStats oRealStats = m_oRealStats.load();
+		oStatFs = oRealStats.m_oStatFs;
+		return oRealStats.m_nErrno; //------------------------------------------
+	}
+	if (::fstatvfs(m_nRootFd, &oStatFs) != 0) {
+		return errno; //--------------------------------------------------------
+	}
+	return 0;
+}
+int FakeFs::getFakeStatVFS(struct ::statvfs& oStatFs) noexcept
+{
+	auto& oLog = *m_refLogger;
+
+	// get stats for underlying filesystem (possibly cached)
+	const int nErrno = readRealStatVFS(oStatFs);
+	const int nRetStat = -nErrno;
+	oLog.log_retstat("statvfs", nRetStat);
+	if (nErrno != 0) {
+		return nRetStat; //-----------------------------------------------------
+	}
+	oLog.log_statvfs(&oStatFs);
+
+	const unsigned long nFragmentSize = oStatFs.f_frsize;
+	if (m_nBlockSize != static_cast<int64_t>(nFragmentSize)) {
+		oLog.log_msg("\ninternal error block size\n");
+		return -EOVERFLOW; //---------------------------------------------------
+	}
+
+	int64_t nFsSizeInFragments = static_cast<int64_t>(oStatFs.f_blocks);
+	int64_t nFreeFragments = static_cast<int64_t>(oStatFs.f_bavail);
+	int64_t nFreeishFragments = static_cast<int64_t>(oStatFs.f_bfree);
+	const int64_t nDeltaFree = nFreeishFragments - nFreeFragments;
+
+	// store real data
+	m_nRealDiskSizeInBlocks.store(nFsSizeInFragments, std::memory_order_relaxed);
+	m_nRealFreeSizeInBlocks.store(nFreeFragments, std::memory_order_relaxed);
+	// modifying data
+	const FakeSizes oFakeSizes = m_oFakeSizes.load();
+	const bool bUseFakeFixedDiskSize = oFakeSizes.m_bUseFakeFixedDiskSize;
+	const bool bUseFakeFixedFreeSize = oFakeSizes.m_bUseFakeFixedFreeSize;
+	const int64_t nFakeDiskSizeInBlocks = oFakeSizes.m_nFakeDiskSizeInBlocks;
+	const int64_t nFakeFreeSizeInBlocks = oFakeSizes.m_nFakeFreeSizeInBlocks;
+	if (bUseFakeFixedDiskSize) {
+		nFsSizeInFragments = nFakeDiskSizeInBlocks;
+	} else if (nFakeDiskSizeInBlocks != 0) {
+		nFsSizeInFragments += nFakeDiskSizeInBlocks;
+		if (nFsSizeInFragments < 0) {
+			nFsSizeInFragments = 0;
+		}
+	}
+	if (bUseFakeFixedFreeSize) {
+		nFreeFragments = std::min(nFakeFreeSizeInBlocks, nFsSizeInFragments);
+	} else if (nFakeFreeSizeInBlocks != 0) {
+		nFreeFragments += nFakeFreeSizeInBlocks;
+		if (nFreeFragments < 0) {
+			nFreeFragments= 0;
+		} else if (nFreeFragments > nFsSizeInFragments) {
+			nFreeFragments = nFsSizeInFragments;
+		}
+	}
+
+	oStatFs.f_blocks = static_cast<fsblkcnt_t>(nFsSizeInFragments);
+	oStatFs.f_bavail = static_cast<fsblkcnt_t>(nFreeFragments);
+	oStatFs.f_bfree = static_cast<fsblkcnt_t>(nFreeFragments + nDeltaFree);
+	oLog.log_msg("\n     new f_blocks %lld \n", oStatFs.f_blocks);
+	oLog.log_msg("     new f_bavail %lld \n", oStatFs.f_bavail);
+	oLog.log_msg("     new f_bfree %lld \n", oStatFs.f_bfree);
+	oLog.log_msg("     nRetStat %d \n", nRetStat);
+
+	return nRetStat;
+}
+void FakeFs::refreshRealStats() noexcept
+{
+	struct ::statvfs oStatFs;
+	const int nErrno = ((::fstatvfs(m_nRootFd, &oStatFs) == 0) ? 0 : errno);
+	m_oRealStats.update([&](RealStats& oRealStats)
+	{
+		oRealStats.m_nErrno = nErrno;
+		if (nErrno == 0) {
+			oRealStats.m_oStatFs = oStatFs;
+		}
+	});
+}
+void FakeFs::startStatsPoller(double fTTL) noexcept
+{
+	// the cache must be valid before the first statfs
+	refreshRealStats();
+	const auto oInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+																std::chrono::duration<double>(fTTL));
+	m_refStatsPoller = std::make_unique<std::thread>([this, oInterval]()
+	{
+		std::unique_lock<std::mutex> oLock(m_oStatsPollerMutex);
+		while (! m_oStatsPollerCond.wait_for(oLock, oInterval, [&](){ return m_bStopStatsPoller; })) {
+			oLock.unlock();
+			refreshRealStats();
+			oLock.lock();
+		}
+	});
+}
+void FakeFs::stopStatsPoller() noexcept
+{
+	if (! m_refStatsPoller) {
+		return; //--------------------------------------------------------------
+	}
+	{
+		std::lock_guard<std::mutex> oLock(m_oStatsPollerMutex);
+		m_bStopStatsPoller = true;
+	}
+	m_oStatsPollerCond.notify_one();
+	m_refStatsPoller->join();
+	m_refStatsPoller.reset();
+}
+
+int64_t FakeFs::getRealDiskSizeInBlocks() noexcept
+{
+	struct ::statvfs oStatFs;
+	const std::string sErr = getStatVFS(oStatFs);
+	if (! sErr.empty()) {
+		return m_nRealDiskSizeInBlocks.load(std::memory_order_relaxed); //------
+	}
+
+	const int64_t nFsSizeInFragments = static_cast<int64_t>(oStatFs.f_blocks);
+	//int64_t nFreeFragments = static_cast<int64_t>(oStatFs.f_bavail);
+
+	m_nRealDiskSizeInBlocks.store(nFsSizeInFragments, std::memory_order_relaxed);
+	return nFsSizeInFragments;
+}
+int64_t FakeFs::getRealFreeSizeInBlocks() noexcept
+{
+	struct ::statvfs oStatFs;
+	const std::string sErr = getStatVFS(oStatFs);
+	if (! sErr.empty()) {
+		return m_nRealFreeSizeInBlocks.load(std::memory_order_relaxed); //------
+	}
+	//const int64_t nFsSizeInFragments = static_cast<int64_t>(oStatFs.f_blocks);
+	const int64_t nFreeFragments = static_cast<int64_t>(oStatFs.f_bavail);
+	m_nRealFreeSizeInBlocks.store(nFreeFragments, std::memory_order_relaxed);
+	return nFreeFragments;
+}
+
+void FakeFs::setFakeDiskSizeInBlocks(int64_t nSizeBlocks) noexcept
+{
+	m_oFakeSizes.update([&](FakeSizes& oSizes)
+	{
+		oSizes.m_bUseFakeFixedDiskSize = true;
+		oSizes.m_nFakeDiskSizeInBlocks = nSizeBlocks;
+	});
+}
+void FakeFs::setFakeDiskSizeDiffInBlocks(int64_t nSizeBlocks) noexcept
+{
+	m_oFakeSizes.update([&](FakeSizes& oSizes)
+	{
+		oSizes.m_bUseFakeFixedDiskSize = false;
+		oSizes.m_nFakeDiskSizeInBlocks = nSizeBlocks;
+	});
+}
+void FakeFs::setFakeFreeSizeInBlocks(int64_t nSizeBlocks) noexcept
+{
+	m_oFakeSizes.update([&](FakeSizes& oSizes)
+	{
+		oSizes.m_bUseFakeFixedFreeSize = true;
+		oSizes.m_nFakeFreeSizeInBlocks = nSizeBlocks;
+	});
+}
+void FakeFs::setFakeFreeSizeDiffInBlocks(int64_t nSizeBlocks) noexcept
+{
+	m_oFakeSizes.update([&](FakeSizes& oSizes)
+	{
+		oSizes.m_bUseFakeFixedFreeSize = false;
+		oSizes.m_nFakeFreeSizeInBlocks = nSizeBlocks;
+	});
+}
+
+} // namespace fspf
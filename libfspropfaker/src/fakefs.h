@@ -0,0 +1,162 @@
+/*
+ * Copyright © 2020  Stefano Marsili, <stemars@gmx.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+/*
+ * File:   fakefs.h
+ */
+
+#ifndef FSPF_FAKE_FS_H
+#define FSPF_FAKE_FS_H
+
+#include "fslogger.h"
+#include "seqlock.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+
+#include <stdint.h>
+#include <sys/statvfs.h>
+
+namespace fspf
+{
+
+using std::unique_ptr;
+using std::shared_ptr;
+using std::weak_ptr;
+
+class FsPropFaker;
+class FsDispatcher;
+
+/** The state shared by the fuse backends.
+ * A backend serves the fuse requests for the underlying folder and fakes
+ * the sizes returned by statfs.
+ */
+class FakeFs
+{
+public:
+	virtual ~FakeFs() noexcept;
+
+	// mounts the file system and creates the fuse instance
+	// returns empty string if successful, the error otherwise
+	virtual std::string mount(int nArgC, char** aArgV) noexcept = 0;
+	// serves requests with the thread model requested in the options until unmounted
+	// returns 0 if successful, -1 otherwise
+	virtual int loop() noexcept = 0;
+	// unmounts the file system if still mounted and destroys the fuse instance
+	virtual void teardown() noexcept = 0;
+	// serves requests with the threads of the dispatcher instead of loop()
+	// oOnEnd is called by a dispatcher thread after teardown()
+	// returns empty string if successful, the error otherwise
+	virtual std::string dispatch(FsDispatcher& oDispatcher, std::function<void()>&& oOnEnd) noexcept = 0;
+	// can be called from any thread to make loop() return
+	virtual void exitSession() noexcept = 0;
+	// the paths of the files and folders currently open
+	std::vector<std::string> getOpenPaths() const noexcept;
+
+	FsPropFaker* getFsPropFaker() const noexcept;
+	FsLogger* getFsLogger() const noexcept;
+
+	int64_t getRealDiskSizeInBlocks() noexcept;
+	int64_t getRealFreeSizeInBlocks() noexcept;
+	// reads the statistics of the underlying file system into the cache
+	void refreshRealStats() noexcept;
+
+	void setFakeDiskSizeInBlocks(int64_t nSizeBlocks) noexcept;
+	void setFakeDiskSizeDiffInBlocks(int64_t nSizeBlocks) noexcept;
+	void setFakeFreeSizeInBlocks(int64_t nSizeBlocks) noexcept;
+	void setFakeFreeSizeDiffInBlocks(int64_t nSizeBlocks) noexcept;
+
+protected:
+	FakeFs(FsPropFaker* p0FsPropFaker, std::function<void()>&& oCallback) noexcept;
+	std::string initInstance() noexcept;
+
+	// detaches the mount point without touching the fuse device
+	void unmountLazily() noexcept;
+	// the statistics of the underlying file system, cached if the poller runs
+	// returns 0 if successful, the errno otherwise
+	int readRealStatVFS(struct ::statvfs& oStatFs) noexcept;
+	// the statistics of the underlying file system with the fake sizes applied
+	// returns 0 if successful, a negative errno otherwise
+	int getFakeStatVFS(struct ::statvfs& oStatFs) noexcept;
+	void addOpenHandle(uint64_t nFh, const char* p0Path) noexcept;
+	void removeOpenHandle(uint64_t nFh) noexcept;
+	// the flags the underlying file has to be opened with for the flags of a fuse open
+	int getUnderlyingOpenFlags(int nFlags) const noexcept;
+private:
+	std::string getStatVFS(struct ::statvfs& oStatFs) noexcept;
+	void startStatsPoller(double fTTL) noexcept;
+	void stopStatsPoller() noexcept;
+protected:
+	FsPropFaker* m_p0FsPropFaker;
+	const std::string& m_sMountName;
+	const std::string& m_sRootPath;
+	const int m_nRootFd; // the root folder opened with O_PATH, owned by m_p0FsPropFaker
+	const std::string& m_sLogFilePath;
+	int64_t m_nBlockSize;
+
+	unique_ptr<FsLogger> m_refLogger;
+
+	std::function<void()> m_oCallback;
+
+	std::atomic<bool> m_bUnmounted{false};
+	// set by init if requested and supported by the kernel
+	bool m_bWritebackCache = false;
+private:
+	// Key: fuse_file_info::fh, Value: the path within the mount.
+	mutable std::mutex m_oOpenHandlesMutex;
+	std::unordered_map<uint64_t, std::string> m_oOpenHandles;
+
+	// the last sizes returned by the underlying file system, if negative not determined yet.
+	std::atomic<int64_t> m_nRealDiskSizeInBlocks{-1};
+	std::atomic<int64_t> m_nRealFreeSizeInBlocks{-1};
+	struct FakeSizes
+	{
+		bool m_bUseFakeFixedDiskSize = false; // if false m_nFakeDiskSizeInBlocks must be added to real disk size.
+		bool m_bUseFakeFixedFreeSize = false; // if false m_nFakeFreeSizeInBlocks must be added to real free size.
+		int64_t m_nFakeDiskSizeInBlocks = 0; // 1000000 bytes.
+		int64_t m_nFakeFreeSizeInBlocks = 0; // 1000000 bytes.
+	};
+	// statfs reads the fake sizes without ever waiting for the setters
+	SeqLock<FakeSizes> m_oFakeSizes;
+
+	struct RealStats
+	{
+		int m_nErrno = 0; // if not 0 the last refresh failed and m_oStatFs is the last good one
+		struct ::statvfs m_oStatFs;
+	};
+	// only used if the poller runs
+	SeqLock<RealStats> m_oRealStats;
+	unique_ptr<std::thread> m_refStatsPoller;
+	std::mutex m_oStatsPollerMutex;
+	std::condition_variable m_oStatsPollerCond;
+	bool m_bStopStatsPoller = false;
+
+private:
+	FakeFs() = delete;
+	FakeFs(const FakeFs& oSource) = delete;
+	FakeFs& operator=(const FakeFs& oSource) = delete;
+};
+
+} // namespace fspf
+
+#endif /* FSPF_FAKE_FS_H */
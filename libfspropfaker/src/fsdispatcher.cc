@@ -0,0 +1,270 @@
+/*
+ * Copyright © 2020  Stefano Marsili, <stemars@gmx.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+/*
+ * File:   fsdispatcher.cc
+ */
+
+#include "fsdispatcher.h"
+
+#include "fusepp/Fuse.h"
+
+#include <fuse_lowlevel.h>
+
+#include <cassert>
+#include <atomic>
+#include <system_error>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+namespace fspf
+{
+
+static constexpr int32_t s_nMaxDispatcherThreads = 1024;
+
+struct FsDispatcher::Session
+{
+	struct fuse_session* m_p0Session = nullptr;
+	struct fuse_chan* m_p0Chan = nullptr;
+	int m_nFd = -1;
+	std::function<void()> m_oOnEnd;
+	// The threads currently receiving or processing a request of this session.
+	// The registration is one shot: only the thread that was woken up reads the
+	// fuse device and it re-arms it before processing the request. The thread
+	// that reads the end of the connection doesn't re-arm it, so no new thread
+	// can join and the last one to leave ends the session.
+	std::atomic<int32_t> m_nActive{0};
+	std::atomic<bool> m_bEnding{false};
+	#if FUSE_USE_VERSION < 35
+	#else
+	// The receive buffer of each thread, indexed by the thread. libfuse allocates
+	// it with the size of this session, which depends on its options.
+	std::vector<struct fuse_buf> m_aBufs;
+	~Session() noexcept
+	{
+		for (auto& oBuf : m_aBufs) {
+			::free(oBuf.mem);
+		}
+	}
+	#endif
+};
+
+FsDispatcher::CreateResult FsDispatcher::create(int32_t nThreads) noexcept
+{
+	CreateResult oResult;
+	if ((nThreads <= 0) || (nThreads > s_nMaxDispatcherThreads)) {
+		oResult.m_sError = "Dispatcher threads must be between 1 and " + std::to_string(s_nMaxDispatcherThreads);
+		return oResult; //------------------------------------------------------
+	}
+	auto refDispatcher = shared_ptr<FsDispatcher>(new FsDispatcher());
+	oResult.m_sError = refDispatcher->init(nThreads);
+	if (! oResult.m_sError.empty()) {
+		return oResult; //------------------------------------------------------
+	}
+	oResult.m_refDispatcher = std::move(refDispatcher);
+	return oResult;
+}
+
+FsDispatcher::FsDispatcher() noexcept
+{
+}
+FsDispatcher::~FsDispatcher() noexcept
+{
+	if (m_nStopFd >= 0) {
+		const uint64_t nOne = 1;
+		// level triggered: stays readable and wakes up all the threads
+		if (::write(m_nStopFd, &nOne, sizeof(nOne)) != sizeof(nOne)) {
+			assert(false);
+		}
+	}
+	for (auto& oThread : m_aThreads) {
+		oThread.join();
+	}
+	// the fakers own a reference to the dispatcher, no session can be left
+	assert(m_oSessions.empty());
+	if (m_nStopFd >= 0) {
+		::close(m_nStopFd);
+	}
+	if (m_nEpollFd >= 0) {
+		::close(m_nEpollFd);
+	}
+}
+
+std::string FsDispatcher::init(int32_t nThreads) noexcept
+{
+	m_nEpollFd = ::epoll_create1(EPOLL_CLOEXEC);
+	if (m_nEpollFd < 0) {
+		return std::string("epoll_create1: ") + ::strerror(errno); //-----------
+	}
+	m_nStopFd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (m_nStopFd < 0) {
+		return std::string("eventfd: ") + ::strerror(errno); //-----------------
+	}
+	struct ::epoll_event oEvent{};
+	oEvent.events = EPOLLIN;
+	oEvent.data.ptr = nullptr;
+	if (::epoll_ctl(m_nEpollFd, EPOLL_CTL_ADD, m_nStopFd, &oEvent) != 0) {
+		return std::string("epoll_ctl: ") + ::strerror(errno); //---------------
+	}
+	try {
+		for (int32_t nIdx = 0; nIdx < nThreads; ++nIdx) {
+			m_aThreads.emplace_back([this, nIdx]() { run(nIdx); });
+		}
+	} catch (const std::system_error& oErr) {
+		return std::string("Could not create dispatcher thread: ") + oErr.what(); //--
+	}
+	return "";
+}
+
+int32_t FsDispatcher::getTotThreads() const noexcept
+{
+	return static_cast<int32_t>(m_aThreads.size());
+}
+int32_t FsDispatcher::getTotSessions() noexcept
+{
+	std::lock_guard<std::mutex> oLock(m_oSessionsMutex);
+	return static_cast<int32_t>(m_oSessions.size());
+}
+
+std::string FsDispatcher::addSession(struct fuse_session* p0Session, struct fuse_chan* p0Chan
+									, std::function<void()>&& oOnEnd) noexcept
+{
+	assert(p0Session != nullptr);
+	assert(oOnEnd);
+	auto refSession = std::make_unique<Session>();
+	Session* p0S = refSession.get();
+	p0S->m_p0Session = p0Session;
+	p0S->m_p0Chan = p0Chan;
+	#if FUSE_USE_VERSION < 35
+	assert(p0Chan != nullptr);
+	p0S->m_nFd = ::fuse_chan_fd(p0Chan);
+	#else
+	assert(p0Chan == nullptr);
+	p0S->m_nFd = ::fuse_session_fd(p0Session);
+	p0S->m_aBufs.resize(m_aThreads.size(), fuse_buf{});
+	#endif
+	p0S->m_oOnEnd = std::move(oOnEnd);
+	{
+		std::lock_guard<std::mutex> oLock(m_oSessionsMutex);
+		m_oSessions.emplace(p0S, std::move(refSession));
+	}
+	struct ::epoll_event oEvent{};
+	oEvent.events = EPOLLIN | EPOLLONESHOT;
+	oEvent.data.ptr = p0S;
+	if (::epoll_ctl(m_nEpollFd, EPOLL_CTL_ADD, p0S->m_nFd, &oEvent) != 0) {
+		const std::string sErr = std::string("epoll_ctl: ") + ::strerror(errno);
+		std::lock_guard<std::mutex> oLock(m_oSessionsMutex);
+		m_oSessions.erase(p0S);
+		return sErr; //---------------------------------------------------------
+	}
+	return "";
+}
+
+bool FsDispatcher::rearm(Session* p0S) noexcept
+{
+	struct ::epoll_event oEvent{};
+	oEvent.events = EPOLLIN | EPOLLONESHOT;
+	oEvent.data.ptr = p0S;
+	return (::epoll_ctl(m_nEpollFd, EPOLL_CTL_MOD, p0S->m_nFd, &oEvent) == 0);
+}
+
+void FsDispatcher::releaseSession(Session* p0S) noexcept
+{
+	if (p0S->m_nActive.fetch_sub(1) != 1) {
+		return; //--------------------------------------------------------------
+	}
+	if (! p0S->m_bEnding) {
+		return; //--------------------------------------------------------------
+	}
+	// last thread out of an ended session
+	unique_ptr<Session> refSession;
+	{
+		std::lock_guard<std::mutex> oLock(m_oSessionsMutex);
+		auto itFind = m_oSessions.find(p0S);
+		assert(itFind != m_oSessions.end());
+		refSession = std::move(itFind->second);
+		m_oSessions.erase(itFind);
+	}
+	refSession->m_oOnEnd();
+}
+
+void FsDispatcher::run(int32_t nThreadIdx) noexcept
+{
+	#if FUSE_USE_VERSION < 35
+	(void)nThreadIdx;
+	// grown to the biggest buffer size of the served sessions
+	std::vector<char> aBuf;
+	#endif
+	while (true) {
+		struct ::epoll_event oEvent;
+		const int nTotEvents = ::epoll_wait(m_nEpollFd, &oEvent, 1, -1);
+		if (nTotEvents < 0) {
+			if (errno == EINTR) {
+				continue; // while ----
+			}
+			break; // while ----
+		}
+		if (nTotEvents == 0) {
+			continue; // while ----
+		}
+		Session* p0S = static_cast<Session*>(oEvent.data.ptr);
+		if (p0S == nullptr) {
+			// the dispatcher is being destroyed
+			break; // while ----
+		}
+		++p0S->m_nActive;
+		#if FUSE_USE_VERSION < 35
+		struct fuse_chan* p0TmpChan = p0S->m_p0Chan;
+		const size_t nBufSize = ::fuse_chan_bufsize(p0TmpChan);
+		if (aBuf.size() < nBufSize) {
+			aBuf.resize(nBufSize);
+		}
+		struct fuse_buf oBuf{};
+		oBuf.mem = aBuf.data();
+		oBuf.size = nBufSize;
+		const int nRes = ::fuse_session_receive_buf(p0S->m_p0Session, &oBuf, &p0TmpChan);
+		#else
+		struct fuse_buf& oBuf = p0S->m_aBufs[static_cast<size_t>(nThreadIdx)];
+		const int nRes = ::fuse_session_receive_buf(p0S->m_p0Session, &oBuf);
+		#endif
+		if ((nRes > 0) || (nRes == -EINTR)) {
+			if (! rearm(p0S)) {
+				// cannot wait for this session anymore
+				p0S->m_bEnding = true;
+				::fuse_session_exit(p0S->m_p0Session);
+			}
+		} else {
+			// 0 means unmounted
+			p0S->m_bEnding = true;
+			::epoll_ctl(m_nEpollFd, EPOLL_CTL_DEL, p0S->m_nFd, nullptr);
+		}
+		if (nRes > 0) {
+			#if FUSE_USE_VERSION < 35
+			::fuse_session_process_buf(p0S->m_p0Session, &oBuf, p0TmpChan);
+			#else
+			::fuse_session_process_buf(p0S->m_p0Session, &oBuf);
+			#endif
+		}
+		releaseSession(p0S);
+	}
+}
+
+} // namespace fspf
@@ -43,24 +43,94 @@
 #include <cassert>
 #include <memory>
 #include <string>
+#include <algorithm>
+#include <chrono>
+#include <system_error>
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <time.h>
 #include <sys/statvfs.h>
+#include <sys/syscall.h>
 
 
 using std::unique_ptr;
 using std::shared_ptr;
 using std::weak_ptr;
 
+#ifndef FSPROPFAKER_WITHOUT_LOGGING
+
 namespace fspf
 {
 
-std::pair<unique_ptr<FsLogger>, std::string> FsLogger::create(const std::string& sMountName, const std::string& sLogFilePath) noexcept
+// 2 MiB of queued messages
+static constexpr uint32_t s_nLogRingSlots = 16 * 1024;
+// the writer's latency if the ring doesn't fill up
+static constexpr int32_t s_nWriterIntervalMillisec = 20;
+// the longest formatted message (paths included)
+static constexpr size_t s_nMaxRecordSize = PATH_MAX + 1024;
+// a path record with the longest path
+static constexpr size_t s_nMaxTracePathRecordSize = sizeof(TraceRecord)
+											+ (PATH_MAX + sizeof(TraceRecord) - 1) / sizeof(TraceRecord) * sizeof(TraceRecord);
+// the paths remembered by the trace before they are forgotten and written again
+static constexpr size_t s_nMaxTracePaths = 64 * 1024;
+
+// the op served by the thread, selects the log level and stores the results of the syscalls
+static thread_local FsLogger::TraceOp* s_p0CurrentTraceOp = nullptr;
+// cached, gettid is a syscall
+static thread_local uint32_t s_nTraceThread = 0;
+
+// the LOG_CATEGORY of an op, 0 if it's logged whatever the categories
+static int32_t getOpCategory(TRACE_OP eOp) noexcept
+{
+	switch (eOp) {
+	case TRACE_OP_INIT:
+	case TRACE_OP_DESTROY:
+		return 0; //------------------------------------------------------------
+	case TRACE_OP_OPEN:
+	case TRACE_OP_READ:
+	case TRACE_OP_WRITE:
+	case TRACE_OP_FLUSH:
+	case TRACE_OP_RELEASE:
+	case TRACE_OP_FSYNC:
+	case TRACE_OP_FALLOCATE:
+	case TRACE_OP_COPY_FILE_RANGE:
+	case TRACE_OP_LSEEK:
+		return FsPropFaker::LOG_CATEGORY_DATA; //-------------------------------
+	case TRACE_OP_SETXATTR:
+	case TRACE_OP_GETXATTR:
+	case TRACE_OP_LISTXATTR:
+	case TRACE_OP_REMOVEXATTR:
+		return FsPropFaker::LOG_CATEGORY_XATTR; //------------------------------
+	case TRACE_OP_OPENDIR:
+	case TRACE_OP_READDIR:
+	case TRACE_OP_RELEASEDIR:
+	case TRACE_OP_FSYNCDIR:
+		return FsPropFaker::LOG_CATEGORY_DIR; //--------------------------------
+	case TRACE_OP_STATFS:
+		return FsPropFaker::LOG_CATEGORY_STATFS; //-----------------------------
+	default:
+		return FsPropFaker::LOG_CATEGORY_META; //-------------------------------
+	}
+}
+
+static int64_t getMonotonicNs() noexcept
+{
+	struct ::timespec oNow;
+	::clock_gettime(CLOCK_MONOTONIC, &oNow);
+	return static_cast<int64_t>(oNow.tv_sec) * 1000000000 + oNow.tv_nsec;
+}
+
+std::pair<unique_ptr<FsLogger>, std::string> FsLogger::create(const std::string& sMountName, const std::string& sLogFilePath
+																, bool bBinaryTrace, TRACE_BACKEND eBackend) noexcept
 {
 	auto refLogger = std::unique_ptr<FsLogger>(new FsLogger(sMountName, sLogFilePath));
-	std::string sErr = refLogger->init();
+	std::string sErr = refLogger->init(bBinaryTrace, eBackend);
 	if (! sErr.empty()) {
 		return std::make_pair(unique_ptr<FsLogger>{}, std::move(sErr));
 	}
@@ -71,7 +141,7 @@ FsLogger::FsLogger(const std::string& sMountName, const std::string& sLogFilePat
 , m_sLogFilePath(sLogFilePath)
 {
 }
-std::string FsLogger::init() noexcept
+std::string FsLogger::init(bool bBinaryTrace, TRACE_BACKEND eBackend) noexcept
 {
 	if (m_sLogFilePath.empty()) {
 		// no logging
@@ -83,18 +153,103 @@ std::string FsLogger::init() noexcept
 		const std::string sLogFileName = m_sMountName + ".log";
 		sLogFilePath += "/" + sLogFileName;
 	}
-	m_p0LogFile = ::fopen(sLogFilePath.c_str(), "w");
-	if (m_p0LogFile == nullptr) {
+	m_nLogFd = ::open(sLogFilePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (m_nLogFd < 0) {
 		return std::string{"Could not open log file "} + sLogFilePath;
 	}
-	// set logfile to line buffering
-	::setvbuf(m_p0LogFile, NULL, _IOLBF, 0);
+	m_eBackend = eBackend;
+	if (bBinaryTrace) {
+		TraceHeader oHeader{};
+		::memcpy(oHeader.m_aMagic, s_aTraceMagic, sizeof(oHeader.m_aMagic));
+		oHeader.m_nVersion = s_nTraceVersion;
+		oHeader.m_nRecordSize = sizeof(TraceRecord);
+		struct ::timespec oNow;
+		::clock_gettime(CLOCK_REALTIME, &oNow);
+		oHeader.m_nStartTimeNs = static_cast<int64_t>(oNow.tv_sec) * 1000000000 + oNow.tv_nsec;
+		m_nTraceStartNs = getMonotonicNs();
+		oHeader.m_nBackend = eBackend;
+		::strncpy(oHeader.m_aMountName, m_sMountName.c_str(), sizeof(oHeader.m_aMountName) - 1);
+		writeAll(std::string(reinterpret_cast<const char*>(&oHeader), sizeof(oHeader)));
+		m_bBinaryTrace = true;
+	}
+	m_refRing = std::make_unique<LogRing>(s_nLogRingSlots);
+	assert(s_nMaxTracePathRecordSize <= m_refRing->getMaxRecordSize());
+	try {
+		m_refWriter = std::make_unique<std::thread>([this]() { runWriter(); });
+	} catch (const std::system_error& oErr) {
+		return std::string("Could not create log writer thread: ") + oErr.what(); //--
+	}
 	return "";
 }
 FsLogger::~FsLogger() noexcept
 {
-	if (m_p0LogFile != nullptr) {
-		::fclose(m_p0LogFile);
+	if (m_refWriter) {
+		{
+			std::lock_guard<std::mutex> oLock(m_oWriterMutex);
+			m_bStopWriter = true;
+		}
+		m_oWriterCond.notify_one();
+		m_refWriter->join();
+	}
+	if (m_nLogFd >= 0) {
+		::close(m_nLogFd);
+	}
+}
+
+void FsLogger::push(const char* p0Data, size_t nLen) noexcept
+{
+	while (! m_refRing->tryPush(p0Data, nLen)) {
+		// the writer is behind, never lose a message
+		wakeWriter();
+		std::this_thread::yield();
+	}
+	if (m_refRing->isHalfFull()) {
+		wakeWriter();
+	}
+}
+void FsLogger::wakeWriter() noexcept
+{
+	{
+		std::lock_guard<std::mutex> oLock(m_oWriterMutex);
+		m_bWakeWriter = true;
+	}
+	m_oWriterCond.notify_one();
+}
+void FsLogger::runWriter() noexcept
+{
+	std::string sBatch;
+	std::unique_lock<std::mutex> oLock(m_oWriterMutex);
+	while (true) {
+		m_oWriterCond.wait_for(oLock, std::chrono::milliseconds(s_nWriterIntervalMillisec)
+								, [&](){ return m_bWakeWriter || m_bStopWriter; });
+		const bool bStop = m_bStopWriter;
+		m_bWakeWriter = false;
+		oLock.unlock();
+		// when stopping no other thread logs anymore
+		m_refRing->popAll(sBatch);
+		writeAll(sBatch);
+		sBatch.clear();
+		oLock.lock();
+		if (bStop) {
+			break; // while ----
+		}
+	}
+}
+void FsLogger::writeAll(const std::string& sText) noexcept
+{
+	const char* p0Text = sText.data();
+	size_t nLeft = sText.size();
+	while (nLeft > 0) {
+		const ssize_t nWritten = ::write(m_nLogFd, p0Text, nLeft);
+		if (nWritten < 0) {
+			if (errno == EINTR) {
+				continue; // while ----
+			}
+			// ex. disk full, the messages are lost
+			break; // while ----
+		}
+		p0Text += nWritten;
+		nLeft -= static_cast<size_t>(nWritten);
 	}
 }
 
@@ -105,17 +260,36 @@ FsLogger::~FsLogger() noexcept
 
 void FsLogger::log_msg(const char* p0Format, ...)
 {
-	if (m_p0LogFile == nullptr) {
+	if (! isLoggingText(FsPropFaker::LOG_LEVEL_OPS)) {
 		return;
 	}
 	::va_list oAP;
 	::va_start(oAP, p0Format);
-
-	::vfprintf(m_p0LogFile, p0Format, oAP);
+	vpushFormatted(p0Format, oAP);
+	::va_end(oAP);
+}
+void FsLogger::pushFormatted(const char* p0Format, ...) noexcept
+{
+	::va_list oAP;
+	::va_start(oAP, p0Format);
+	vpushFormatted(p0Format, oAP);
+	::va_end(oAP);
+}
+void FsLogger::vpushFormatted(const char* p0Format, ::va_list oAP) noexcept
+{
+	const int nSavedErrno = errno;
+	char aRecord[s_nMaxRecordSize];
+	const int nLen = ::vsnprintf(aRecord, sizeof(aRecord), p0Format, oAP);
+	if (nLen > 0) {
+		// truncated if too long
+		const size_t nRecordLen = std::min({static_cast<size_t>(nLen), sizeof(aRecord) - 1, m_refRing->getMaxRecordSize()});
+		push(aRecord, nRecordLen);
+	}
+	errno = nSavedErrno;
 }
 void FsLogger::log_conn(struct fuse_conn_info* p0Conn)
 {
-	if (m_p0LogFile == nullptr) {
+	if (! isLoggingText(FsPropFaker::LOG_LEVEL_FULL)) {
 		return;
 	}
 
@@ -129,9 +303,11 @@ void FsLogger::log_conn(struct fuse_conn_info* p0Conn)
 	// unsigned proto_minor;
 	log_msg("     proto_minor = %d\n", p0Conn->proto_minor);
 
+	#if FUSE_USE_VERSION < 35
 	/** Is asynchronous read supported (read-write) */
 	// unsigned async_read;
 	log_msg("     async_read = %d\n", p0Conn->async_read);
+	#endif
 
 	/** Maximum size of the write buffer */
 	// unsigned max_write;
@@ -162,23 +338,54 @@ void FsLogger::log_conn(struct fuse_conn_info* p0Conn)
 }
 int FsLogger::log_error(const char* p0Func)
 {
-	int nRet = -errno;
+	return log_errno(p0Func, errno);
+}
+int FsLogger::log_errno(const char* p0Func, int nErrno)
+{
+	const int nRet = - nErrno;
 
-	log_msg("    ERROR %s: %s\n", p0Func, ::strerror(errno));
+	if (m_bBinaryTrace) {
+		setTraceResult(nRet);
+		return nRet; //---------------------------------------------------------
+	}
+	if (! isLoggingText(FsPropFaker::LOG_LEVEL_ERRORS)) {
+		return nRet; //---------------------------------------------------------
+	}
 
+	const bool bInOp = (s_p0CurrentTraceOp != nullptr) && (s_p0CurrentTraceOp->m_p0Log == this);
+	if ((! bInOp) || (s_p0CurrentTraceOp->m_nLogLevel >= FsPropFaker::LOG_LEVEL_OPS)) {
+		pushFormatted("    ERROR %s: %s\n", p0Func, ::strerror(nErrno));
+		return nRet; //---------------------------------------------------------
+	}
+	// the request itself wasn't logged
+	const TraceOp& oOp = *s_p0CurrentTraceOp;
+	const char* p0OpName = getTraceOpInfo(oOp.m_oRecord.m_nOp).m_p0Name;
+	const char* p0Path = ((oOp.m_p0Path != nullptr) ? oOp.m_p0Path : "");
+	if (m_eBackend == TRACE_BACKEND_LOW) {
+		pushFormatted("\nlow:%s(ino=%llu, name=\"%s\") ERROR %s: %s\n", p0OpName
+					, static_cast<unsigned long long>(oOp.m_oRecord.m_nIno), p0Path, p0Func, ::strerror(nErrno));
+	} else {
+		pushFormatted("\nover:%s(path=\"%s\") ERROR %s: %s\n", p0OpName, p0Path, p0Func, ::strerror(nErrno));
+	}
 	return nRet;
 }
 void FsLogger::log_fi(struct fuse_file_info* p0FI)
 {
+	if (! isLoggingText(FsPropFaker::LOG_LEVEL_FULL)) {
+		return;
+	}
+
 	log_msg("    fi:\n");
 
 	/** Open flags.  Available in open() and release() */
 	//	int flags;
 	log_msg("     flags = 0x%08x\n", p0FI->flags);
 
+	#if FUSE_USE_VERSION < 35
 	/** Old file handle, don't use */
 	//	unsigned long fh_old;	
 	log_msg("     fh_old = 0x%08lx\n", p0FI->fh_old);
+	#endif
 
 	/** In case of a write operation indicates if this was caused by a
 	    writepage */
@@ -209,6 +416,10 @@ void FsLogger::log_fi(struct fuse_file_info* p0FI)
 }
 void FsLogger::log_fuse_context(struct fuse_context* p0Context)
 {
+	if (! isLoggingText(FsPropFaker::LOG_LEVEL_FULL)) {
+		return;
+	}
+
 	log_msg("    context:\n");
 
 	/** Pointer to the fuse object */
@@ -240,12 +451,20 @@ void FsLogger::log_fuse_context(struct fuse_context* p0Context)
 }
 void FsLogger::log_retstat(const char* p0func, int nRetStat)
 {
+	if (m_bBinaryTrace) {
+		setTraceResult(nRetStat);
+		return; //--------------------------------------------------------------
+	}
 	int nErrSave = errno;
 	log_msg("    %s returned %d\n", p0func, nRetStat);
 	errno = nErrSave;
 }
 void FsLogger::log_stat(struct stat* p0StatBuf)
 {
+	if (! isLoggingText(FsPropFaker::LOG_LEVEL_FULL)) {
+		return;
+	}
+
 	log_msg("    si:\n");
 
 	//  dev_t     st_dev;     /* ID of device containing file */
@@ -290,6 +509,10 @@ void FsLogger::log_stat(struct stat* p0StatBuf)
 }
 void FsLogger::log_statvfs(struct ::statvfs* p0StatFs)
 {
+	if (! isLoggingText(FsPropFaker::LOG_LEVEL_FULL)) {
+		return;
+	}
+
 	log_msg("    sv:\n");
 
 	//  unsigned long  f_bsize;    /* file system block size */
@@ -337,8 +560,150 @@ int FsLogger::log_syscall(const char* p0func, int nRetStat, int nMinRet)
 	return nRetStat;
 
 }
+uint64_t FsLogger::getTraceTimeNs() const noexcept
+{
+	return static_cast<uint64_t>(getMonotonicNs() - m_nTraceStartNs);
+}
+int32_t FsLogger::getThreadLogLevel() const noexcept
+{
+	if ((s_p0CurrentTraceOp != nullptr) && (s_p0CurrentTraceOp->m_p0Log == this)) {
+		return s_p0CurrentTraceOp->m_nLogLevel; //------------------------------
+	}
+	// ex. the completion thread of io_uring
+	return m_nLogLevel.load(std::memory_order_relaxed);
+}
+void FsLogger::setLogLevel(FsPropFaker::LOG_LEVEL eLogLevel) noexcept
+{
+	m_nLogLevel.store(eLogLevel, std::memory_order_relaxed);
+}
+FsPropFaker::LOG_LEVEL FsLogger::getLogLevel() const noexcept
+{
+	return static_cast<FsPropFaker::LOG_LEVEL>(m_nLogLevel.load(std::memory_order_relaxed));
+}
+void FsLogger::setLogCategories(int32_t nLogCategories) noexcept
+{
+	m_nLogCategories.store(nLogCategories, std::memory_order_relaxed);
+}
+int32_t FsLogger::getLogCategories() const noexcept
+{
+	return m_nLogCategories.load(std::memory_order_relaxed);
+}
+void FsLogger::setTraceResult(int64_t nResult) noexcept
+{
+	// the completion thread of io_uring has no op
+	if ((s_p0CurrentTraceOp != nullptr) && (s_p0CurrentTraceOp->m_p0Log == this)) {
+		s_p0CurrentTraceOp->m_oRecord.m_nResult = static_cast<int32_t>(std::max<int64_t>(std::min<int64_t>(nResult, INT32_MAX), INT32_MIN));
+	}
+}
+uint32_t FsLogger::internTracePath(const char* p0Path) noexcept
+{
+	if (p0Path == nullptr) {
+		return 0; //------------------------------------------------------------
+	}
+	const size_t nLen = std::min<size_t>(::strlen(p0Path), PATH_MAX);
+	std::string sPath(p0Path, nLen);
+	std::lock_guard<std::mutex> oLock(m_oTracePathsMutex);
+	auto itFind = m_oTracePathIds.find(sPath);
+	if (itFind != m_oTracePathIds.end()) {
+		return itFind->second; //-----------------------------------------------
+	}
+	if (m_oTracePathIds.size() >= s_nMaxTracePaths) {
+		// Bound the memory, the paths used again get a new record.
+		// The ids keep growing, the records already queued stay valid.
+		m_oTracePathIds.clear();
+	}
+	const uint32_t nPathId = m_nNextTracePathId;
+	++m_nNextTracePathId;
+	if (m_nNextTracePathId == 0) {
+		// 0 means no path
+		m_nNextTracePathId = 1;
+	}
+	m_oTracePathIds.emplace(std::move(sPath), nPathId);
+
+	char aRecord[s_nMaxTracePathRecordSize];
+	TraceRecord oRecord{};
+	oRecord.m_nType = TRACE_RECORD_TYPE_PATH;
+	oRecord.m_nResult = static_cast<int32_t>(nLen);
+	oRecord.m_nPathId = nPathId;
+	const size_t nPaddedLen = (nLen + sizeof(TraceRecord) - 1) / sizeof(TraceRecord) * sizeof(TraceRecord);
+	::memcpy(aRecord, &oRecord, sizeof(TraceRecord));
+	::memcpy(aRecord + sizeof(TraceRecord), p0Path, nLen);
+	::memset(aRecord + sizeof(TraceRecord) + nLen, 0, nPaddedLen - nLen);
+	// queued while holding the lock so that it precedes the records using the id
+	push(aRecord, sizeof(TraceRecord) + nPaddedLen);
+	return nPathId;
+}
+void FsLogger::writeTraceOp(TraceOp& oOp) noexcept
+{
+	oOp.m_oRecord.m_nPathId = internTracePath(oOp.m_p0Path);
+	oOp.m_oRecord.m_nPath2Id = internTracePath(oOp.m_p0Path2);
+	push(reinterpret_cast<const char*>(&oOp.m_oRecord), sizeof(TraceRecord));
+}
+
+FsLogger::TraceOp::TraceOp(FsLogger& oLog, TRACE_OP eOp, pid_t nPid, const char* p0Path
+							, int64_t nArg0, int64_t nArg1, int64_t nArg2) noexcept
+: TraceOp(oLog, eOp, nPid, uint64_t{0}, p0Path, nArg0, nArg1, nArg2)
+{
+}
+FsLogger::TraceOp::TraceOp(FsLogger& oLog, TRACE_OP eOp, pid_t nPid, uint64_t nIno, const char* p0Name
+							, int64_t nArg0, int64_t nArg1, int64_t nArg2) noexcept
+: m_p0Log(((oLog.m_nLogFd >= 0) && (s_p0CurrentTraceOp == nullptr)) ? &oLog : nullptr)
+{
+	if (m_p0Log == nullptr) {
+		return; //--------------------------------------------------------------
+	}
+	s_p0CurrentTraceOp = this;
+	m_p0Path = p0Name;
+	m_oRecord = TraceRecord{};
+	m_oRecord.m_nOp = static_cast<uint16_t>(eOp);
+	m_oRecord.m_nIno = nIno;
+	if (! oLog.m_bBinaryTrace) {
+		const int32_t nCategory = getOpCategory(eOp);
+		if ((nCategory == 0) || ((oLog.m_nLogCategories.load(std::memory_order_relaxed) & nCategory) != 0)) {
+			m_nLogLevel = oLog.m_nLogLevel.load(std::memory_order_relaxed);
+		}
+		return; //--------------------------------------------------------------
+	}
+	if (s_nTraceThread == 0) {
+		s_nTraceThread = static_cast<uint32_t>(::syscall(SYS_gettid));
+	}
+	m_oRecord.m_nType = TRACE_RECORD_TYPE_OP;
+	m_oRecord.m_nThread = s_nTraceThread;
+	m_oRecord.m_nPid = static_cast<uint32_t>(nPid);
+	m_oRecord.m_aArgs[0] = nArg0;
+	m_oRecord.m_aArgs[1] = nArg1;
+	m_oRecord.m_aArgs[2] = nArg2;
+	m_oRecord.m_nTimeNs = m_p0Log->getTraceTimeNs();
+}
+FsLogger::TraceOp::~TraceOp() noexcept
+{
+	if (m_p0Log == nullptr) {
+		return; //--------------------------------------------------------------
+	}
+	s_p0CurrentTraceOp = nullptr;
+	if (! m_p0Log->m_bBinaryTrace) {
+		return; //--------------------------------------------------------------
+	}
+	const int nSavedErrno = errno;
+	m_oRecord.m_nDurationNs = m_p0Log->getTraceTimeNs() - m_oRecord.m_nTimeNs;
+	m_p0Log->writeTraceOp(*this);
+	errno = nSavedErrno;
+}
+void FsLogger::TraceOp::setSecond(uint64_t nIno2, const char* p0Path2) noexcept
+{
+	if (m_p0Log == nullptr) {
+		return; //--------------------------------------------------------------
+	}
+	m_oRecord.m_nIno2 = nIno2;
+	m_p0Path2 = p0Path2;
+}
+
 void FsLogger::log_utime(struct utimbuf* p0Buf)
 {
+	if (! isLoggingText(FsPropFaker::LOG_LEVEL_FULL)) {
+		return;
+	}
+
 	log_msg("    buf:\n");
 
 	//    time_t actime;
@@ -349,3 +714,5 @@ void FsLogger::log_utime(struct utimbuf* p0Buf)
 }
 
 } // namespace fspf
+
+#endif // FSPROPFAKER_WITHOUT_LOGGING
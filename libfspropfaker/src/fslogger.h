@@ -21,12 +21,25 @@
 #ifndef FS_LOGGER_H
 #define FS_LOGGER_H
 
+#include "fspropfaker.h"
+#include "logring.h"
+#include "fstrace.h"
+
 #include "fusepp/Fuse.h"
 
 #include <memory>
 #include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <atomic>
 
 #include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <utime.h>
+#include <sys/types.h>
 
 namespace fspf
 {
@@ -35,20 +48,70 @@ using std::unique_ptr;
 using std::shared_ptr;
 using std::weak_ptr;
 
-class FsPropFaker;
+#ifndef FSPROPFAKER_WITHOUT_LOGGING
 
 /** Fuse specific logger.
+ * The messages are formatted by the calling thread and queued to a ring
+ * buffer. A background thread writes them to the log file in big chunks.
+ *
+ * The messages of a request are only formatted if the level and the
+ * categories (see FsPropFaker::LOG_LEVEL and FsPropFaker::LOG_CATEGORY)
+ * current when the request started allow it. Errors are always logged.
+ *
+ * If a binary trace is requested the log file is written in the format
+ * described in fstrace.h instead: a fixed size record per request, created
+ * by FsLogger::TraceOp. The text messages are discarded.
  */
 class FsLogger
 {
 public:
+	/** A request being served.
+	 * Created on the stack at the start of the request. It selects the
+	 * verbosity of the text messages of the thread from the category of the op.
+	 *
+	 * In the binary trace the record is queued by the destructor. The result
+	 * is the one passed to the last log_retstat, log_syscall, log_error,
+	 * log_errno or setTraceResult of the thread meanwhile, 0 if none.
+	 *
+	 * An op created while another one of the thread is alive (ex. setattr
+	 * replying through getattr) is part of it and isn't recorded.
+	 * Does nothing if there is no log file.
+	 */
+	class TraceOp
+	{
+	public:
+		// path based backend
+		TraceOp(FsLogger& oLog, TRACE_OP eOp, pid_t nPid, const char* p0Path
+				, int64_t nArg0 = 0, int64_t nArg1 = 0, int64_t nArg2 = 0) noexcept;
+		// inode based backend, p0Name can be null
+		TraceOp(FsLogger& oLog, TRACE_OP eOp, pid_t nPid, uint64_t nIno, const char* p0Name
+				, int64_t nArg0 = 0, int64_t nArg1 = 0, int64_t nArg2 = 0) noexcept;
+		~TraceOp() noexcept;
+		// the second node and path or name (ex. the target of rename), p0Path2 can be null
+		void setSecond(uint64_t nIno2, const char* p0Path2) noexcept;
+	private:
+		friend class FsLogger;
+		FsLogger* m_p0Log; // null if not recorded
+		int32_t m_nLogLevel = FsPropFaker::LOG_LEVEL_ERRORS; // the verbosity of the text log during the op
+		const char* m_p0Path = nullptr;
+		const char* m_p0Path2 = nullptr;
+		TraceRecord m_oRecord;
+	private:
+		TraceOp(const TraceOp& oSource) = delete;
+		TraceOp& operator=(const TraceOp& oSource) = delete;
+	};
+
 	~FsLogger() noexcept;
-	static std::pair<unique_ptr<FsLogger>, std::string> create(const std::string& sMountName, const std::string& sLogFilePath) noexcept;
+	static std::pair<unique_ptr<FsLogger>, std::string> create(const std::string& sMountName, const std::string& sLogFilePath
+																, bool bBinaryTrace = false
+																, TRACE_BACKEND eBackend = TRACE_BACKEND_OVER) noexcept;
 
 	//void log_function(const char* p0FuncName, const char* p0Format, ...);
 	void log_msg(const char* p0Format, ...);
 	void log_conn(struct fuse_conn_info* p0Conn);
 	int log_error(const char* p0Func);
+	// like log_error but with an explicit errno, returns -nErrno
+	int log_errno(const char* p0Func, int nErrno);
 	void log_fi(struct fuse_file_info* p0FI);
 	void log_fuse_context(struct fuse_context* p0Context);
 	void log_retstat(const char* p0Func, int nRetStat);
@@ -56,20 +119,142 @@ public:
 	void log_statvfs(struct ::statvfs* p0StatFs);
 	int  log_syscall(const char* p0Func, int nRetStat, int nMinRet);
 	void log_utime(struct utimbuf* p0Buf);
+	// the result of the current op of the thread in the binary trace, ex. an errno passed directly to the reply
+	void setTraceResult(int64_t nResult) noexcept;
+
+	void setLogLevel(FsPropFaker::LOG_LEVEL eLogLevel) noexcept;
+	FsPropFaker::LOG_LEVEL getLogLevel() const noexcept;
+	void setLogCategories(int32_t nLogCategories) noexcept;
+	int32_t getLogCategories() const noexcept;
 protected:
 	FsLogger(const std::string& sMountName, const std::string& sLogFilePath) noexcept;
-	std::string init() noexcept;
+	std::string init(bool bBinaryTrace, TRACE_BACKEND eBackend) noexcept;
 private:
 	const std::string& m_sMountName;
 	const std::string& m_sLogFilePath;
 
-	FILE* m_p0LogFile = nullptr;
+	int m_nLogFd = -1; // if negative logging is disabled
+	unique_ptr<LogRing> m_refRing;
+	unique_ptr<std::thread> m_refWriter;
+	std::mutex m_oWriterMutex;
+	std::condition_variable m_oWriterCond;
+	bool m_bWakeWriter = false; // protected by m_oWriterMutex
+	bool m_bStopWriter = false; // protected by m_oWriterMutex
+
+	std::atomic<int32_t> m_nLogLevel{FsPropFaker::LOG_LEVEL_FULL};
+	std::atomic<int32_t> m_nLogCategories{FsPropFaker::LOG_CATEGORY_ALL};
+	TRACE_BACKEND m_eBackend = TRACE_BACKEND_OVER; // the prefix of the ops in the text log
+
+	bool m_bBinaryTrace = false;
+	int64_t m_nTraceStartNs = 0; // the monotonic clock at the start of the trace
+	// Key: the path, Value: its id in the trace. Cleared when too big.
+	std::mutex m_oTracePathsMutex;
+	std::unordered_map<std::string, uint32_t> m_oTracePathIds;
+	uint32_t m_nNextTracePathId = 1; // protected by m_oTracePathsMutex
+private:
+	// whether messages of the given level are written by the current thread
+	bool isLoggingText(int32_t nLevel) const noexcept
+	{
+		return (m_nLogFd >= 0) && ! m_bBinaryTrace && (getThreadLogLevel() >= nLevel);
+	}
+	// the level of the current op of the thread or, if none, the current level
+	int32_t getThreadLogLevel() const noexcept;
+	// formats and queues a message regardless of the level
+	void pushFormatted(const char* p0Format, ...) noexcept;
+	void vpushFormatted(const char* p0Format, ::va_list oAP) noexcept;
+	// queues a text or binary record, waits if the ring is full
+	void push(const char* p0Data, size_t nLen) noexcept;
+	void wakeWriter() noexcept;
+	void runWriter() noexcept;
+	void writeAll(const std::string& sText) noexcept;
+	uint64_t getTraceTimeNs() const noexcept;
+	// returns 0 if p0Path is null, writes the path record the first time it's used
+	uint32_t internTracePath(const char* p0Path) noexcept;
+	void writeTraceOp(TraceOp& oOp) noexcept;
 private:
 	FsLogger() = delete;
 	FsLogger(const FsLogger& oSource) = delete;
 	FsLogger& operator=(const FsLogger& oSource) = delete;
 };
 
+#else
+
+/** Fuse specific logger of a build without logging.
+ * The functions are inline and empty so that the compiler removes the calls.
+ * Those returning a value compute it as the logging version does.
+ */
+class FsLogger
+{
+public:
+	class TraceOp
+	{
+	public:
+		TraceOp(FsLogger& /*oLog*/, TRACE_OP /*eOp*/, pid_t /*nPid*/, const char* /*p0Path*/
+				, int64_t /*nArg0*/ = 0, int64_t /*nArg1*/ = 0, int64_t /*nArg2*/ = 0) noexcept {}
+		TraceOp(FsLogger& /*oLog*/, TRACE_OP /*eOp*/, pid_t /*nPid*/, uint64_t /*nIno*/, const char* /*p0Name*/
+				, int64_t /*nArg0*/ = 0, int64_t /*nArg1*/ = 0, int64_t /*nArg2*/ = 0) noexcept {}
+		void setSecond(uint64_t /*nIno2*/, const char* /*p0Path2*/) noexcept {}
+	private:
+		TraceOp(const TraceOp& oSource) = delete;
+		TraceOp& operator=(const TraceOp& oSource) = delete;
+	};
+
+	// the log file path is ignored
+	static std::pair<unique_ptr<FsLogger>, std::string> create(const std::string& /*sMountName*/
+																, const std::string& /*sLogFilePath*/
+																, bool /*bBinaryTrace*/ = false
+																, TRACE_BACKEND /*eBackend*/ = TRACE_BACKEND_OVER) noexcept
+	{
+		return std::make_pair(unique_ptr<FsLogger>(new FsLogger()), "");
+	}
+
+	// a template rather than a C variadic function, which might not be inlined
+	template<typename ...TArgs>
+	void log_msg(const char* /*p0Format*/, TArgs... /*aArgs*/) noexcept {}
+	void log_conn(struct fuse_conn_info* /*p0Conn*/) noexcept {}
+	int log_error(const char* /*p0Func*/) noexcept { return -errno; }
+	int log_errno(const char* /*p0Func*/, int nErrno) noexcept { return - nErrno; }
+	void log_fi(struct fuse_file_info* /*p0FI*/) noexcept {}
+	void log_fuse_context(struct fuse_context* /*p0Context*/) noexcept {}
+	void log_retstat(const char* /*p0Func*/, int /*nRetStat*/) noexcept {}
+	void log_stat(struct stat* /*p0StatBuf*/) noexcept {}
+	void log_statvfs(struct ::statvfs* /*p0StatFs*/) noexcept {}
+	int  log_syscall(const char* /*p0Func*/, int nRetStat, int nMinRet) noexcept
+	{
+		return ((nRetStat < nMinRet) ? -errno : nRetStat);
+	}
+	void log_utime(struct utimbuf* /*p0Buf*/) noexcept {}
+	void setTraceResult(int64_t /*nResult*/) noexcept {}
+
+	void setLogLevel(FsPropFaker::LOG_LEVEL eLogLevel) noexcept
+	{
+		m_nLogLevel.store(eLogLevel, std::memory_order_relaxed);
+	}
+	FsPropFaker::LOG_LEVEL getLogLevel() const noexcept
+	{
+		return static_cast<FsPropFaker::LOG_LEVEL>(m_nLogLevel.load(std::memory_order_relaxed));
+	}
+	void setLogCategories(int32_t nLogCategories) noexcept
+	{
+		m_nLogCategories.store(nLogCategories, std::memory_order_relaxed);
+	}
+	int32_t getLogCategories() const noexcept
+	{
+		return m_nLogCategories.load(std::memory_order_relaxed);
+	}
+private:
+	FsLogger() noexcept = default;
+private:
+	// only kept for the getters
+	std::atomic<int32_t> m_nLogLevel{FsPropFaker::LOG_LEVEL_FULL};
+	std::atomic<int32_t> m_nLogCategories{FsPropFaker::LOG_CATEGORY_ALL};
+private:
+	FsLogger(const FsLogger& oSource) = delete;
+	FsLogger& operator=(const FsLogger& oSource) = delete;
+};
+
+#endif // FSPROPFAKER_WITHOUT_LOGGING
+
 } // namespace fspf
 
 #endif /* FS_LOGGER_H */
@@ -21,6 +21,8 @@
 #include "fspropfaker.h"
 
 #include "overfs.h"
+#include "lowfs.h"
+#include "fslogger.h"
 #include "fsutil.h"
 
 #include <iostream>
@@ -28,14 +30,17 @@
 #include <memory>
 #include <string>
 #include <mutex>
+#include <cmath>
+#include <chrono>
 
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <limits.h>
-#include <signal.h>
+#include <sys/sysmacros.h>
 #include <sys/statvfs.h>
 
 
@@ -47,11 +52,123 @@ namespace fspf
 {
 
 static constexpr int32_t s_nMaxMountNameSize = 20;
+// The kernel rejects smaller read and write requests sizes.
+static constexpr int32_t s_nMinRequestBytes = 4096;
+// Bigger requests are limited by the kernel anyway.
+#if FUSE_USE_VERSION < 35
+static constexpr int32_t s_nMaxRequestBytes = 128 * 1024;
+#else
+// libfuse 3 negotiates max_pages with the kernel (4.20 or later)
+static constexpr int32_t s_nMaxRequestBytes = 1024 * 1024;
+#endif
+static constexpr int32_t s_nMaxWorkerThreads = 1024;
+// a day, bigger values would overflow the poller's interval
+static constexpr double s_fMaxRealStatsTTL = 24 * 60 * 60;
+static constexpr int32_t s_nDefaultUnmountTimeoutMillisec = 5000;
+
+static std::string checkOptions(const FsPropFaker::Options& oOptions) noexcept
+{
+	if (oOptions.m_nMaxRead != 0) {
+		if ((oOptions.m_nMaxRead < s_nMinRequestBytes) || (oOptions.m_nMaxRead > s_nMaxRequestBytes)) {
+			return "Options: max read must be between " + std::to_string(s_nMinRequestBytes)
+					+ " and " + std::to_string(s_nMaxRequestBytes); //-----------------
+		}
+	}
+	if (oOptions.m_nMaxWrite != 0) {
+		if ((oOptions.m_nMaxWrite < s_nMinRequestBytes) || (oOptions.m_nMaxWrite > s_nMaxRequestBytes)) {
+			return "Options: max write must be between " + std::to_string(s_nMinRequestBytes)
+					+ " and " + std::to_string(s_nMaxRequestBytes); //-----------------
+		}
+		#if FUSE_USE_VERSION < 35
+		if ((oOptions.m_nMaxWrite > s_nMinRequestBytes) && ! oOptions.m_bBigWrites) {
+			return "Options: max write bigger than " + std::to_string(s_nMinRequestBytes)
+					+ " needs big writes"; //-------------------------------------------
+		}
+		#endif
+	}
+	if (oOptions.m_bSingleThreaded && (oOptions.m_nWorkerThreads != 0)) {
+		return "Options: single threaded and worker threads are mutually exclusive"; //--
+	}
+	if ((oOptions.m_nWorkerThreads < 0) || (oOptions.m_nWorkerThreads > s_nMaxWorkerThreads)) {
+		return "Options: worker threads must be between 0 and " + std::to_string(s_nMaxWorkerThreads); //--
+	}
+	#if FUSE_USE_VERSION < 35
+	if (oOptions.m_bCloneFd || (oOptions.m_nMaxIdleThreads >= 0)) {
+		return "Options: clone fd and max idle threads need libfuse 3"; //--------
+	}
+	#else
+	if ((oOptions.m_bCloneFd || (oOptions.m_nMaxIdleThreads >= 0))
+			&& (oOptions.m_bSingleThreaded || (oOptions.m_nWorkerThreads > 0))) {
+		return "Options: clone fd and max idle threads need the libfuse thread pool"; //--
+	}
+	#endif
+	if (oOptions.m_bKernelCache && oOptions.m_bAutoCache) {
+		return "Options: kernel cache and auto cache are mutually exclusive"; //----
+	}
+	if (! (std::isfinite(oOptions.m_fEntryTimeout) && std::isfinite(oOptions.m_fAttrTimeout)
+			&& std::isfinite(oOptions.m_fNegativeTimeout))) {
+		return "Options: timeouts must be finite"; //-------------------------------
+	}
+	if (! (std::isfinite(oOptions.m_fRealStatsTTL) && (oOptions.m_fRealStatsTTL >= 0.0))) {
+		return "Options: real stats TTL must be finite and not negative"; //----
+	}
+	if (oOptions.m_fRealStatsTTL > s_fMaxRealStatsTTL) {
+		return "Options: real stats TTL must not be bigger than " + std::to_string(static_cast<int64_t>(s_fMaxRealStatsTTL)); //--
+	}
+	if (oOptions.m_refDispatcher && (oOptions.m_bSingleThreaded || (oOptions.m_nWorkerThreads != 0)
+									|| oOptions.m_bCloneFd || (oOptions.m_nMaxIdleThreads >= 0))) {
+		return "Options: the dispatcher cannot be used together with the other thread options"; //--
+	}
+	#ifndef FSPROPFAKER_WITH_IO_URING
+	if (oOptions.m_bIoUring) {
+		return "Options: the library was built without io_uring support"; //---
+	}
+	#endif
+	if (oOptions.m_bIoUring && ! oOptions.m_bLowLevel) {
+		return "Options: io_uring needs the low level API"; //------------------
+	}
+	#if FUSE_USE_VERSION < 35
+	if (oOptions.m_bWritebackCache) {
+		return "Options: writeback cache needs libfuse 3"; //-------------------
+	}
+	#endif
+	if (oOptions.m_bWritebackCache && oOptions.m_bPassthrough) {
+		// the kernel disables passthrough if the writeback cache is enabled
+		return "Options: writeback cache and passthrough are mutually exclusive"; //--
+	}
+	#if FUSE_VERSION < FUSE_MAKE_VERSION(3, 16)
+	if (oOptions.m_bPassthrough) {
+		return "Options: passthrough needs libfuse 3.16"; //--------------------
+	}
+	#else
+	if (oOptions.m_bPassthrough && ! oOptions.m_bLowLevel) {
+		return "Options: passthrough needs the low level API"; //---------------
+	}
+	#endif
+	if (oOptions.m_nMountTimeoutMillisec <= 0) {
+		return "Options: mount timeout must be positive"; //--------------------
+	}
+	if ((oOptions.m_eLogLevel < FsPropFaker::LOG_LEVEL_ERRORS) || (oOptions.m_eLogLevel > FsPropFaker::LOG_LEVEL_FULL)) {
+		return "Options: invalid log level"; //---------------------------------
+	}
+	if ((oOptions.m_nLogCategories & ~FsPropFaker::LOG_CATEGORY_ALL) != 0) {
+		return "Options: invalid log categories"; //----------------------------
+	}
+	return "";
+}
 
 FsPropFaker::CreateResult FsPropFaker::create(const std::string& sMountName
 											, const std::string& sFsFolderPath
 											, const std::string& sMountPath
 											, const std::string& sLogFilePath) noexcept
+{
+	return create(sMountName, sFsFolderPath, sMountPath, sLogFilePath, Options{});
+}
+FsPropFaker::CreateResult FsPropFaker::create(const std::string& sMountName
+											, const std::string& sFsFolderPath
+											, const std::string& sMountPath
+											, const std::string& sLogFilePath
+											, const Options& oOptions) noexcept
 {
 	assert(! sFsFolderPath.empty());
 	CreateResult oResult;
@@ -60,7 +177,7 @@ FsPropFaker::CreateResult FsPropFaker::create(const std::string& sMountName
 		return oResult;
     }
 	auto refFaker = std::unique_ptr<FsPropFaker>(new FsPropFaker());
-	oResult.m_sError = refFaker->init(sMountName, sFsFolderPath, sMountPath, sLogFilePath);
+	oResult.m_sError = refFaker->init(sMountName, sFsFolderPath, sMountPath, sLogFilePath, oOptions);
 	if (! oResult.m_sError.empty()) {
 		return oResult;
 	}
@@ -78,9 +195,21 @@ FsPropFaker::FsPropFaker() noexcept
 
 FsPropFaker::~FsPropFaker() noexcept
 {
-	if (m_refFsThread) {
+	if (m_bFsLaunched) {
 		unmount();
+	}
+	if (m_refFsThread) {
+		// unmount() might not have made the session exit (for example
+		// if it failed or timed out), ending the session first makes loop()
+		// return so that the join doesn't block forever
+		m_refFs->exitSession();
 		m_refFsThread->join();
+	} else if (m_bFsLaunched) {
+		// the dispatcher mustn't use this instance anymore
+		waitFuseFinished(-1);
+	}
+	if (m_nRootFd >= 0) {
+		::close(m_nRootFd);
 	}
 }
 
@@ -100,6 +229,10 @@ const std::string& FsPropFaker::getLogFilePath() const noexcept
 {
 	return m_sLogFilePath;
 }
+const FsPropFaker::Options& FsPropFaker::getOptions() const noexcept
+{
+	return m_oOptions;
+}
 int64_t FsPropFaker::getBlockSize() const noexcept
 {
 	return m_nBlockSize;
@@ -108,12 +241,23 @@ int64_t FsPropFaker::getBlockSize() const noexcept
 std::string FsPropFaker::init(const std::string& sMountName
 							, const std::string& sFsFolderPath
 							, const std::string& sMountPath
-							, const std::string& sLogFilePath) noexcept
+							, const std::string& sLogFilePath
+							, const Options& oOptions) noexcept
 {
+	const std::string sOptionsErr = checkOptions(oOptions);
+	if (! sOptionsErr.empty()) {
+		return sOptionsErr; //--------------------------------------------------
+	}
+	m_oOptions = oOptions;
 	m_sRootPath = realPath(sFsFolderPath);
 	if (! dirExists(m_sRootPath)) {
 		return std::string("Folder ") + m_sRootPath + " not found"; //----------
 	}
+	// the file system operations resolve their paths relative to this descriptor
+	m_nRootFd = ::open(m_sRootPath.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if (m_nRootFd < 0) {
+		return m_sRootPath + ": " + std::string("Error ") + std::string(::strerror(errno)); //--
+	}
 	struct ::statvfs oStatFs;
 	const std::string sErr = getStatVFS(m_sRootPath, oStatFs);
 	if (! sErr.empty()) {
@@ -161,38 +305,154 @@ std::string FsPropFaker::init(const std::string& sMountName
 std::string FsPropFaker::createThread() noexcept
 {
 //std::cout << "FsPropFaker::createThread  starting thread" << '\n';
-	auto oPair = OverFs::createInstance(this, [&](){ fuseInitialized(); });
-	if (! oPair.second.empty()) {
-		return oPair.second;
+	if (m_oOptions.m_bLowLevel) {
+		auto oPair = LowFs::createInstance(this, [&](){ fuseInitialized(); });
+		if (! oPair.second.empty()) {
+			return oPair.second;
+		}
+		m_refFs = std::move(oPair.first);
+	} else {
+		auto oPair = OverFs::createInstance(this, [&](){ fuseInitialized(); });
+		if (! oPair.second.empty()) {
+			return oPair.second;
+		}
+		m_refFs = std::move(oPair.first);
 	}
-	m_refFs = std::move(oPair.first);
-	m_refFsThread = std::make_unique<std::thread>([&]()
+	struct ::stat oMountStat;
+	if (::stat(m_sMountPath.c_str(), &oMountStat) != 0) {
+		return m_sMountPath + ": " + std::string("Error ") + std::string(::strerror(errno)); //--
+	}
+	const dev_t nUnmountedDev = oMountStat.st_dev;
+	// creates fuse filesystem
+	auto oMount = [&]()
 	{
-		// creates fuse filesystem
-		const int nArgC = 3;
-		char aPrg[s_nMaxMountNameSize + 1];
-		::strcpy(aPrg, m_sMountName.c_str());
-		char aMountPath[PATH_MAX];
-		::strcpy(aMountPath, m_sMountPath.c_str());
-		char aOptionF[2 + 1];
-		::strcpy(aOptionF, "-f"); // so that run() blocks until unmounted
-		//
-		char* aArgV[3] = {aPrg, aOptionF, aMountPath};
-
-		m_refFs->run(nArgC, aArgV);
-		// now thread is ready to join in the destructor
-	});
+		std::vector<std::string> aArgs = getFuseArgs();
+		std::vector<char*> aArgV;
+		for (auto& sArg : aArgs) {
+			aArgV.push_back(&(sArg[0]));
+		}
+		aArgV.push_back(nullptr);
+		return m_refFs->mount(static_cast<int>(aArgs.size()), aArgV.data());
+	};
+	if (m_oOptions.m_refDispatcher) {
+		std::string sErr = oMount();
+		if (sErr.empty()) {
+			sErr = m_refFs->dispatch(*m_oOptions.m_refDispatcher, [this]() { fuseFinished(""); });
+			if (! sErr.empty()) {
+				m_refFs->teardown();
+			}
+		}
+		if (! sErr.empty()) {
+			return sErr; //-----------------------------------------------------
+		}
+	} else {
+		m_refFsThread = std::make_unique<std::thread>([&, oMount]()
+		{
+			const std::string sErr = oMount();
+			if (! sErr.empty()) {
+				fuseFinished(sErr);
+				return; //------------------------------------------------------
+			}
+			m_refFs->loop();
+			m_refFs->teardown();
+			fuseFinished("");
+			// now thread is ready to join in the destructor
+		});
+	}
+	m_bFsLaunched = true;
 //std::cout << "FsPropFaker::createThread  waiting for fuse initialization" << '\n';
-	// Wait for m_oFsThread to initialize file system
+	const auto oDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_oOptions.m_nMountTimeoutMillisec);
+	// Wait for m_oFsThread to initialize file system or to fail
 	{
 		std::unique_lock<std::mutex> oLock(m_oFsStartedMutex);
-		m_oFileSystemStarted.wait(oLock, [&](){ return (m_bFileSystemStarted != false); });
+		const bool bSignaled = m_oFileSystemStarted.wait_until(oLock, oDeadline, [&]()
+		{
+			return (m_bFileSystemStarted != false) || m_bFileSystemFinished;
+		});
+		if (! bSignaled) {
+			return "Timeout waiting for fuse to initialize " + m_sMountPath; //-
+		}
+		if (m_bFileSystemStarted == false) {
+			return (m_sFsThreadError.empty() ? "File system stopped before being initialized" : m_sFsThreadError); //--
+		}
+	}
+	// init is called before libfuse replies to the kernel, the mount
+	// is complete when the mount point belongs to another device
+	while (true) {
+		if (::stat(m_sMountPath.c_str(), &oMountStat) != 0) {
+			return m_sMountPath + ": " + std::string("Error ") + std::string(::strerror(errno)); //--
+		}
+		if (oMountStat.st_dev != nUnmountedDev) {
+			m_nFuseDev = oMountStat.st_dev;
+			break;
+		}
+		if (std::chrono::steady_clock::now() >= oDeadline) {
+			return "Timeout waiting for mount " + m_sMountPath; //--------------
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
 	}
-//std::cout << "FsPropFaker::createThread  before sleep" << '\n';
-	::sleep(2); // wait for the fuse system to be set up!
 
 	return "";
 }
+std::vector<std::string> FsPropFaker::getFuseArgs() const noexcept
+{
+	std::vector<std::string> aArgs;
+	aArgs.push_back(m_sMountName);
+	aArgs.push_back("-f"); // don't daemonize
+
+	std::string sOpts;
+	auto addOpt = [&](const std::string& sOpt)
+	{
+		if (! sOpts.empty()) {
+			sOpts += ",";
+		}
+		sOpts += sOpt;
+	};
+	const Options& oO = m_oOptions;
+	if (oO.m_nMaxRead > 0) {
+		addOpt("max_read=" + std::to_string(oO.m_nMaxRead));
+	}
+	if (oO.m_nMaxWrite > 0) {
+		addOpt("max_write=" + std::to_string(oO.m_nMaxWrite));
+	}
+	#if FUSE_USE_VERSION < 35
+	// fuse 3 always allows big writes
+	if (oO.m_bBigWrites) {
+		addOpt("big_writes");
+	}
+	#endif
+	if (! oO.m_bAsyncRead) {
+		addOpt("sync_read");
+	}
+	if (oO.m_nMaxReadahead >= 0) {
+		addOpt("max_readahead=" + std::to_string(oO.m_nMaxReadahead));
+	}
+	// the low level backend handles the options of the high level API itself
+	if (! oO.m_bLowLevel) {
+		if (oO.m_bKernelCache) {
+			addOpt("kernel_cache");
+		}
+		if (oO.m_bAutoCache) {
+			addOpt("auto_cache");
+		}
+		if (oO.m_fEntryTimeout >= 0) {
+			addOpt("entry_timeout=" + std::to_string(oO.m_fEntryTimeout));
+		}
+		if (oO.m_fAttrTimeout >= 0) {
+			addOpt("attr_timeout=" + std::to_string(oO.m_fAttrTimeout));
+		}
+		if (oO.m_fNegativeTimeout >= 0) {
+			addOpt("negative_timeout=" + std::to_string(oO.m_fNegativeTimeout));
+		}
+	}
+	if (! sOpts.empty()) {
+		aArgs.push_back("-o");
+		aArgs.push_back(sOpts);
+	}
+
+	aArgs.push_back(m_sMountPath);
+	return aArgs;
+}
 void FsPropFaker::fuseInitialized() noexcept
 {
 	// signal main thread started
@@ -202,18 +462,77 @@ void FsPropFaker::fuseInitialized() noexcept
 	}
 	m_oFileSystemStarted.notify_one();
 }
-// from https://code.i-harness.com/en/q/ea7f34
-template <typename T>
-using stripwhat = typename std::remove_pointer<typename std::decay<T>::type>::type;
+void FsPropFaker::fuseFinished(const std::string& sError) noexcept
+{
+	// notify while holding the lock: when called by a dispatcher thread
+	// this instance can be destroyed as soon as the lock is released
+	std::lock_guard<std::mutex> oLock(m_oFsStartedMutex);
+	m_bFileSystemFinished = true;
+	m_sFsThreadError = sError;
+	m_oFileSystemStarted.notify_all();
+}
 std::string FsPropFaker::unmount() noexcept
 {
-	static_assert(std::is_same<stripwhat<std::thread::native_handle_type>, pthread_t>::value
-				, "libstdc++ doesn't use pthread_t");
-	const auto nRet = ::pthread_kill(m_refFsThread->native_handle(), SIGHUP);
-	if (nRet == 0) {
-		return "";
+	return unmount(s_nDefaultUnmountTimeoutMillisec).m_sError;
+}
+FsPropFaker::UnmountResult FsPropFaker::unmount(int32_t nTimeoutMillisec) noexcept
+{
+	UnmountResult oResult;
+	if ((! m_bFsLaunched) || waitFuseFinished(0)) {
+		return oResult; //------------------------------------------------------
 	}
-	return ::strerror(nRet);
+	oResult.m_aOpenPaths = m_refFs->getOpenPaths();
+	m_refFs->exitSession();
+	if (waitFuseFinished(nTimeoutMillisec)) {
+		return oResult; //------------------------------------------------------
+	}
+	// Open files keep the detached file system alive, abort the connection.
+	oResult.m_sError = "Timeout waiting for unmount of " + m_sMountPath;
+	if (! oResult.m_aOpenPaths.empty()) {
+		oResult.m_sError += " (open: " + oResult.m_aOpenPaths[0];
+		if (oResult.m_aOpenPaths.size() > 1) {
+			oResult.m_sError += " and " + std::to_string(oResult.m_aOpenPaths.size() - 1) + " more";
+		}
+		oResult.m_sError += ")";
+	}
+	const std::string sAbortErr = abortConnection();
+	if (! sAbortErr.empty()) {
+		oResult.m_sError += ", " + sAbortErr;
+		return oResult; //------------------------------------------------------
+	}
+	if (! waitFuseFinished(nTimeoutMillisec)) {
+		oResult.m_sError += ", the connection was aborted but fuse didn't stop";
+	}
+	return oResult;
+}
+bool FsPropFaker::waitFuseFinished(int32_t nTimeoutMillisec) noexcept
+{
+	std::unique_lock<std::mutex> oLock(m_oFsStartedMutex);
+	if (nTimeoutMillisec < 0) {
+		m_oFileSystemStarted.wait(oLock, [&](){ return m_bFileSystemFinished; });
+		return true; //---------------------------------------------------------
+	}
+	return m_oFileSystemStarted.wait_for(oLock, std::chrono::milliseconds(nTimeoutMillisec)
+										, [&](){ return m_bFileSystemFinished; });
+}
+std::string FsPropFaker::abortConnection() noexcept
+{
+	if (m_nFuseDev == 0) {
+		return "Connection unknown"; //-----------------------------------------
+	}
+	// the fuse control file system lets the owner abort the connection
+	const std::string sAbortPath = "/sys/fs/fuse/connections/" + std::to_string(minor(m_nFuseDev)) + "/abort";
+	const int nFd = ::open(sAbortPath.c_str(), O_WRONLY | O_CLOEXEC);
+	if (nFd < 0) {
+		return sAbortPath + ": " + std::string("Error ") + std::string(::strerror(errno)); //--
+	}
+	const bool bOk = (::write(nFd, "1", 1) == 1);
+	const int nErrno = errno;
+	::close(nFd);
+	if (! bOk) {
+		return sAbortPath + ": " + std::string("Error ") + std::string(::strerror(nErrno)); //--
+	}
+	return "";
 }
 
 int64_t FsPropFaker::getRealDiskSizeInBlocks() noexcept
@@ -232,6 +551,10 @@ int64_t FsPropFaker::getRealFreeSizeInMB() noexcept
 {
 	return getRealFreeSizeInBlocks() * m_nBlockSize / s_nMegaByteBytes;
 }
+void FsPropFaker::refreshRealStats() noexcept
+{
+	m_refFs->refreshRealStats();
+}
 
 void FsPropFaker::setFakeDiskSizeInBlocks(int64_t nSizeBlocks) noexcept
 {
@@ -283,6 +606,25 @@ int64_t FsPropFaker::setFakeDiskFreeSizeDiffInMB(int64_t nFreeSizeMB) noexcept
 	return nFreeSizeBlocks;
 }
 
+void FsPropFaker::setLogLevel(LOG_LEVEL eLogLevel) noexcept
+{
+	assert((eLogLevel >= LOG_LEVEL_ERRORS) && (eLogLevel <= LOG_LEVEL_FULL));
+	m_refFs->getFsLogger()->setLogLevel(eLogLevel);
+}
+FsPropFaker::LOG_LEVEL FsPropFaker::getLogLevel() const noexcept
+{
+	return m_refFs->getFsLogger()->getLogLevel();
+}
+void FsPropFaker::setLogCategories(int32_t nLogCategories) noexcept
+{
+	assert((nLogCategories & ~LOG_CATEGORY_ALL) == 0);
+	m_refFs->getFsLogger()->setLogCategories(nLogCategories);
+}
+int32_t FsPropFaker::getLogCategories() const noexcept
+{
+	return m_refFs->getFsLogger()->getLogCategories();
+}
+
 
 } // namespace fspf
 
@@ -0,0 +1,185 @@
+/*
+ * Copyright © 2020  Stefano Marsili, <stemars@gmx.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+/*
+ * File:   fstrace.h
+ */
+
+#ifndef FSPF_FS_TRACE_H
+#define FSPF_FS_TRACE_H
+
+#include <stdint.h>
+
+namespace fspf
+{
+
+/* The binary trace file written by FsLogger instead of the text log.
+ * It starts with a TraceHeader followed by TraceRecord blocks. A path is
+ * written once, the first time a request refers to it, in a
+ * TRACE_RECORD_TYPE_PATH record followed by its characters padded to a
+ * multiple of the record size. The following requests only store its id.
+ * The writer forgets the paths from time to time, a path can therefore be
+ * written again with a new id. Ids are not reused.
+ * All the values are in the byte order of the machine that wrote the trace.
+ */
+
+static constexpr char s_aTraceMagic[8] = {'F', 'S', 'P', 'F', 'T', 'R', 'C', '\0'};
+static constexpr uint32_t s_nTraceVersion = 1;
+
+enum TRACE_BACKEND
+{
+	TRACE_BACKEND_OVER = 0, // path based, ino is always 0
+	TRACE_BACKEND_LOW = 1 // inode based, the paths are just the names within the folder ino
+};
+
+enum TRACE_RECORD_TYPE
+{
+	TRACE_RECORD_TYPE_OP = 1, // a request
+	TRACE_RECORD_TYPE_PATH = 2 // the definition of a path id
+};
+
+enum TRACE_OP
+{
+	TRACE_OP_INIT = 0,
+	TRACE_OP_DESTROY,
+	TRACE_OP_LOOKUP,
+	TRACE_OP_FORGET,
+	TRACE_OP_GETATTR,
+	TRACE_OP_SETATTR,
+	TRACE_OP_READLINK,
+	TRACE_OP_MKNOD,
+	TRACE_OP_MKDIR,
+	TRACE_OP_UNLINK,
+	TRACE_OP_RMDIR,
+	TRACE_OP_SYMLINK,
+	TRACE_OP_RENAME,
+	TRACE_OP_LINK,
+	TRACE_OP_CHMOD,
+	TRACE_OP_CHOWN,
+	TRACE_OP_TRUNCATE,
+	TRACE_OP_UTIMENS,
+	TRACE_OP_OPEN,
+	TRACE_OP_CREATE,
+	TRACE_OP_READ,
+	TRACE_OP_WRITE,
+	TRACE_OP_STATFS,
+	TRACE_OP_FLUSH,
+	TRACE_OP_RELEASE,
+	TRACE_OP_FSYNC,
+	TRACE_OP_FALLOCATE,
+	TRACE_OP_COPY_FILE_RANGE,
+	TRACE_OP_LSEEK,
+	TRACE_OP_SETXATTR,
+	TRACE_OP_GETXATTR,
+	TRACE_OP_LISTXATTR,
+	TRACE_OP_REMOVEXATTR,
+	TRACE_OP_OPENDIR,
+	TRACE_OP_READDIR,
+	TRACE_OP_RELEASEDIR,
+	TRACE_OP_FSYNCDIR,
+	TRACE_OP_ACCESS,
+	TRACE_OP_TOT
+};
+
+struct TraceHeader
+{
+	char m_aMagic[8]; // s_aTraceMagic
+	uint32_t m_nVersion; // s_nTraceVersion
+	uint32_t m_nRecordSize; // sizeof(TraceRecord)
+	int64_t m_nStartTimeNs; // the wall clock time (since the epoch) the record times are relative to
+	uint32_t m_nBackend; // TRACE_BACKEND
+	char m_aMountName[52]; // null terminated, truncated if too long
+};
+
+struct TraceRecord
+{
+	uint16_t m_nType; // TRACE_RECORD_TYPE
+	uint16_t m_nOp; // TRACE_OP
+	int32_t m_nResult; // the result of the last underlying call, negative errno if failed. The length of a path.
+	uint64_t m_nTimeNs; // the start of the request, relative to TraceHeader::m_nStartTimeNs
+	uint64_t m_nDurationNs;
+	uint32_t m_nThread; // the thread of the faker that served the request
+	uint32_t m_nPid; // the process that made the request
+	uint32_t m_nPathId; // 0 if none. The id defined by a path record.
+	uint32_t m_nPath2Id; // 0 if none
+	uint64_t m_nIno; // the node or the folder of the name
+	uint64_t m_nIno2; // the second node or folder (ex. rename's new parent)
+	int64_t m_aArgs[3]; // their meaning depends on the op
+};
+
+static_assert(sizeof(TraceHeader) == 80, "TraceHeader size changed");
+static_assert(sizeof(TraceRecord) == 80, "TraceRecord size changed");
+
+struct TraceOpInfo
+{
+	const char* m_p0Name;
+	const char* m_p0Path2Name; // the meaning of TraceRecord::m_nPath2Id and m_nIno2, null if not used
+	const char* m_aArgNames[3]; // null if not used
+	bool m_bOctalArg0; // whether the first argument is a mode
+};
+
+/** The names of an op and of its arguments.
+ * @param nOp The op. Must be smaller than TRACE_OP_TOT.
+ * @return The info.
+ */
+inline const TraceOpInfo& getTraceOpInfo(uint32_t nOp) noexcept
+{
+	static const TraceOpInfo s_aOpInfos[TRACE_OP_TOT] = {
+		{"init", nullptr, {nullptr, nullptr, nullptr}, false},
+		{"destroy", nullptr, {nullptr, nullptr, nullptr}, false},
+		{"lookup", nullptr, {nullptr, nullptr, nullptr}, false},
+		{"forget", nullptr, {"nlookup", nullptr, nullptr}, false},
+		{"getattr", nullptr, {nullptr, nullptr, nullptr}, false},
+		{"setattr", nullptr, {"to_set", "size", nullptr}, false},
+		{"readlink", nullptr, {nullptr, nullptr, nullptr}, false},
+		{"mknod", nullptr, {"mode", "dev", nullptr}, true},
+		{"mkdir", nullptr, {"mode", nullptr, nullptr}, true},
+		{"unlink", nullptr, {nullptr, nullptr, nullptr}, false},
+		{"rmdir", nullptr, {nullptr, nullptr, nullptr}, false},
+		{"symlink", "link", {nullptr, nullptr, nullptr}, false},
+		{"rename", "new", {"flags", nullptr, nullptr}, false},
+		{"link", "new", {nullptr, nullptr, nullptr}, false},
+		{"chmod", nullptr, {"mode", nullptr, nullptr}, true},
+		{"chown", nullptr, {"uid", "gid", nullptr}, false},
+		{"truncate", nullptr, {"size", nullptr, nullptr}, false},
+		{"utimens", nullptr, {"atime", "mtime", nullptr}, false},
+		{"open", nullptr, {"flags", nullptr, nullptr}, false},
+		{"create", nullptr, {"mode", "flags", nullptr}, true},
+		{"read", nullptr, {"size", "offset", nullptr}, false},
+		{"write", nullptr, {"size", "offset", nullptr}, false},
+		{"statfs", nullptr, {nullptr, nullptr, nullptr}, false},
+		{"flush", nullptr, {nullptr, nullptr, nullptr}, false},
+		{"release", nullptr, {nullptr, nullptr, nullptr}, false},
+		{"fsync", nullptr, {"datasync", nullptr, nullptr}, false},
+		{"fallocate", nullptr, {"mode", "offset", "length"}, false},
+		{"copy_file_range", "out", {"offset_in", "offset_out", "size"}, false},
+		{"lseek", nullptr, {"offset", "whence", nullptr}, false},
+		{"setxattr", "name", {"size", "flags", nullptr}, false},
+		{"getxattr", "name", {"size", nullptr, nullptr}, false},
+		{"listxattr", nullptr, {"size", nullptr, nullptr}, false},
+		{"removexattr", "name", {nullptr, nullptr, nullptr}, false},
+		{"opendir", nullptr, {nullptr, nullptr, nullptr}, false},
+		{"readdir", nullptr, {"size", "offset", nullptr}, false},
+		{"releasedir", nullptr, {nullptr, nullptr, nullptr}, false},
+		{"fsyncdir", nullptr, {"datasync", nullptr, nullptr}, false},
+		{"access", nullptr, {"mask", nullptr, nullptr}, true}
+	};
+	return s_aOpInfos[nOp];
+}
+
+} // namespace fspf
+
+#endif /* FSPF_FS_TRACE_H */
@@ -21,9 +21,10 @@
 #include "fsutil.h"
 
 #include <iostream>
-//#include <cassert>
+#include <cassert>
 #include <string>
 #include <array>
+#include <vector>
 
 #include <stdlib.h>
 #include <limits.h>
@@ -31,8 +32,12 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <spawn.h>
 #include <ios>
 
+extern char** environ;
+
 namespace fspf
 {
 
@@ -66,4 +71,29 @@ std::string getStatVFS(const std::string& sPath, struct ::statvfs& oStatFs) noex
 	return ::strerror(errno);
 }
 
+std::string execAndWait(const std::vector<std::string>& aArgs) noexcept
+{
+	assert(! aArgs.empty());
+	std::vector<char*> aArgV;
+	for (const auto& sArg : aArgs) {
+		aArgV.push_back(const_cast<char*>(sArg.c_str()));
+	}
+	aArgV.push_back(nullptr);
+	::pid_t nPid;
+	const int nRet = ::posix_spawnp(&nPid, aArgV[0], nullptr, nullptr, aArgV.data(), environ);
+	if (nRet != 0) {
+		return aArgs[0] + ": " + ::strerror(nRet); //-----------------------------
+	}
+	int nStatus;
+	while (::waitpid(nPid, &nStatus, 0) == -1) {
+		if (errno != EINTR) {
+			return aArgs[0] + ": " + ::strerror(errno); //------------------------
+		}
+	}
+	if (! (WIFEXITED(nStatus) && (WEXITSTATUS(nStatus) == 0))) {
+		return aArgs[0] + " failed"; //---------------------------------------------
+	}
+	return "";
+}
+
 } // namespace fspf
@@ -22,6 +22,7 @@
 #define FSPF_FS_UTIL_H
 
 #include <string>
+#include <vector>
 
 #include <sys/statvfs.h>
 
@@ -35,6 +36,12 @@ std::string realPath(const std::string& sPath) noexcept;
 
 std::string getStatVFS(const std::string& sPath, struct ::statvfs& oStatFs) noexcept;
 
+/** Runs a program and waits for it to terminate.
+ * @param aArgs The program (searched in PATH) followed by its arguments. Cannot be empty.
+ * @return Empty if the program exited with status 0, the error otherwise.
+ */
+std::string execAndWait(const std::vector<std::string>& aArgs) noexcept;
+
 } // namespace fspf
 
 #endif /* FSPF_FS_UTIL_H */
@@ -0,0 +1,118 @@
+/*
+ * Copyright © 2020  Stefano Marsili, <stemars@gmx.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+/*
+ * File:   fuseloop.cc
+ */
+
+#include "fuseloop.h"
+
+#include <cassert>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <system_error>
+
+#include <stdlib.h>
+#include <errno.h>
+
+using std::unique_ptr;
+
+namespace fspf
+{
+
+// Same as libfuse's own fuse_session_loop.
+// Returns false if an error occurred.
+static bool workerLoop(struct fuse_session* p0Session) noexcept
+{
+	bool bOk = true;
+	#if FUSE_USE_VERSION < 35
+	struct fuse_chan* p0Chan = ::fuse_session_next_chan(p0Session, nullptr);
+	const size_t nBufSize = ::fuse_chan_bufsize(p0Chan);
+	unique_ptr<char[]> refBuf{new (std::nothrow) char[nBufSize]};
+	if (! refBuf) {
+		::fuse_session_exit(p0Session);
+		return false; //--------------------------------------------------------
+	}
+	#else
+	struct fuse_buf oBuf{};
+	#endif
+	while (::fuse_session_exited(p0Session) == 0) {
+		#if FUSE_USE_VERSION < 35
+		struct fuse_chan* p0TmpChan = p0Chan;
+		struct fuse_buf oBuf{};
+		oBuf.mem = refBuf.get();
+		oBuf.size = nBufSize;
+		const int nRes = ::fuse_session_receive_buf(p0Session, &oBuf, &p0TmpChan);
+		#else
+		const int nRes = ::fuse_session_receive_buf(p0Session, &oBuf);
+		#endif
+		if (nRes == -EINTR) {
+			continue; // while ----
+		}
+		if (nRes <= 0) {
+			// 0 means unmounted
+			bOk = (nRes == 0);
+			break; // while ----
+		}
+		#if FUSE_USE_VERSION < 35
+		::fuse_session_process_buf(p0Session, &oBuf, p0TmpChan);
+		#else
+		::fuse_session_process_buf(p0Session, &oBuf);
+		#endif
+	}
+	#if FUSE_USE_VERSION < 35
+	#else
+	::free(oBuf.mem);
+	#endif
+	::fuse_session_exit(p0Session);
+	return bOk;
+}
+
+int fuseLoopFixedThreads(struct fuse_session* p0Session, int32_t nThreads
+						, const std::function<void()>& oStopOthers) noexcept
+{
+	assert(p0Session != nullptr);
+	assert(nThreads > 0);
+	assert(oStopOthers);
+	std::atomic<bool> bFailed{false};
+	std::once_flag oStopOnce;
+	auto oWork = [&]()
+	{
+		if (! workerLoop(p0Session)) {
+			bFailed = true;
+		}
+		std::call_once(oStopOnce, oStopOthers);
+	};
+	std::vector<std::thread> aThreads;
+	try {
+		for (int32_t nIdx = 1; nIdx < nThreads; ++nIdx) {
+			aThreads.emplace_back(oWork);
+		}
+	} catch (const std::system_error&) {
+		// couldn't create all threads, serve with those that were created
+		bFailed = true;
+	}
+	oWork();
+	for (auto& oThread : aThreads) {
+		oThread.join();
+	}
+	return (bFailed ? -1 : 0);
+}
+
+} // namespace fspf
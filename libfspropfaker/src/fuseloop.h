@@ -0,0 +1,52 @@
+/*
+ * Copyright © 2020  Stefano Marsili, <stemars@gmx.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+/*
+ * File:   fuseloop.h
+ */
+
+#ifndef FSPF_FUSE_LOOP_H
+#define FSPF_FUSE_LOOP_H
+
+#include "fusepp/Fuse.h"
+
+#include <fuse_lowlevel.h>
+
+#include <functional>
+
+#include <stdint.h>
+
+namespace fspf
+{
+
+/** Serves the requests of a fuse session with a fixed number of threads.
+ * The calling thread is one of the nThreads threads.
+ * When the first thread stops (the session was exited or the file system
+ * unmounted) oStopOthers is called. It has to unmount the file system so
+ * that the threads blocked reading the fuse device wake up.
+ * Returns when all threads have stopped.
+ * @param p0Session The session. Cannot be null.
+ * @param nThreads The number of threads. Must be positive.
+ * @param oStopOthers The callback. Cannot be null.
+ * @return 0 if successful, -1 otherwise.
+ */
+int fuseLoopFixedThreads(struct fuse_session* p0Session, int32_t nThreads
+						, const std::function<void()>& oStopOthers) noexcept;
+
+} // namespace fspf
+
+#endif /* FSPF_FUSE_LOOP_H */
+
@@ -0,0 +1,297 @@
+/*
+ * Copyright © 2020  Stefano Marsili, <stemars@gmx.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+/*
+ * File:   iouring.cc
+ */
+
+#include "iouring.h"
+
+#ifdef FSPROPFAKER_WITH_IO_URING
+
+#include "fslogger.h"
+
+#include <system_error>
+
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+
+namespace fspf
+{
+
+// the completions processed before they are handed back to the ring
+static constexpr unsigned s_nMaxCompletionBatch = 64;
+// the user data of the sqes whose op was failed before the kernel got them
+static int s_nDiscarded = 0;
+
+std::pair<unique_ptr<IoUring>, std::string> IoUring::create(uint32_t nEntries, FsLogger& oLog) noexcept
+{
+	auto refIoUring = unique_ptr<IoUring>(new IoUring(oLog));
+	const std::string sErr = refIoUring->init(nEntries);
+	if (! sErr.empty()) {
+		return std::make_pair(unique_ptr<IoUring>{}, sErr); //-----------------
+	}
+	return std::make_pair(std::move(refIoUring), "");
+}
+
+IoUring::IoUring(FsLogger& oLog) noexcept
+: m_oLog(oLog)
+{
+}
+IoUring::~IoUring() noexcept
+{
+	if (m_refCompletionThread) {
+		drain();
+		const bool bStopQueued = submit(nullptr, [](struct io_uring_sqe* p0Sqe) { ::io_uring_prep_nop(p0Sqe); });
+		bool bStopped;
+		{
+			std::lock_guard<std::mutex> oLock(m_oPendingMutex);
+			bStopped = (m_nRingError != 0);
+		}
+		if (bStopQueued || bStopped) {
+			m_refCompletionThread->join();
+		} else {
+			// nothing can wake it up, it stays blocked in the kernel
+			m_refCompletionThread->detach();
+		}
+	}
+	if (m_bRingInited) {
+		::io_uring_queue_exit(&m_oRing);
+	}
+}
+
+std::string IoUring::init(uint32_t nEntries) noexcept
+{
+	const int nRes = ::io_uring_queue_init(nEntries, &m_oRing, 0);
+	if (nRes < 0) {
+		return std::string("io_uring_queue_init: ") + ::strerror(- nRes); //---
+	}
+	m_bRingInited = true;
+	// io_uring exists since Linux 5.1, read, write and close since 5.6
+	struct io_uring_probe* p0Probe = ::io_uring_get_probe_ring(&m_oRing);
+	if (p0Probe == nullptr) {
+		return "io_uring: the kernel can't be probed for the supported operations"; //--
+	}
+	bool bSupported = true;
+	for (const int nOpCode : {IORING_OP_READ, IORING_OP_WRITE, IORING_OP_FSYNC, IORING_OP_CLOSE}) {
+		if (! ::io_uring_opcode_supported(p0Probe, nOpCode)) {
+			bSupported = false;
+			break; // for ----
+		}
+	}
+	::io_uring_free_probe(p0Probe);
+	if (! bSupported) {
+		return "io_uring: the kernel doesn't support read, write, fsync or close"; //--
+	}
+	try {
+		m_refCompletionThread = std::make_unique<std::thread>([this]() { run(); });
+	} catch (const std::system_error& oErr) {
+		return std::string("Could not create io_uring completion thread: ") + oErr.what(); //--
+	}
+	return "";
+}
+
+// hands the queued sqes to the kernel, returns the result of the last try
+static int submitQueued(struct io_uring* p0Ring) noexcept
+{
+	while (true) {
+		const int nRes = ::io_uring_submit(p0Ring);
+		if ((nRes == -EINTR) || (nRes == -EAGAIN) || (nRes == -EBUSY)) {
+			// too many completions not reaped yet
+			::sched_yield();
+			continue; // while ----
+		}
+		return nRes; //---------------------------------------------------------
+	}
+}
+
+template<typename FPrep>
+bool IoUring::submit(Op* p0Op, FPrep&& oPrep) noexcept
+{
+	int32_t nRingError;
+	{
+		std::lock_guard<std::mutex> oLock(m_oPendingMutex);
+		nRingError = m_nRingError;
+		if ((nRingError == 0) && (p0Op != nullptr)) {
+			++m_nPending;
+			m_oInFlight.insert(p0Op);
+		}
+	}
+	if (nRingError != 0) {
+		// the completion thread is gone
+		if (p0Op != nullptr) {
+			p0Op->cancel(nRingError);
+			delete p0Op;
+		}
+		return false; //--------------------------------------------------------
+	}
+	std::unique_lock<std::mutex> oLock(m_oSubmitMutex);
+	struct io_uring_sqe* p0Sqe;
+	while ((p0Sqe = ::io_uring_get_sqe(&m_oRing)) == nullptr) {
+		// the submission queue is full, hand it to the kernel
+		const int nRes = submitQueued(&m_oRing);
+		if (nRes < 0) {
+			oLock.unlock();
+			m_oLog.log_errno("io_uring:submit", - nRes);
+			fail(p0Op, nRes);
+			return false; //----------------------------------------------------
+		}
+	}
+	oPrep(p0Sqe);
+	::io_uring_sqe_set_data(p0Sqe, p0Op);
+	const int nRes = submitQueued(&m_oRing);
+	if (nRes < 0) {
+		// the kernel didn't take the sqe, it must not refer to the op
+		// when submitted later
+		::io_uring_prep_nop(p0Sqe);
+		::io_uring_sqe_set_data(p0Sqe, &s_nDiscarded);
+		oLock.unlock();
+		m_oLog.log_errno("io_uring:submit", - nRes);
+		fail(p0Op, nRes);
+		return false; //--------------------------------------------------------
+	}
+	return true;
+}
+
+void IoUring::fail(Op* p0Op, int32_t nRes) noexcept
+{
+	if (p0Op == nullptr) {
+		return; //--------------------------------------------------------------
+	}
+	{
+		std::lock_guard<std::mutex> oLock(m_oPendingMutex);
+		if (m_oInFlight.erase(p0Op) == 0) {
+			// the completion thread already failed it
+			return; //----------------------------------------------------------
+		}
+	}
+	p0Op->cancel(nRes);
+	delete p0Op;
+	std::lock_guard<std::mutex> oLock(m_oPendingMutex);
+	--m_nPending;
+	if (m_nPending == 0) {
+		m_oPendingCond.notify_all();
+	}
+}
+
+void IoUring::read(int nFd, void* p0Buf, size_t nSize, off_t nOffset, unique_ptr<Op> refOp) noexcept
+{
+	submit(refOp.release(), [&](struct io_uring_sqe* p0Sqe)
+	{
+		::io_uring_prep_read(p0Sqe, nFd, p0Buf, static_cast<unsigned>(nSize), static_cast<uint64_t>(nOffset));
+	});
+}
+void IoUring::write(int nFd, const void* p0Buf, size_t nSize, off_t nOffset, unique_ptr<Op> refOp) noexcept
+{
+	submit(refOp.release(), [&](struct io_uring_sqe* p0Sqe)
+	{
+		::io_uring_prep_write(p0Sqe, nFd, p0Buf, static_cast<unsigned>(nSize), static_cast<uint64_t>(nOffset));
+	});
+}
+void IoUring::fsync(int nFd, bool bDataSync, unique_ptr<Op> refOp) noexcept
+{
+	submit(refOp.release(), [&](struct io_uring_sqe* p0Sqe)
+	{
+		::io_uring_prep_fsync(p0Sqe, nFd, (bDataSync ? IORING_FSYNC_DATASYNC : 0));
+	});
+}
+void IoUring::close(int nFd, unique_ptr<Op> refOp) noexcept
+{
+	submit(refOp.release(), [&](struct io_uring_sqe* p0Sqe)
+	{
+		::io_uring_prep_close(p0Sqe, nFd);
+	});
+}
+
+void IoUring::drain() noexcept
+{
+	std::unique_lock<std::mutex> oLock(m_oPendingMutex);
+	m_oPendingCond.wait(oLock, [&](){ return m_nPending == 0; });
+}
+
+void IoUring::run() noexcept
+{
+	struct io_uring_cqe* aCqes[s_nMaxCompletionBatch];
+	bool bStop = false;
+	while (! bStop) {
+		struct io_uring_cqe* p0Cqe;
+		const int nRes = ::io_uring_wait_cqe(&m_oRing, &p0Cqe);
+		if (nRes < 0) {
+			if ((nRes == -EINTR) || (nRes == -EAGAIN)) {
+				continue; // while ----
+			}
+			m_oLog.log_errno("io_uring:wait_cqe", - nRes);
+			failAll(nRes);
+			break; // while ----
+		}
+		// all the completions available, not just the one waited for
+		const unsigned nTotCqes = ::io_uring_peek_batch_cqe(&m_oRing, aCqes, s_nMaxCompletionBatch);
+		{
+			std::lock_guard<std::mutex> oLock(m_oPendingMutex);
+			for (unsigned nIdx = 0; nIdx < nTotCqes; ++nIdx) {
+				m_oInFlight.erase(static_cast<Op*>(::io_uring_cqe_get_data(aCqes[nIdx])));
+			}
+		}
+		int64_t nCompleted = 0;
+		for (unsigned nIdx = 0; nIdx < nTotCqes; ++nIdx) {
+			void* p0Data = ::io_uring_cqe_get_data(aCqes[nIdx]);
+			if (p0Data == &s_nDiscarded) {
+				continue; // for ----
+			}
+			Op* p0Op = static_cast<Op*>(p0Data);
+			if (p0Op == nullptr) {
+				// the destructor waited for the pending ops, it's the last one
+				bStop = true;
+				continue; // for ----
+			}
+			p0Op->complete(aCqes[nIdx]->res);
+			delete p0Op;
+			++nCompleted;
+		}
+		::io_uring_cq_advance(&m_oRing, nTotCqes);
+		if (nCompleted > 0) {
+			std::lock_guard<std::mutex> oLock(m_oPendingMutex);
+			m_nPending -= nCompleted;
+			if (m_nPending == 0) {
+				m_oPendingCond.notify_all();
+			}
+		}
+	}
+}
+
+void IoUring::failAll(int32_t nRes) noexcept
+{
+	std::unordered_set<Op*> oInFlight;
+	{
+		std::lock_guard<std::mutex> oLock(m_oPendingMutex);
+		// from now on submit completes the ops itself
+		m_nRingError = nRes;
+		oInFlight.swap(m_oInFlight);
+	}
+	for (Op* p0Op : oInFlight) {
+		// the request gets its reply, but the op isn't deleted because
+		// the kernel might still use its buffers
+		p0Op->complete(nRes);
+	}
+	std::lock_guard<std::mutex> oLock(m_oPendingMutex);
+	m_nPending -= static_cast<int64_t>(oInFlight.size());
+	m_oPendingCond.notify_all();
+}
+
+} // namespace fspf
+
+#endif /* FSPROPFAKER_WITH_IO_URING */
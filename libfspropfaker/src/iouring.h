@@ -0,0 +1,133 @@
+/*
+ * Copyright © 2020  Stefano Marsili, <stemars@gmx.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+/*
+ * File:   iouring.h
+ */
+
+#ifndef FSPF_IO_URING_H
+#define FSPF_IO_URING_H
+
+#ifdef FSPROPFAKER_WITH_IO_URING
+
+#include <liburing.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_set>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace fspf
+{
+
+using std::unique_ptr;
+
+class FsLogger;
+
+/** Asynchronous reads, writes, syncs and closes of the underlying files.
+ * The operations are queued to an io_uring by the calling thread, which
+ * doesn't wait for them. A thread of the instance reaps the completions
+ * in batches and calls IoUring::Op::complete for each of them.
+ *
+ * If the ring fails, the pending and the following operations are completed
+ * with the error.
+ */
+class IoUring
+{
+public:
+	/** An operation in progress. */
+	class Op
+	{
+	public:
+		virtual ~Op() noexcept = default;
+		/** Called from the completion thread, the op is deleted afterwards.
+		 * @param nRes The bytes transferred or 0 if successful, the negative errno otherwise.
+		 */
+		virtual void complete(int32_t nRes) noexcept = 0;
+		/** Called instead of complete if the op couldn't be handed to the kernel.
+		 * The op is deleted afterwards.
+		 * @param nRes The negative errno.
+		 */
+		virtual void cancel(int32_t nRes) noexcept
+		{
+			complete(nRes);
+		}
+	};
+	/** Creates the ring and starts the completion thread.
+	 * Fails if the kernel doesn't support the operations (before Linux 5.6).
+	 * @param nEntries The size of the submission queue.
+	 * @param oLog The logger of the ring's errors. Must outlive the instance.
+	 * @return The instance and empty string or null and the error.
+	 */
+	static std::pair<unique_ptr<IoUring>, std::string> create(uint32_t nEntries, FsLogger& oLog) noexcept;
+	/** Waits for the pending operations and stops the completion thread.
+	 */
+	~IoUring() noexcept;
+
+	// the buffers must stay valid until the op completes
+	void read(int nFd, void* p0Buf, size_t nSize, off_t nOffset, unique_ptr<Op> refOp) noexcept;
+	void write(int nFd, const void* p0Buf, size_t nSize, off_t nOffset, unique_ptr<Op> refOp) noexcept;
+	void fsync(int nFd, bool bDataSync, unique_ptr<Op> refOp) noexcept;
+	void close(int nFd, unique_ptr<Op> refOp) noexcept;
+
+	/** Waits until all the submitted operations have completed.
+	 */
+	void drain() noexcept;
+protected:
+	explicit IoUring(FsLogger& oLog) noexcept;
+private:
+	// return empty if ok, error otherwise
+	std::string init(uint32_t nEntries) noexcept;
+	// queues the sqe prepared by oPrep, null p0Op stops the completion thread
+	// returns false if the op was completed with an error instead
+	template<typename FPrep>
+	bool submit(Op* p0Op, FPrep&& oPrep) noexcept;
+	// completes the op with the error, removing it from the pending
+	void fail(Op* p0Op, int32_t nRes) noexcept;
+	void run() noexcept;
+	// completes all the pending ops with the error of the ring
+	void failAll(int32_t nRes) noexcept;
+private:
+	FsLogger& m_oLog;
+	struct io_uring m_oRing;
+	bool m_bRingInited = false;
+	// serializes the submitters, the completion thread only uses the completion queue
+	std::mutex m_oSubmitMutex;
+
+	std::mutex m_oPendingMutex;
+	std::condition_variable m_oPendingCond;
+	int64_t m_nPending = 0; // protected by m_oPendingMutex
+	// the submitted ops not yet completed, protected by m_oPendingMutex
+	std::unordered_set<Op*> m_oInFlight;
+	// the negative errno if the completion thread stopped because of an error
+	int32_t m_nRingError = 0; // protected by m_oPendingMutex
+
+	unique_ptr<std::thread> m_refCompletionThread;
+private:
+	IoUring(const IoUring& oSource) = delete;
+	IoUring& operator=(const IoUring& oSource) = delete;
+};
+
+} // namespace fspf
+
+#endif /* FSPROPFAKER_WITH_IO_URING */
+
+#endif /* FSPF_IO_URING_H */
@@ -0,0 +1,115 @@
+/*
+ * Copyright © 2020  Stefano Marsili, <stemars@gmx.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+/*
+ * File:   logring.cc
+ */
+
+#include "logring.h"
+
+#include <cassert>
+#include <algorithm>
+
+#include <string.h>
+
+namespace fspf
+{
+
+// a record never takes more than this number of slots
+static constexpr uint64_t s_nMaxRecordSlots = 64;
+
+constexpr size_t LogRing::s_nSlotTextSize;
+
+LogRing::LogRing(uint32_t nTotSlots) noexcept
+: m_nMask(nTotSlots - 1)
+, m_aSlots(new Slot[nTotSlots])
+{
+	assert((nTotSlots >= s_nMaxRecordSlots) && ((nTotSlots & (nTotSlots - 1)) == 0));
+	for (uint32_t nIdx = 0; nIdx < nTotSlots; ++nIdx) {
+		m_aSlots[nIdx].m_nSeq.store(nIdx, std::memory_order_relaxed);
+	}
+}
+
+size_t LogRing::getMaxRecordSize() const noexcept
+{
+	return s_nMaxRecordSlots * s_nSlotTextSize;
+}
+
+bool LogRing::tryPush(const char* p0Text, size_t nLen) noexcept
+{
+	assert(nLen <= getMaxRecordSize());
+	const uint64_t nTotSlots = std::max<uint64_t>(1, (nLen + s_nSlotTextSize - 1) / s_nSlotTextSize);
+	uint64_t nPos = m_nEnqueuePos.load(std::memory_order_relaxed);
+	while (true) {
+		bool bStale = false;
+		for (uint64_t nIdx = 0; nIdx < nTotSlots; ++nIdx) {
+			const uint64_t nSeq = m_aSlots[(nPos + nIdx) & m_nMask].m_nSeq.load(std::memory_order_acquire);
+			const int64_t nDiff = static_cast<int64_t>(nSeq) - static_cast<int64_t>(nPos + nIdx);
+			if (nDiff < 0) {
+				// not yet consumed
+				return false; //--------------------------------------------------
+			}
+			if (nDiff > 0) {
+				// another producer claimed it
+				bStale = true;
+				break; // for ----
+			}
+		}
+		if (bStale) {
+			nPos = m_nEnqueuePos.load(std::memory_order_relaxed);
+			continue; // while ----
+		}
+		if (m_nEnqueuePos.compare_exchange_weak(nPos, nPos + nTotSlots, std::memory_order_relaxed)) {
+			break; // while ----
+		}
+	}
+	for (uint64_t nIdx = 0; nIdx < nTotSlots; ++nIdx) {
+		Slot& oSlot = m_aSlots[(nPos + nIdx) & m_nMask];
+		const size_t nChunk = std::min(nLen, s_nSlotTextSize);
+		::memcpy(oSlot.m_aText, p0Text, nChunk);
+		oSlot.m_nLen = static_cast<uint32_t>(nChunk);
+		p0Text += nChunk;
+		nLen -= nChunk;
+		oSlot.m_nSeq.store(nPos + nIdx + 1, std::memory_order_release);
+	}
+	return true;
+}
+
+void LogRing::popAll(std::string& sOut) noexcept
+{
+	uint64_t nPos = m_nDequeuePos.load(std::memory_order_relaxed);
+	while (true) {
+		Slot& oSlot = m_aSlots[nPos & m_nMask];
+		if (oSlot.m_nSeq.load(std::memory_order_acquire) != nPos + 1) {
+			// empty or not published yet
+			break; // while ----
+		}
+		sOut.append(oSlot.m_aText, oSlot.m_nLen);
+		oSlot.m_nSeq.store(nPos + m_nMask + 1, std::memory_order_release);
+		++nPos;
+	}
+	m_nDequeuePos.store(nPos, std::memory_order_relaxed);
+}
+
+bool LogRing::isHalfFull() const noexcept
+{
+	// the dequeue position first, it never passes the enqueue position
+	const uint64_t nDequeuePos = m_nDequeuePos.load(std::memory_order_relaxed);
+	const uint64_t nEnqueuePos = m_nEnqueuePos.load(std::memory_order_relaxed);
+	return (nEnqueuePos - nDequeuePos > (m_nMask + 1) / 2);
+}
+
+} // namespace fspf
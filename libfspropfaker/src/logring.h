@@ -0,0 +1,86 @@
+/*
+ * Copyright © 2020  Stefano Marsili, <stemars@gmx.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+/*
+ * File:   logring.h
+ */
+
+#ifndef FSPF_LOG_RING_H
+#define FSPF_LOG_RING_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace fspf
+{
+
+/** Bounded lock-free queue of text records with many producers and one consumer.
+ * A record longer than a slot occupies consecutive slots, which are claimed
+ * all at once, so that the consumer gets it in one piece.
+ */
+class LogRing
+{
+public:
+	/** Constructor.
+	 * @param nTotSlots The number of slots. Must be a power of two.
+	 */
+	explicit LogRing(uint32_t nTotSlots) noexcept;
+
+	/** The maximum length of a record.
+	 * @return The size in bytes.
+	 */
+	size_t getMaxRecordSize() const noexcept;
+	/** Adds a record. Can be called by any thread.
+	 * @param p0Text The text. Cannot be null.
+	 * @param nLen The length of the text. Must not be bigger than getMaxRecordSize().
+	 * @return Whether there was enough room.
+	 */
+	bool tryPush(const char* p0Text, size_t nLen) noexcept;
+	/** Removes the available records and appends them to a string.
+	 * Must only be called by the consumer thread.
+	 * @param sOut The string the text is appended to.
+	 */
+	void popAll(std::string& sOut) noexcept;
+	/** Whether at least half of the slots are used.
+	 * @return Whether the consumer should be woken up.
+	 */
+	bool isHalfFull() const noexcept;
+private:
+	static constexpr size_t s_nSlotTextSize = 116;
+	struct Slot
+	{
+		// the position for which the slot can be written (== pos) or read (== pos + 1)
+		std::atomic<uint64_t> m_nSeq;
+		uint32_t m_nLen;
+		char m_aText[s_nSlotTextSize];
+	};
+	const uint64_t m_nMask;
+	std::unique_ptr<Slot[]> m_aSlots;
+	alignas(64) std::atomic<uint64_t> m_nEnqueuePos{0};
+	alignas(64) std::atomic<uint64_t> m_nDequeuePos{0};
+private:
+	LogRing() = delete;
+	LogRing(const LogRing& oSource) = delete;
+	LogRing& operator=(const LogRing& oSource) = delete;
+};
+
+} // namespace fspf
+
+#endif /* FSPF_LOG_RING_H */
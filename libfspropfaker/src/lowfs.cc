@@ -0,0 +1,1525 @@
+/*
+ * Copyright © 2020  Stefano Marsili, <stemars@gmx.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+/*
+ * File:   lowfs.cc
+ */
+/* The inode table is modelled on libfuse's passthrough_ll example.
+ */
+
+#include "lowfs.h"
+
+#include "fspropfaker.h"
+#include "fuseloop.h"
+#include "fsdispatcher.h"
+
+#include <cassert>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/xattr.h>
+
+namespace fspf
+{
+
+// The default timeouts of the high level API.
+static constexpr double s_fDefaultEntryTimeout = 1.0;
+static constexpr double s_fDefaultAttrTimeout = 1.0;
+static constexpr double s_fDefaultNegativeTimeout = 0.0;
+
+// The nodes are opened with O_PATH, the operations that have no *at() variant
+// or don't accept AT_EMPTY_PATH go through the descriptor's proc link.
+static inline std::string getProcPath(int nFd) noexcept
+{
+	return "/proc/self/fd/" + std::to_string(nFd);
+}
+// the process that made the request, only used by the trace
+static inline pid_t getCallerPid(fuse_req_t oReq) noexcept
+{
+	#ifdef FSPROPFAKER_WITHOUT_LOGGING
+	(void)oReq;
+	return 0;
+	#else
+	return ::fuse_req_ctx(oReq)->pid;
+	#endif
+}
+
+#ifdef FSPROPFAKER_WITH_IO_URING
+static constexpr uint32_t s_nIoUringEntries = 256;
+
+// replies to the request when the operation completes
+class IoUringReply final : public IoUring::Op
+{
+public:
+	enum REPLY_TYPE
+	{
+		REPLY_TYPE_ERR = 0, // the error or success
+		REPLY_TYPE_BUF = 1, // the data read into m_refBuf
+		REPLY_TYPE_WRITE = 2, // the bytes written
+		REPLY_TYPE_CLOSE = 3 // the error or success of closing m_nFd
+	};
+	IoUringReply(fuse_req_t oReq, REPLY_TYPE eType, FsLogger& oLog, const char* p0Func
+				, unique_ptr<char[]> refBuf = unique_ptr<char[]>{}) noexcept
+	: m_oReq(oReq)
+	, m_eType(eType)
+	, m_oLog(oLog)
+	, m_p0Func(p0Func)
+	, m_refBuf(std::move(refBuf))
+	{
+	}
+	IoUringReply(fuse_req_t oReq, int nFd, FsLogger& oLog, const char* p0Func) noexcept
+	: IoUringReply(oReq, REPLY_TYPE_CLOSE, oLog, p0Func)
+	{
+		m_nFd = nFd;
+	}
+	void complete(int32_t nRes) noexcept override
+	{
+		if ((m_eType == REPLY_TYPE_CLOSE) && (nRes == -EINVAL)) {
+			// the kernel refused the request, the descriptor is still open
+			closeSync();
+			return; //----------------------------------------------------------
+		}
+		m_oLog.log_retstat(m_p0Func, nRes);
+		if (nRes < 0) {
+			m_oLog.log_errno(m_p0Func, - nRes);
+			::fuse_reply_err(m_oReq, - nRes);
+			return; //----------------------------------------------------------
+		}
+		switch (m_eType) {
+		case REPLY_TYPE_BUF:
+			::fuse_reply_buf(m_oReq, m_refBuf.get(), static_cast<size_t>(nRes));
+			break;
+		case REPLY_TYPE_WRITE:
+			::fuse_reply_write(m_oReq, static_cast<size_t>(nRes));
+			break;
+		default:
+			::fuse_reply_err(m_oReq, 0);
+			break;
+		}
+	}
+	void cancel(int32_t nRes) noexcept override
+	{
+		if (m_eType == REPLY_TYPE_CLOSE) {
+			closeSync();
+			return; //----------------------------------------------------------
+		}
+		complete(nRes);
+	}
+private:
+	void closeSync() noexcept
+	{
+		if (::close(m_nFd) != 0) {
+			::fuse_reply_err(m_oReq, - m_oLog.log_error(m_p0Func));
+			return; //----------------------------------------------------------
+		}
+		::fuse_reply_err(m_oReq, 0);
+	}
+private:
+	fuse_req_t m_oReq;
+	REPLY_TYPE m_eType;
+	int m_nFd = -1; // only REPLY_TYPE_CLOSE
+	FsLogger& m_oLog;
+	const char* m_p0Func;
+	unique_ptr<char[]> m_refBuf;
+};
+#endif
+
+std::pair<shared_ptr<LowFs>, std::string> LowFs::createInstance(FsPropFaker* p0FsPropFaker
+																, std::function<void()>&& oCallback) noexcept
+{
+	assert(p0FsPropFaker != nullptr);
+	auto refFs = shared_ptr<LowFs>(new LowFs(p0FsPropFaker, std::move(oCallback)));
+	std::string sErr = refFs->initInstance();
+	if (! sErr.empty()) {
+		return std::make_pair(shared_ptr<LowFs>{}, sErr);
+	}
+	return std::make_pair(refFs, "");
+}
+
+LowFs::LowFs(FsPropFaker* p0FsPropFaker, std::function<void()>&& oCallback) noexcept
+: FakeFs(p0FsPropFaker, std::move(oCallback))
+{
+	// the options the high level API would handle
+	const FsPropFaker::Options& oOptions = p0FsPropFaker->getOptions();
+	m_fEntryTimeout = ((oOptions.m_fEntryTimeout >= 0) ? oOptions.m_fEntryTimeout : s_fDefaultEntryTimeout);
+	m_fAttrTimeout = ((oOptions.m_fAttrTimeout >= 0) ? oOptions.m_fAttrTimeout : s_fDefaultAttrTimeout);
+	m_fNegativeTimeout = ((oOptions.m_fNegativeTimeout >= 0) ? oOptions.m_fNegativeTimeout : s_fDefaultNegativeTimeout);
+}
+std::string LowFs::initInstance() noexcept
+{
+	const std::string sErr = FakeFs::initInstance();
+	if (! sErr.empty()) {
+		return sErr; //---------------------------------------------------------
+	}
+	struct ::stat oStat;
+	if (::fstatat(m_nRootFd, "", &oStat, AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW) != 0) {
+		return m_sRootPath + ": " + std::string("Error ") + std::string(::strerror(errno)); //--
+	}
+	m_oRoot.m_nFd = m_nRootFd;
+	m_oRoot.m_nIno = oStat.st_ino;
+	m_oRoot.m_nDev = oStat.st_dev;
+	#ifdef FSPROPFAKER_WITH_IO_URING
+	if (m_p0FsPropFaker->getOptions().m_bIoUring) {
+		auto oPair = IoUring::create(s_nIoUringEntries, *m_refLogger);
+		if (oPair.first) {
+			m_refIoUring = std::move(oPair.first);
+		} else {
+			// ex. disabled by the kernel or the container, the blocking calls still work
+			m_refLogger->log_msg("\nlow:initInstance io_uring not available: %s\n", oPair.second.c_str());
+		}
+	}
+	#endif
+	return "";
+}
+LowFs::~LowFs() noexcept
+{
+	teardown();
+	// the nodes the kernel didn't forget before the connection ended
+	for (auto& oPair : m_oInodes) {
+		::close(oPair.second->m_nFd);
+	}
+}
+
+const struct fuse_lowlevel_ops* LowFs::getOperations() noexcept
+{
+	static struct fuse_lowlevel_ops s_oOperations;
+	static std::once_flag s_oOperationsSet;
+	std::call_once(s_oOperationsSet, [&]()
+	{
+		s_oOperations.init = init;
+		s_oOperations.destroy = destroy;
+		s_oOperations.lookup = lookup;
+		s_oOperations.forget = forget;
+		s_oOperations.forget_multi = forget_multi;
+		s_oOperations.getattr = getattr;
+		s_oOperations.setattr = setattr;
+		s_oOperations.readlink = readlink;
+		s_oOperations.mknod = mknod;
+		s_oOperations.mkdir = mkdir;
+		s_oOperations.unlink = unlink;
+		s_oOperations.rmdir = rmdir;
+		s_oOperations.symlink = symlink;
+		s_oOperations.rename = rename;
+		s_oOperations.link = link;
+		s_oOperations.open = open;
+		s_oOperations.create = create;
+		s_oOperations.read = read;
+		s_oOperations.write_buf = write_buf;
+		s_oOperations.flush = flush;
+		s_oOperations.release = release;
+		s_oOperations.fsync = fsync;
+		s_oOperations.fallocate = fallocate;
+		#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 4)
+		s_oOperations.copy_file_range = copy_file_range;
+		#endif
+		#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+		s_oOperations.lseek = lseek;
+		#endif
+		s_oOperations.statfs = statfs;
+		s_oOperations.setxattr = setxattr;
+		s_oOperations.getxattr = getxattr;
+		s_oOperations.listxattr = listxattr;
+		s_oOperations.removexattr = removexattr;
+		s_oOperations.opendir = opendir;
+		s_oOperations.readdir = readdir;
+		#if FUSE_USE_VERSION < 35
+		#else
+		s_oOperations.readdirplus = readdirplus;
+		#endif
+		s_oOperations.releasedir = releasedir;
+		s_oOperations.fsyncdir = fsyncdir;
+		s_oOperations.access = access;
+	});
+	return &s_oOperations;
+}
+LowFs* LowFs::this_(fuse_req_t oReq) noexcept
+{
+	return static_cast<LowFs*>(::fuse_req_userdata(oReq));
+}
+
+std::string LowFs::mount(int nArgC, char** aArgV) noexcept
+{
+	assert(m_p0Session == nullptr);
+	struct fuse_args oArgs = FUSE_ARGS_INIT(nArgC, aArgV);
+	#if FUSE_USE_VERSION < 35
+	int nMultiThreaded;
+	int nForeground;
+	if (::fuse_parse_cmdline(&oArgs, &m_p0MountPoint, &nMultiThreaded, &nForeground) == -1) {
+		::fuse_opt_free_args(&oArgs);
+		return "Could not parse fuse arguments"; //---------------------------------
+	}
+	const std::string sMountPoint = m_p0MountPoint;
+	m_p0Chan = ::fuse_mount(m_p0MountPoint, &oArgs);
+	if (m_p0Chan == nullptr) {
+		::fuse_opt_free_args(&oArgs);
+		::free(m_p0MountPoint);
+		m_p0MountPoint = nullptr;
+		return "Could not mount " + sMountPoint; //---------------------------------
+	}
+	m_p0Session = ::fuse_lowlevel_new(&oArgs, getOperations(), sizeof(struct fuse_lowlevel_ops), this);
+	::fuse_opt_free_args(&oArgs);
+	if (m_p0Session == nullptr) {
+		::fuse_unmount(m_p0MountPoint, m_p0Chan);
+		m_p0Chan = nullptr;
+		::free(m_p0MountPoint);
+		m_p0MountPoint = nullptr;
+		return "Could not create fuse session"; //---------------------------------
+	}
+	::fuse_session_add_chan(m_p0Session, m_p0Chan);
+	#else
+	struct fuse_cmdline_opts oOpts;
+	if (::fuse_parse_cmdline(&oArgs, &oOpts) != 0) {
+		::fuse_opt_free_args(&oArgs);
+		return "Could not parse fuse arguments"; //---------------------------------
+	}
+	const std::string sMountPoint = oOpts.mountpoint;
+	::free(oOpts.mountpoint);
+	// the session rejects the options that are applied in init (ex. max_write)
+	m_p0ConnInfoOpts = ::fuse_parse_conn_info_opts(&oArgs);
+	if (m_p0ConnInfoOpts == nullptr) {
+		::fuse_opt_free_args(&oArgs);
+		return "Could not parse fuse arguments"; //---------------------------------
+	}
+	m_p0Session = ::fuse_session_new(&oArgs, getOperations(), sizeof(struct fuse_lowlevel_ops), this);
+	::fuse_opt_free_args(&oArgs);
+	if (m_p0Session == nullptr) {
+		::free(m_p0ConnInfoOpts);
+		m_p0ConnInfoOpts = nullptr;
+		return "Could not create fuse session"; //---------------------------------
+	}
+	if (::fuse_session_mount(m_p0Session, sMountPoint.c_str()) != 0) {
+		::fuse_session_destroy(m_p0Session);
+		m_p0Session = nullptr;
+		::free(m_p0ConnInfoOpts);
+		m_p0ConnInfoOpts = nullptr;
+		return "Could not mount " + sMountPoint; //---------------------------------
+	}
+	#endif
+	return "";
+}
+
+int LowFs::loop() noexcept
+{
+	assert(m_p0Session != nullptr);
+	const FsPropFaker::Options& oOptions = m_p0FsPropFaker->getOptions();
+	if (oOptions.m_bSingleThreaded) {
+		return ::fuse_session_loop(m_p0Session); //---------------------------------
+	}
+	if (oOptions.m_nWorkerThreads > 0) {
+		return fuseLoopFixedThreads(m_p0Session, oOptions.m_nWorkerThreads
+									, [&]() { unmountLazily(); }); //-----------
+	}
+	#if FUSE_USE_VERSION < 35
+	return ::fuse_session_loop_mt(m_p0Session);
+	#else
+	struct fuse_loop_config oConfig;
+	oConfig.clone_fd = (oOptions.m_bCloneFd ? 1 : 0);
+	oConfig.max_idle_threads = ((oOptions.m_nMaxIdleThreads >= 0) ? oOptions.m_nMaxIdleThreads : 10);
+	return ::fuse_session_loop_mt(m_p0Session, &oConfig);
+	#endif
+}
+
+std::string LowFs::dispatch(FsDispatcher& oDispatcher, std::function<void()>&& oOnEnd) noexcept
+{
+	assert(m_p0Session != nullptr);
+	#if FUSE_USE_VERSION < 35
+	struct fuse_chan* p0Chan = m_p0Chan;
+	#else
+	struct fuse_chan* p0Chan = nullptr;
+	#endif
+	return oDispatcher.addSession(m_p0Session, p0Chan, [this, oOnEnd]()
+	{
+		teardown();
+		oOnEnd();
+	});
+}
+
+void LowFs::teardown() noexcept
+{
+	if (m_p0Session == nullptr) {
+		return; //--------------------------------------------------------------
+	}
+	if (! m_bUnmounted.exchange(true)) {
+		#if FUSE_USE_VERSION < 35
+		// also destroys the channel
+		::fuse_session_remove_chan(m_p0Chan);
+		::fuse_unmount(m_p0MountPoint, m_p0Chan);
+		#else
+		::fuse_session_unmount(m_p0Session);
+		#endif
+	}
+	#if FUSE_USE_VERSION < 35
+	m_p0Chan = nullptr;
+	#endif
+	#ifdef FSPROPFAKER_WITH_IO_URING
+	if (m_refIoUring) {
+		// the pending operations still reply to the session
+		m_refIoUring->drain();
+	}
+	#endif
+	{
+		std::lock_guard<std::mutex> oLock(m_oSessionMutex);
+		::fuse_session_destroy(m_p0Session);
+		m_p0Session = nullptr;
+	}
+	#if FUSE_USE_VERSION < 35
+	::free(m_p0MountPoint);
+	m_p0MountPoint = nullptr;
+	#else
+	::free(m_p0ConnInfoOpts);
+	m_p0ConnInfoOpts = nullptr;
+	#endif
+}
+
+void LowFs::exitSession() noexcept
+{
+	{
+		std::lock_guard<std::mutex> oLock(m_oSessionMutex);
+		if (m_p0Session != nullptr) {
+			::fuse_session_exit(m_p0Session);
+		}
+	}
+	// without open files the kernel then ends the connection,
+	// which wakes up the threads reading the fuse device
+	unmountLazily();
+}
+
+LowFs::Inode& LowFs::getInode(fuse_ino_t nIno) noexcept
+{
+	if (nIno == FUSE_ROOT_ID) {
+		return m_oRoot; //------------------------------------------------------
+	}
+	return *reinterpret_cast<Inode*>(static_cast<uintptr_t>(nIno));
+}
+
+int LowFs::lookupEntry(fuse_ino_t nParent, const char* p0Name, struct fuse_entry_param& oEntry) noexcept
+{
+	std::memset(&oEntry, 0, sizeof(oEntry));
+	oEntry.attr_timeout = m_fAttrTimeout;
+	oEntry.entry_timeout = m_fEntryTimeout;
+
+	const int nFd = ::openat(getInode(nParent).m_nFd, p0Name, O_PATH | O_NOFOLLOW | O_CLOEXEC);
+	if (nFd < 0) {
+		return errno; //--------------------------------------------------------
+	}
+	if (::fstatat(nFd, "", &oEntry.attr, AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW) != 0) {
+		const int nErrno = errno;
+		::close(nFd);
+		return nErrno; //-------------------------------------------------------
+	}
+	const InodeKey oKey{oEntry.attr.st_ino, oEntry.attr.st_dev};
+	if ((oKey.m_nIno == m_oRoot.m_nIno) && (oKey.m_nDev == m_oRoot.m_nDev)) {
+		::close(nFd);
+		oEntry.ino = FUSE_ROOT_ID;
+		return 0; //------------------------------------------------------------
+	}
+	std::lock_guard<std::mutex> oLock(m_oInodesMutex);
+	auto itFind = m_oInodes.find(oKey);
+	Inode* p0Inode;
+	if (itFind != m_oInodes.end()) {
+		// already known, maybe through another link
+		::close(nFd);
+		p0Inode = itFind->second.get();
+	} else {
+		auto refInode = std::make_unique<Inode>();
+		refInode->m_nFd = nFd;
+		refInode->m_nIno = oKey.m_nIno;
+		refInode->m_nDev = oKey.m_nDev;
+		p0Inode = refInode.get();
+		m_oInodes.emplace(oKey, std::move(refInode));
+	}
+	++p0Inode->m_nLookups;
+	oEntry.ino = static_cast<fuse_ino_t>(reinterpret_cast<uintptr_t>(p0Inode));
+	return 0;
+}
+void LowFs::forgetInode(fuse_ino_t nIno, uint64_t nLookups) noexcept
+{
+	if (nIno == FUSE_ROOT_ID) {
+		return; //--------------------------------------------------------------
+	}
+	Inode& oInode = getInode(nIno);
+	std::lock_guard<std::mutex> oLock(m_oInodesMutex);
+	assert(oInode.m_nLookups >= nLookups);
+	oInode.m_nLookups -= nLookups;
+	if (oInode.m_nLookups > 0) {
+		return; //--------------------------------------------------------------
+	}
+	::close(oInode.m_nFd);
+	m_oInodes.erase(InodeKey{oInode.m_nIno, oInode.m_nDev});
+}
+
+std::string LowFs::getMountRelPath(int nFd) const noexcept
+{
+	char aPath[PATH_MAX];
+	const ssize_t nLen = ::readlink(getProcPath(nFd).c_str(), aPath, sizeof(aPath) - 1);
+	if (nLen < 0) {
+		return "?"; //----------------------------------------------------------
+	}
+	const std::string sPath(aPath, static_cast<size_t>(nLen));
+	const size_t nRootLen = m_sRootPath.size();
+	if ((sPath.compare(0, nRootLen, m_sRootPath) != 0)
+			|| ((sPath.size() > nRootLen) && (sPath[nRootLen] != '/'))) {
+		return sPath; //--------------------------------------------------------
+	}
+	return ((sPath.size() == nRootLen) ? std::string("/") : sPath.substr(nRootLen));
+}
+
+void LowFs::replyEntry(fuse_req_t oReq, fuse_ino_t nParent, const char* p0Name) noexcept
+{
+	auto& oLog = *m_refLogger;
+	struct fuse_entry_param oEntry;
+	const int nErrno = lookupEntry(nParent, p0Name, oEntry);
+	if (nErrno != 0) {
+		oLog.log_errno("low:lookup", nErrno);
+		::fuse_reply_err(oReq, nErrno);
+		return; //--------------------------------------------------------------
+	}
+	oLog.log_stat(&oEntry.attr);
+	if (::fuse_reply_entry(oReq, &oEntry) != 0) {
+		// the request was interrupted, the kernel doesn't know about the node
+		forgetInode(oEntry.ino, 1);
+	}
+}
+
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 16)
+void LowFs::openPassthrough(fuse_req_t oReq, Inode& oInode, int nFd, struct fuse_file_info* p0FI) noexcept
+{
+	if (! m_bPassthrough) {
+		return; //--------------------------------------------------------------
+	}
+	std::lock_guard<std::mutex> oLock(oInode.m_oBackingMutex);
+	++oInode.m_nBackingOpens;
+	// the handles of a node share the backing file, the kernel opens
+	// it again with the flags of each handle
+	if ((oInode.m_nBackingId == 0) && ! m_bPassthroughDenied.load(std::memory_order_relaxed)) {
+		const int nBackingId = ::fuse_passthrough_open(oReq, nFd);
+		if (nBackingId > 0) {
+			oInode.m_nBackingId = nBackingId;
+		} else {
+			const int nErrno = errno;
+			m_refLogger->log_msg("    low:passthrough refused: %s\n", ::strerror(nErrno));
+			if (nErrno == EPERM) {
+				// needs CAP_SYS_ADMIN, don't ask again for each open
+				m_bPassthroughDenied = true;
+			}
+		}
+	}
+	// if 0 the faker serves the data
+	p0FI->backing_id = oInode.m_nBackingId;
+}
+void LowFs::releasePassthrough(fuse_req_t oReq, Inode& oInode) noexcept
+{
+	if (! m_bPassthrough) {
+		return; //--------------------------------------------------------------
+	}
+	std::lock_guard<std::mutex> oLock(oInode.m_oBackingMutex);
+	assert(oInode.m_nBackingOpens > 0);
+	--oInode.m_nBackingOpens;
+	if ((oInode.m_nBackingOpens == 0) && (oInode.m_nBackingId != 0)) {
+		::fuse_passthrough_close(oReq, oInode.m_nBackingId);
+		oInode.m_nBackingId = 0;
+	}
+}
+#endif
+
+void LowFs::init(void* p0Userdata, struct fuse_conn_info* p0Conn)
+{
+	LowFs* p0LowFs = static_cast<LowFs*>(p0Userdata);
+
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_INIT, 0, nullptr);
+	oLog.log_msg("\nlow:init()\n");
+
+	// let libfuse splice the data returned by read to the fuse device
+	if ((p0Conn->capable & FUSE_CAP_SPLICE_WRITE) != 0) {
+		p0Conn->want |= FUSE_CAP_SPLICE_WRITE;
+	}
+	if ((p0Conn->capable & FUSE_CAP_SPLICE_MOVE) != 0) {
+		p0Conn->want |= FUSE_CAP_SPLICE_MOVE;
+	}
+	// let libfuse splice the requests from the fuse device so that
+	// write_buf can pass them on to the backing file
+	if ((p0Conn->capable & FUSE_CAP_SPLICE_READ) != 0) {
+		p0Conn->want |= FUSE_CAP_SPLICE_READ;
+	}
+	#if FUSE_USE_VERSION < 35
+	#else
+	// let the kernel get the nodes along with readdir
+	if ((p0Conn->capable & FUSE_CAP_READDIRPLUS) != 0) {
+		p0Conn->want |= FUSE_CAP_READDIRPLUS;
+	}
+	// max_write and the like, libfuse derives max_pages from max_write
+	::fuse_apply_conn_info_opts(p0LowFs->m_p0ConnInfoOpts, p0Conn);
+	// let the kernel collect small writes in its page cache
+	if (p0LowFs->m_p0FsPropFaker->getOptions().m_bWritebackCache
+			&& ((p0Conn->capable & FUSE_CAP_WRITEBACK_CACHE) != 0)) {
+		p0Conn->want |= FUSE_CAP_WRITEBACK_CACHE;
+		p0LowFs->m_bWritebackCache = true;
+	}
+	#endif
+	#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 16)
+	// let the kernel read and write the underlying files directly,
+	// only the metadata and statfs requests reach the faker
+	if (p0LowFs->m_p0FsPropFaker->getOptions().m_bPassthrough
+			&& ((p0Conn->capable & FUSE_CAP_PASSTHROUGH) != 0)) {
+		p0Conn->want |= FUSE_CAP_PASSTHROUGH;
+		p0LowFs->m_bPassthrough = true;
+	}
+	#endif
+
+	oLog.log_conn(p0Conn);
+
+	// inform main thread that the file system has been initialized
+	p0LowFs->m_oCallback();
+}
+void LowFs::destroy(void* p0Userdata)
+{
+	LowFs* p0LowFs = static_cast<LowFs*>(p0Userdata);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_DESTROY, 0, nullptr);
+
+	oLog.log_msg("\nlow:destroy(userdata=0x%08x)\n", p0Userdata);
+}
+
+void LowFs::lookup(fuse_req_t oReq, fuse_ino_t nParent, const char* p0Name)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_LOOKUP, getCallerPid(oReq), nParent, p0Name);
+
+	oLog.log_msg("\nlow:lookup(parent=%llu, name=\"%s\")\n", static_cast<unsigned long long>(nParent), p0Name);
+
+	struct fuse_entry_param oEntry;
+	const int nErrno = p0LowFs->lookupEntry(nParent, p0Name, oEntry);
+	if ((nErrno == ENOENT) && (p0LowFs->m_fNegativeTimeout > 0)) {
+		// let the kernel cache that the name doesn't exist
+		std::memset(&oEntry, 0, sizeof(oEntry));
+		oEntry.entry_timeout = p0LowFs->m_fNegativeTimeout;
+		oLog.setTraceResult(- nErrno);
+		::fuse_reply_entry(oReq, &oEntry);
+		return; //--------------------------------------------------------------
+	}
+	if (nErrno != 0) {
+		oLog.log_errno("low:lookup", nErrno);
+		::fuse_reply_err(oReq, nErrno);
+		return; //--------------------------------------------------------------
+	}
+	oLog.log_stat(&oEntry.attr);
+	if (::fuse_reply_entry(oReq, &oEntry) != 0) {
+		p0LowFs->forgetInode(oEntry.ino, 1);
+	}
+}
+
+void LowFs::forget(fuse_req_t oReq, fuse_ino_t nIno
+					#if FUSE_USE_VERSION < 35
+					, unsigned long nLookups
+					#else
+					, uint64_t nLookups
+					#endif
+					)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	FsLogger::TraceOp oTrace(*(p0LowFs->m_refLogger), TRACE_OP_FORGET, getCallerPid(oReq), nIno, nullptr, nLookups);
+	p0LowFs->forgetInode(nIno, nLookups);
+	::fuse_reply_none(oReq);
+}
+void LowFs::forget_multi(fuse_req_t oReq, size_t nCount, struct fuse_forget_data* p0Forgets)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	for (size_t nIdx = 0; nIdx < nCount; ++nIdx) {
+		p0LowFs->forgetInode(static_cast<fuse_ino_t>(p0Forgets[nIdx].ino), p0Forgets[nIdx].nlookup);
+	}
+	::fuse_reply_none(oReq);
+}
+
+void LowFs::getattr(fuse_req_t oReq, fuse_ino_t nIno, struct fuse_file_info* /*p0FI*/)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_GETATTR, getCallerPid(oReq), nIno, nullptr);
+
+	oLog.log_msg("\nlow:getattr(ino=%llu)\n", static_cast<unsigned long long>(nIno));
+
+	struct ::stat oStat;
+	if (::fstatat(p0LowFs->getInode(nIno).m_nFd, "", &oStat, AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW) != 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:getattr fstatat"));
+		return; //--------------------------------------------------------------
+	}
+	oLog.log_stat(&oStat);
+	::fuse_reply_attr(oReq, &oStat, p0LowFs->m_fAttrTimeout);
+}
+
+void LowFs::setattr(fuse_req_t oReq, fuse_ino_t nIno, struct ::stat* p0Attr, int nToSet, struct fuse_file_info* p0FI)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_SETATTR, getCallerPid(oReq), nIno, nullptr, nToSet, p0Attr->st_size);
+
+	oLog.log_msg("\nlow:setattr(ino=%llu, to_set=0x%x, fi=0x%08x)\n", static_cast<unsigned long long>(nIno), nToSet, p0FI);
+
+	const int nFd = p0LowFs->getInode(nIno).m_nFd;
+	const std::string sProcPath = getProcPath(nFd);
+	if ((nToSet & FUSE_SET_ATTR_MODE) != 0) {
+		const int nRes = ((p0FI != nullptr) ? ::fchmod(static_cast<int>(p0FI->fh), p0Attr->st_mode)
+											: ::chmod(sProcPath.c_str(), p0Attr->st_mode));
+		if (nRes != 0) {
+			::fuse_reply_err(oReq, - oLog.log_error("low:setattr chmod"));
+			return; //----------------------------------------------------------
+		}
+	}
+	if ((nToSet & (FUSE_SET_ATTR_UID | FUSE_SET_ATTR_GID)) != 0) {
+		const uid_t nUId = (((nToSet & FUSE_SET_ATTR_UID) != 0) ? p0Attr->st_uid : static_cast<uid_t>(-1));
+		const gid_t nGId = (((nToSet & FUSE_SET_ATTR_GID) != 0) ? p0Attr->st_gid : static_cast<gid_t>(-1));
+		if (::fchownat(nFd, "", nUId, nGId, AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW) != 0) {
+			::fuse_reply_err(oReq, - oLog.log_error("low:setattr fchownat"));
+			return; //----------------------------------------------------------
+		}
+	}
+	if ((nToSet & FUSE_SET_ATTR_SIZE) != 0) {
+		const int nRes = ((p0FI != nullptr) ? ::ftruncate(static_cast<int>(p0FI->fh), p0Attr->st_size)
+											: ::truncate(sProcPath.c_str(), p0Attr->st_size));
+		if (nRes != 0) {
+			::fuse_reply_err(oReq, - oLog.log_error("low:setattr truncate"));
+			return; //----------------------------------------------------------
+		}
+	}
+	if ((nToSet & (FUSE_SET_ATTR_ATIME | FUSE_SET_ATTR_MTIME)) != 0) {
+		struct ::timespec aTimes[2];
+		aTimes[0].tv_sec = 0;
+		aTimes[0].tv_nsec = UTIME_OMIT;
+		aTimes[1].tv_sec = 0;
+		aTimes[1].tv_nsec = UTIME_OMIT;
+		if ((nToSet & FUSE_SET_ATTR_ATIME_NOW) != 0) {
+			aTimes[0].tv_nsec = UTIME_NOW;
+		} else if ((nToSet & FUSE_SET_ATTR_ATIME) != 0) {
+			aTimes[0] = p0Attr->st_atim;
+		}
+		if ((nToSet & FUSE_SET_ATTR_MTIME_NOW) != 0) {
+			aTimes[1].tv_nsec = UTIME_NOW;
+		} else if ((nToSet & FUSE_SET_ATTR_MTIME) != 0) {
+			aTimes[1] = p0Attr->st_mtim;
+		}
+		const int nRes = ((p0FI != nullptr) ? ::futimens(static_cast<int>(p0FI->fh), aTimes)
+											: ::utimensat(AT_FDCWD, sProcPath.c_str(), aTimes, 0));
+		if (nRes != 0) {
+			::fuse_reply_err(oReq, - oLog.log_error("low:setattr utimensat"));
+			return; //----------------------------------------------------------
+		}
+	}
+	getattr(oReq, nIno, p0FI);
+}
+
+void LowFs::readlink(fuse_req_t oReq, fuse_ino_t nIno)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_READLINK, getCallerPid(oReq), nIno, nullptr);
+
+	oLog.log_msg("\nlow:readlink(ino=%llu)\n", static_cast<unsigned long long>(nIno));
+
+	char aLink[PATH_MAX + 1];
+	const ssize_t nLen = ::readlinkat(p0LowFs->getInode(nIno).m_nFd, "", aLink, sizeof(aLink));
+	if (nLen < 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:readlink readlinkat"));
+		return; //--------------------------------------------------------------
+	}
+	if (nLen == static_cast<ssize_t>(sizeof(aLink))) {
+		oLog.log_errno("low:readlink", ENAMETOOLONG);
+		::fuse_reply_err(oReq, ENAMETOOLONG);
+		return; //--------------------------------------------------------------
+	}
+	aLink[nLen] = '\0';
+	oLog.log_msg("    link=\"%s\"\n", aLink);
+	::fuse_reply_readlink(oReq, aLink);
+}
+
+void LowFs::mknod(fuse_req_t oReq, fuse_ino_t nParent, const char* p0Name, mode_t nMode, dev_t nDev)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_MKNOD, getCallerPid(oReq), nParent, p0Name, nMode, nDev);
+
+	oLog.log_msg("\nlow:mknod(parent=%llu, name=\"%s\", mode=0%3o, dev=%lld)\n"
+				, static_cast<unsigned long long>(nParent), p0Name, nMode, nDev);
+
+	const int nParentFd = p0LowFs->getInode(nParent).m_nFd;
+	int nRes;
+	if (S_ISDIR(nMode)) {
+		nRes = ::mkdirat(nParentFd, p0Name, nMode);
+	} else if (S_ISLNK(nMode)) {
+		nRes = -1;
+		errno = EINVAL;
+	} else {
+		nRes = ::mknodat(nParentFd, p0Name, nMode, nDev);
+	}
+	if (nRes != 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:mknod mknodat"));
+		return; //--------------------------------------------------------------
+	}
+	p0LowFs->replyEntry(oReq, nParent, p0Name);
+}
+
+void LowFs::mkdir(fuse_req_t oReq, fuse_ino_t nParent, const char* p0Name, mode_t nMode)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_MKDIR, getCallerPid(oReq), nParent, p0Name, nMode);
+
+	oLog.log_msg("\nlow:mkdir(parent=%llu, name=\"%s\", mode=0%3o)\n"
+				, static_cast<unsigned long long>(nParent), p0Name, nMode);
+
+	if (::mkdirat(p0LowFs->getInode(nParent).m_nFd, p0Name, nMode) != 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:mkdir mkdirat"));
+		return; //--------------------------------------------------------------
+	}
+	p0LowFs->replyEntry(oReq, nParent, p0Name);
+}
+
+void LowFs::unlink(fuse_req_t oReq, fuse_ino_t nParent, const char* p0Name)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_UNLINK, getCallerPid(oReq), nParent, p0Name);
+
+	oLog.log_msg("\nlow:unlink(parent=%llu, name=\"%s\")\n", static_cast<unsigned long long>(nParent), p0Name);
+
+	if (::unlinkat(p0LowFs->getInode(nParent).m_nFd, p0Name, 0) != 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:unlink unlinkat"));
+		return; //--------------------------------------------------------------
+	}
+	::fuse_reply_err(oReq, 0);
+}
+
+void LowFs::rmdir(fuse_req_t oReq, fuse_ino_t nParent, const char* p0Name)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_RMDIR, getCallerPid(oReq), nParent, p0Name);
+
+	oLog.log_msg("\nlow:rmdir(parent=%llu, name=\"%s\")\n", static_cast<unsigned long long>(nParent), p0Name);
+
+	if (::unlinkat(p0LowFs->getInode(nParent).m_nFd, p0Name, AT_REMOVEDIR) != 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:rmdir unlinkat"));
+		return; //--------------------------------------------------------------
+	}
+	::fuse_reply_err(oReq, 0);
+}
+
+void LowFs::symlink(fuse_req_t oReq, const char* p0Link, fuse_ino_t nParent, const char* p0Name)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_SYMLINK, getCallerPid(oReq), nParent, p0Name);
+	oTrace.setSecond(0, p0Link);
+
+	oLog.log_msg("\nlow:symlink(link=\"%s\", parent=%llu, name=\"%s\")\n"
+				, p0Link, static_cast<unsigned long long>(nParent), p0Name);
+
+	if (::symlinkat(p0Link, p0LowFs->getInode(nParent).m_nFd, p0Name) != 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:symlink symlinkat"));
+		return; //--------------------------------------------------------------
+	}
+	p0LowFs->replyEntry(oReq, nParent, p0Name);
+}
+
+void LowFs::rename(fuse_req_t oReq, fuse_ino_t nParent, const char* p0Name
+					, fuse_ino_t nNewParent, const char* p0NewName
+					#if FUSE_USE_VERSION < 35
+					#else
+					, unsigned int nFlags
+					#endif
+					)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	#if FUSE_USE_VERSION < 35
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_RENAME, getCallerPid(oReq), nParent, p0Name);
+	#else
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_RENAME, getCallerPid(oReq), nParent, p0Name, nFlags);
+	#endif
+	oTrace.setSecond(nNewParent, p0NewName);
+
+	oLog.log_msg("\nlow:rename(parent=%llu, name=\"%s\", newparent=%llu, newname=\"%s\")\n"
+				, static_cast<unsigned long long>(nParent), p0Name
+				, static_cast<unsigned long long>(nNewParent), p0NewName);
+
+	#if FUSE_USE_VERSION < 35
+	#else
+	if (nFlags != 0) {
+		// RENAME_EXCHANGE and RENAME_NOREPLACE are not supported
+		oLog.log_errno("low:rename flags", EINVAL);
+		::fuse_reply_err(oReq, EINVAL);
+		return; //--------------------------------------------------------------
+	}
+	#endif
+	if (::renameat(p0LowFs->getInode(nParent).m_nFd, p0Name, p0LowFs->getInode(nNewParent).m_nFd, p0NewName) != 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:rename renameat"));
+		return; //--------------------------------------------------------------
+	}
+	::fuse_reply_err(oReq, 0);
+}
+
+void LowFs::link(fuse_req_t oReq, fuse_ino_t nIno, fuse_ino_t nNewParent, const char* p0NewName)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_LINK, getCallerPid(oReq), nIno, nullptr);
+	oTrace.setSecond(nNewParent, p0NewName);
+
+	oLog.log_msg("\nlow:link(ino=%llu, newparent=%llu, newname=\"%s\")\n"
+				, static_cast<unsigned long long>(nIno), static_cast<unsigned long long>(nNewParent), p0NewName);
+
+	// linkat with AT_EMPTY_PATH needs CAP_DAC_READ_SEARCH, the proc link doesn't
+	const std::string sProcPath = getProcPath(p0LowFs->getInode(nIno).m_nFd);
+	if (::linkat(AT_FDCWD, sProcPath.c_str(), p0LowFs->getInode(nNewParent).m_nFd, p0NewName, AT_SYMLINK_FOLLOW) != 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:link linkat"));
+		return; //--------------------------------------------------------------
+	}
+	p0LowFs->replyEntry(oReq, nNewParent, p0NewName);
+}
+
+void LowFs::open(fuse_req_t oReq, fuse_ino_t nIno, struct fuse_file_info* p0FI)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_OPEN, getCallerPid(oReq), nIno, nullptr, p0FI->flags);
+
+	oLog.log_msg("\nlow:open(ino=%llu, fi=0x%08x)\n", static_cast<unsigned long long>(nIno), p0FI);
+
+	Inode& oInode = p0LowFs->getInode(nIno);
+	const int nFd = ::open(getProcPath(oInode.m_nFd).c_str(), p0LowFs->getUnderlyingOpenFlags(p0FI->flags) & ~O_NOFOLLOW);
+	if (nFd < 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:open open"));
+		return; //--------------------------------------------------------------
+	}
+	p0FI->fh = static_cast<uint64_t>(nFd);
+	#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 11)
+	if ((p0FI->flags & O_ACCMODE) == O_RDONLY) {
+		// nothing to flush, the kernel doesn't send the request when closed
+		// (what no_rofd_flush does for the high level API)
+		p0FI->noflush = 1;
+	}
+	#endif
+	const FsPropFaker::Options& oOptions = p0LowFs->m_p0FsPropFaker->getOptions();
+	if (oOptions.m_bKernelCache) {
+		p0FI->keep_cache = 1;
+	} else if (oOptions.m_bAutoCache) {
+		// like the high level API keep the cached data if the file wasn't modified
+		struct ::stat oStat;
+		if (::fstat(nFd, &oStat) == 0) {
+			const int64_t nMTimeNs = static_cast<int64_t>(oStat.st_mtim.tv_sec) * 1000000000 + oStat.st_mtim.tv_nsec;
+			p0FI->keep_cache = ((oInode.m_nOpenMTimeNs.exchange(nMTimeNs) == nMTimeNs) ? 1 : 0);
+		}
+	}
+	#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 16)
+	p0LowFs->openPassthrough(oReq, oInode, nFd, p0FI);
+	#endif
+	p0LowFs->addOpenHandle(p0FI->fh, p0LowFs->getMountRelPath(nFd).c_str());
+	oLog.log_fi(p0FI);
+	if (::fuse_reply_open(oReq, p0FI) != 0) {
+		// the request was interrupted, release won't be called
+		p0LowFs->removeOpenHandle(p0FI->fh);
+		::close(nFd);
+		#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 16)
+		p0LowFs->releasePassthrough(oReq, oInode);
+		#endif
+	}
+}
+
+void LowFs::create(fuse_req_t oReq, fuse_ino_t nParent, const char* p0Name, mode_t nMode, struct fuse_file_info* p0FI)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_CREATE, getCallerPid(oReq), nParent, p0Name, nMode, p0FI->flags);
+
+	oLog.log_msg("\nlow:create(parent=%llu, name=\"%s\", mode=0%03o, fi=0x%08x)\n"
+				, static_cast<unsigned long long>(nParent), p0Name, nMode, p0FI);
+
+	const int nFd = ::openat(p0LowFs->getInode(nParent).m_nFd, p0Name
+							, (p0LowFs->getUnderlyingOpenFlags(p0FI->flags) | O_CREAT) & ~O_NOFOLLOW, nMode);
+	if (nFd < 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:create openat"));
+		return; //--------------------------------------------------------------
+	}
+	struct fuse_entry_param oEntry;
+	const int nErrno = p0LowFs->lookupEntry(nParent, p0Name, oEntry);
+	if (nErrno != 0) {
+		::close(nFd);
+		oLog.log_errno("low:create lookup", nErrno);
+		::fuse_reply_err(oReq, nErrno);
+		return; //--------------------------------------------------------------
+	}
+	p0FI->fh = static_cast<uint64_t>(nFd);
+	#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 11)
+	if ((p0FI->flags & O_ACCMODE) == O_RDONLY) {
+		p0FI->noflush = 1;
+	}
+	#endif
+	#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 16)
+	Inode& oInode = p0LowFs->getInode(oEntry.ino);
+	p0LowFs->openPassthrough(oReq, oInode, nFd, p0FI);
+	#endif
+	p0LowFs->addOpenHandle(p0FI->fh, p0LowFs->getMountRelPath(nFd).c_str());
+	oLog.log_fi(p0FI);
+	if (::fuse_reply_create(oReq, &oEntry, p0FI) != 0) {
+		p0LowFs->removeOpenHandle(p0FI->fh);
+		::close(nFd);
+		#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 16)
+		p0LowFs->releasePassthrough(oReq, oInode);
+		#endif
+		p0LowFs->forgetInode(oEntry.ino, 1);
+	}
+}
+
+void LowFs::read(fuse_req_t oReq, fuse_ino_t nIno, size_t nSize, off_t nOffset, struct fuse_file_info* p0FI)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_READ, getCallerPid(oReq), nIno, nullptr, nSize, nOffset);
+
+	oLog.log_msg("\nlow:read(ino=%llu, size=%d, offset=%lld, fi=0x%08x)\n"
+				, static_cast<unsigned long long>(nIno), nSize, nOffset, p0FI);
+
+	#ifdef FSPROPFAKER_WITH_IO_URING
+	if (p0LowFs->m_refIoUring) {
+		unique_ptr<char[]> refBuf(new (std::nothrow) char[nSize]);
+		if (! refBuf) {
+			::fuse_reply_err(oReq, - oLog.log_errno("low:read new", ENOMEM));
+			return; //----------------------------------------------------------
+		}
+		char* p0Buf = refBuf.get();
+		p0LowFs->m_refIoUring->read(static_cast<int>(p0FI->fh), p0Buf, nSize, nOffset
+									, std::make_unique<IoUringReply>(oReq, IoUringReply::REPLY_TYPE_BUF
+																	, oLog, "io_uring read", std::move(refBuf)));
+		return; //--------------------------------------------------------------
+	}
+	#endif
+	// Tell libfuse where the data is, it splices it from the backing
+	// file to the fuse device if possible.
+	struct fuse_bufvec oBufVec = FUSE_BUFVEC_INIT(nSize);
+	oBufVec.buf[0].flags = static_cast<enum fuse_buf_flags>(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
+	oBufVec.buf[0].fd = static_cast<int>(p0FI->fh);
+	oBufVec.buf[0].pos = nOffset;
+
+	::fuse_reply_data(oReq, &oBufVec, FUSE_BUF_SPLICE_MOVE);
+}
+
+void LowFs::write_buf(fuse_req_t oReq, fuse_ino_t nIno, struct fuse_bufvec* p0Buf, off_t nOffset
+					, struct fuse_file_info* p0FI)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+
+	const size_t nSize = ::fuse_buf_size(p0Buf);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_WRITE, getCallerPid(oReq), nIno, nullptr, nSize, nOffset);
+
+	oLog.log_msg("\nlow:write_buf(ino=%llu, buf=0x%08x, size=%d, offset=%lld, fi=0x%08x)\n"
+				, static_cast<unsigned long long>(nIno), p0Buf, nSize, nOffset, p0FI);
+
+	#ifdef FSPROPFAKER_WITH_IO_URING
+	if (p0LowFs->m_refIoUring) {
+		// libfuse reuses the request's buffer (or pipe) once this returns
+		unique_ptr<char[]> refBuf(new (std::nothrow) char[nSize]);
+		if (! refBuf) {
+			::fuse_reply_err(oReq, - oLog.log_errno("low:write_buf new", ENOMEM));
+			return; //----------------------------------------------------------
+		}
+		char* p0Data = refBuf.get();
+		struct fuse_bufvec oMem = FUSE_BUFVEC_INIT(nSize);
+		oMem.buf[0].mem = p0Data;
+		const ssize_t nCopied = ::fuse_buf_copy(&oMem, p0Buf, FUSE_BUF_NO_SPLICE);
+		if (nCopied < 0) {
+			oLog.log_errno("low:write_buf fuse_buf_copy", static_cast<int>(- nCopied));
+			::fuse_reply_err(oReq, static_cast<int>(- nCopied));
+			return; //----------------------------------------------------------
+		}
+		p0LowFs->m_refIoUring->write(static_cast<int>(p0FI->fh), p0Data, static_cast<size_t>(nCopied), nOffset
+									, std::make_unique<IoUringReply>(oReq, IoUringReply::REPLY_TYPE_WRITE
+																	, oLog, "io_uring write", std::move(refBuf)));
+		return; //--------------------------------------------------------------
+	}
+	#endif
+	// If the data is still in the fuse device's pipe it is spliced
+	// directly into the backing file, otherwise it is written from memory.
+	struct fuse_bufvec oDst = FUSE_BUFVEC_INIT(nSize);
+	oDst.buf[0].flags = static_cast<enum fuse_buf_flags>(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
+	oDst.buf[0].fd = static_cast<int>(p0FI->fh);
+	oDst.buf[0].pos = nOffset;
+
+	const ssize_t nRetStat = ::fuse_buf_copy(&oDst, p0Buf, FUSE_BUF_SPLICE_NONBLOCK);
+	oLog.log_retstat("fuse_buf_copy", static_cast<int>(nRetStat));
+	if (nRetStat < 0) {
+		// fuse_buf_copy returns -errno
+		oLog.log_errno("low:write_buf fuse_buf_copy", static_cast<int>(- nRetStat));
+		::fuse_reply_err(oReq, static_cast<int>(- nRetStat));
+		return; //--------------------------------------------------------------
+	}
+	::fuse_reply_write(oReq, static_cast<size_t>(nRetStat));
+}
+
+void LowFs::flush(fuse_req_t oReq, fuse_ino_t nIno, struct fuse_file_info* p0FI)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_FLUSH, getCallerPid(oReq), nIno, nullptr);
+
+	oLog.log_msg("\nlow:flush(ino=%llu, fi=0x%08x)\n", static_cast<unsigned long long>(nIno), p0FI);
+
+	// closing a duplicate reports the errors of delayed writes (ex. NFS)
+	const int nDupFd = ::dup(static_cast<int>(p0FI->fh));
+	if ((nDupFd < 0) || (::close(nDupFd) != 0)) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:flush close"));
+		return; //--------------------------------------------------------------
+	}
+	::fuse_reply_err(oReq, 0);
+}
+
+void LowFs::release(fuse_req_t oReq, fuse_ino_t nIno, struct fuse_file_info* p0FI)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_RELEASE, getCallerPid(oReq), nIno, nullptr);
+
+	oLog.log_msg("\nlow:release(ino=%llu, fi=0x%08x)\n", static_cast<unsigned long long>(nIno), p0FI);
+	oLog.log_fi(p0FI);
+
+	p0LowFs->removeOpenHandle(p0FI->fh);
+	#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 16)
+	p0LowFs->releasePassthrough(oReq, p0LowFs->getInode(nIno));
+	#endif
+	#ifdef FSPROPFAKER_WITH_IO_URING
+	if (p0LowFs->m_refIoUring) {
+		// the last close of a file can block (ex. NFS flushes the data)
+		const int nFd = static_cast<int>(p0FI->fh);
+		p0LowFs->m_refIoUring->close(nFd, std::make_unique<IoUringReply>(oReq, nFd, oLog, "io_uring close"));
+		return; //--------------------------------------------------------------
+	}
+	#endif
+	::close(static_cast<int>(p0FI->fh));
+	::fuse_reply_err(oReq, 0);
+}
+
+void LowFs::fsync(fuse_req_t oReq, fuse_ino_t nIno, int nDataSync, struct fuse_file_info* p0FI)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_FSYNC, getCallerPid(oReq), nIno, nullptr, nDataSync);
+
+	oLog.log_msg("\nlow:fsync(ino=%llu, datasync=%d, fi=0x%08x)\n", static_cast<unsigned long long>(nIno), nDataSync, p0FI);
+
+	const int nFd = static_cast<int>(p0FI->fh);
+	#ifdef FSPROPFAKER_WITH_IO_URING
+	if (p0LowFs->m_refIoUring) {
+		p0LowFs->m_refIoUring->fsync(nFd, (nDataSync != 0)
+									, std::make_unique<IoUringReply>(oReq, IoUringReply::REPLY_TYPE_ERR
+																	, oLog, "io_uring fsync"));
+		return; //--------------------------------------------------------------
+	}
+	#endif
+	const int nRes = ((nDataSync != 0) ? ::fdatasync(nFd) : ::fsync(nFd));
+	if (nRes != 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:fsync fsync"));
+		return; //--------------------------------------------------------------
+	}
+	::fuse_reply_err(oReq, 0);
+}
+
+void LowFs::fallocate(fuse_req_t oReq, fuse_ino_t nIno, int nMode, off_t nOffset, off_t nLength
+					, struct fuse_file_info* p0FI)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_FALLOCATE, getCallerPid(oReq), nIno, nullptr, nMode, nOffset, nLength);
+
+	oLog.log_msg("\nlow:fallocate(ino=%llu, mode=%d, offset=%lld, length=%lld, fi=0x%08x)\n"
+				, static_cast<unsigned long long>(nIno), nMode, nOffset, nLength, p0FI);
+
+	if (::fallocate(static_cast<int>(p0FI->fh), nMode, nOffset, nLength) != 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:fallocate fallocate"));
+		return; //--------------------------------------------------------------
+	}
+	::fuse_reply_err(oReq, 0);
+}
+
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 4)
+void LowFs::copy_file_range(fuse_req_t oReq, fuse_ino_t nInoIn, off_t nOffsetIn, struct fuse_file_info* p0FIIn
+							, fuse_ino_t nInoOut, off_t nOffsetOut, struct fuse_file_info* p0FIOut
+							, size_t nSize, int nFlags)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_COPY_FILE_RANGE, getCallerPid(oReq), nInoIn, nullptr, nOffsetIn, nOffsetOut, nSize);
+	oTrace.setSecond(nInoOut, nullptr);
+
+	oLog.log_msg("\nlow:copy_file_range(ino_in=%llu, offset_in=%lld, ino_out=%llu, offset_out=%lld, size=%d, flags=%d)\n"
+				, static_cast<unsigned long long>(nInoIn), nOffsetIn
+				, static_cast<unsigned long long>(nInoOut), nOffsetOut, nSize, nFlags);
+
+	loff_t nOffIn = nOffsetIn;
+	loff_t nOffOut = nOffsetOut;
+	const ssize_t nRes = ::copy_file_range(static_cast<int>(p0FIIn->fh), &nOffIn
+											, static_cast<int>(p0FIOut->fh), &nOffOut
+											, nSize, static_cast<unsigned int>(nFlags));
+	if (nRes < 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:copy_file_range copy_file_range"));
+		return; //--------------------------------------------------------------
+	}
+	oLog.setTraceResult(nRes);
+	::fuse_reply_write(oReq, static_cast<size_t>(nRes));
+}
+#endif
+
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+void LowFs::lseek(fuse_req_t oReq, fuse_ino_t nIno, off_t nOffset, int nWhence, struct fuse_file_info* p0FI)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_LSEEK, getCallerPid(oReq), nIno, nullptr, nOffset, nWhence);
+
+	oLog.log_msg("\nlow:lseek(ino=%llu, offset=%lld, whence=%d, fi=0x%08x)\n"
+				, static_cast<unsigned long long>(nIno), nOffset, nWhence, p0FI);
+
+	const off_t nRes = ::lseek(static_cast<int>(p0FI->fh), nOffset, nWhence);
+	if (nRes < 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:lseek lseek"));
+		return; //--------------------------------------------------------------
+	}
+	oLog.setTraceResult(nRes);
+	::fuse_reply_lseek(oReq, nRes);
+}
+#endif
+
+void LowFs::statfs(fuse_req_t oReq, fuse_ino_t nIno)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_STATFS, getCallerPid(oReq), nIno, nullptr);
+
+	oLog.log_msg("\nlow:statfs(ino=%llu)\n", static_cast<unsigned long long>(nIno));
+
+	struct ::statvfs oStatFs;
+	const int nRetStat = p0LowFs->getFakeStatVFS(oStatFs);
+	oLog.setTraceResult(nRetStat);
+	if (nRetStat != 0) {
+		::fuse_reply_err(oReq, - nRetStat);
+		return; //--------------------------------------------------------------
+	}
+	::fuse_reply_statfs(oReq, &oStatFs);
+}
+
+void LowFs::setxattr(fuse_req_t oReq, fuse_ino_t nIno, const char* p0Name, const char* p0Value
+					, size_t nSize, int nFlags)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_SETXATTR, getCallerPid(oReq), nIno, nullptr, nSize, nFlags);
+	oTrace.setSecond(0, p0Name);
+
+	oLog.log_msg("\nlow:setxattr(ino=%llu, name=\"%s\", value=\"%s\", size=%d, flags=0x%08x)\n"
+				, static_cast<unsigned long long>(nIno), p0Name, p0Value, nSize, nFlags);
+
+	const std::string sProcPath = getProcPath(p0LowFs->getInode(nIno).m_nFd);
+	if (::setxattr(sProcPath.c_str(), p0Name, p0Value, nSize, nFlags) != 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:setxattr setxattr"));
+		return; //--------------------------------------------------------------
+	}
+	::fuse_reply_err(oReq, 0);
+}
+
+void LowFs::getxattr(fuse_req_t oReq, fuse_ino_t nIno, const char* p0Name, size_t nSize)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_GETXATTR, getCallerPid(oReq), nIno, nullptr, nSize);
+	oTrace.setSecond(0, p0Name);
+
+	oLog.log_msg("\nlow:getxattr(ino=%llu, name=\"%s\", size=%d)\n", static_cast<unsigned long long>(nIno), p0Name, nSize);
+
+	const std::string sProcPath = getProcPath(p0LowFs->getInode(nIno).m_nFd);
+	std::vector<char> aValue(nSize);
+	const ssize_t nRes = ::getxattr(sProcPath.c_str(), p0Name, aValue.data(), nSize);
+	if (nRes < 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:getxattr getxattr"));
+		return; //--------------------------------------------------------------
+	}
+	oLog.setTraceResult(nRes);
+	if (nSize == 0) {
+		::fuse_reply_xattr(oReq, static_cast<size_t>(nRes));
+	} else {
+		::fuse_reply_buf(oReq, aValue.data(), static_cast<size_t>(nRes));
+	}
+}
+
+void LowFs::listxattr(fuse_req_t oReq, fuse_ino_t nIno, size_t nSize)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_LISTXATTR, getCallerPid(oReq), nIno, nullptr, nSize);
+
+	oLog.log_msg("\nlow:listxattr(ino=%llu, size=%d)\n", static_cast<unsigned long long>(nIno), nSize);
+
+	const std::string sProcPath = getProcPath(p0LowFs->getInode(nIno).m_nFd);
+	std::vector<char> aList(nSize);
+	const ssize_t nRes = ::listxattr(sProcPath.c_str(), aList.data(), nSize);
+	if (nRes < 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:listxattr listxattr"));
+		return; //--------------------------------------------------------------
+	}
+	oLog.setTraceResult(nRes);
+	if (nSize == 0) {
+		::fuse_reply_xattr(oReq, static_cast<size_t>(nRes));
+	} else {
+		::fuse_reply_buf(oReq, aList.data(), static_cast<size_t>(nRes));
+	}
+}
+
+void LowFs::removexattr(fuse_req_t oReq, fuse_ino_t nIno, const char* p0Name)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_REMOVEXATTR, getCallerPid(oReq), nIno, nullptr);
+	oTrace.setSecond(0, p0Name);
+
+	oLog.log_msg("\nlow:removexattr(ino=%llu, name=\"%s\")\n", static_cast<unsigned long long>(nIno), p0Name);
+
+	const std::string sProcPath = getProcPath(p0LowFs->getInode(nIno).m_nFd);
+	if (::removexattr(sProcPath.c_str(), p0Name) != 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:removexattr removexattr"));
+		return; //--------------------------------------------------------------
+	}
+	::fuse_reply_err(oReq, 0);
+}
+
+void LowFs::opendir(fuse_req_t oReq, fuse_ino_t nIno, struct fuse_file_info* p0FI)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_OPENDIR, getCallerPid(oReq), nIno, nullptr);
+
+	oLog.log_msg("\nlow:opendir(ino=%llu, fi=0x%08x)\n", static_cast<unsigned long long>(nIno), p0FI);
+
+	const int nFd = ::openat(p0LowFs->getInode(nIno).m_nFd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (nFd < 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:opendir openat"));
+		return; //--------------------------------------------------------------
+	}
+	DIR* p0DirStream = ::fdopendir(nFd);
+	if (p0DirStream == nullptr) {
+		const int nRetStat = oLog.log_error("low:opendir fdopendir");
+		::close(nFd);
+		::fuse_reply_err(oReq, - nRetStat);
+		return; //--------------------------------------------------------------
+	}
+	auto p0DirHandle = new (std::nothrow) DirHandle();
+	if (p0DirHandle == nullptr) {
+		::closedir(p0DirStream);
+		oLog.log_errno("low:opendir new", ENOMEM);
+		::fuse_reply_err(oReq, ENOMEM);
+		return; //--------------------------------------------------------------
+	}
+	p0DirHandle->m_p0DirStream = p0DirStream;
+
+	p0FI->fh = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(p0DirHandle));
+	p0LowFs->addOpenHandle(p0FI->fh, p0LowFs->getMountRelPath(nFd).c_str());
+	oLog.log_fi(p0FI);
+	if (::fuse_reply_open(oReq, p0FI) != 0) {
+		p0LowFs->removeOpenHandle(p0FI->fh);
+		::closedir(p0DirStream);
+		delete p0DirHandle;
+	}
+}
+
+void LowFs::readDir(fuse_req_t oReq, fuse_ino_t nIno, size_t nSize, off_t nOffset, struct fuse_file_info* p0FI, bool bPlus) noexcept
+{
+	auto& oLog = *m_refLogger;
+
+	DirHandle* p0DirHandle = reinterpret_cast<DirHandle*>(static_cast<uintptr_t>(p0FI->fh));
+	DIR* p0DirStream = p0DirHandle->m_p0DirStream;
+
+	// The kernel passes the offset of the last entry it received (0 at the
+	// start). If it isn't where the previous call stopped (rewinddir, seekdir
+	// or a retry) the stream is repositioned and the pending entry dropped.
+	if (nOffset != p0DirHandle->m_nOffset) {
+		::seekdir(p0DirStream, nOffset);
+		p0DirHandle->m_p0PendingEntry = nullptr;
+		p0DirHandle->m_nOffset = nOffset;
+	}
+
+	#if FUSE_USE_VERSION < 35
+	// no readdirplus in libfuse 2
+	assert(! bPlus);
+	(void)bPlus;
+	(void)nIno;
+	#endif
+	std::vector<char> aBuf(nSize);
+	size_t nUsed = 0;
+	// Entries are added with the offset of the following entry until
+	// the buffer is full. The entry that didn't fit is kept for the next call.
+	while (true) {
+		struct dirent* p0DirEntry = p0DirHandle->m_p0PendingEntry;
+		if (p0DirEntry == nullptr) {
+			errno = 0;
+			p0DirEntry = ::readdir(p0DirStream);
+			if (p0DirEntry == nullptr) {
+				if (errno != 0) {
+					const int nRetStat = oLog.log_error("low:readdir readdir");
+					if (nUsed == 0) {
+						::fuse_reply_err(oReq, - nRetStat);
+						return; //----------------------------------------------
+					}
+				}
+				break;
+			}
+		}
+		const off_t nNextOffset = ::telldir(p0DirStream);
+		const char* p0Name = p0DirEntry->d_name;
+		size_t nEntrySize;
+		#if FUSE_USE_VERSION < 35
+		{
+		#else
+		if (bPlus) {
+			// The kernel adds the returned nodes to its cache as if looked up,
+			// except the dot entries, which are only passed by inode and type.
+			struct fuse_entry_param oEntry;
+			std::memset(&oEntry, 0, sizeof(oEntry));
+			const bool bDots = ((::strcmp(p0Name, ".") == 0) || (::strcmp(p0Name, "..") == 0));
+			if (bDots) {
+				oEntry.attr.st_ino = p0DirEntry->d_ino;
+				oEntry.attr.st_mode = DTTOIF(p0DirEntry->d_type);
+			} else {
+				const int nErrno = lookupEntry(nIno, p0Name, oEntry);
+				if (nErrno != 0) {
+					// removed meanwhile
+					p0DirHandle->m_p0PendingEntry = nullptr;
+					p0DirHandle->m_nOffset = nNextOffset;
+					continue; // while ----
+				}
+			}
+			nEntrySize = ::fuse_add_direntry_plus(oReq, aBuf.data() + nUsed, nSize - nUsed, p0Name, &oEntry, nNextOffset);
+			if ((nEntrySize > nSize - nUsed) && ! bDots) {
+				forgetInode(oEntry.ino, 1);
+			}
+		} else {
+		#endif
+			struct ::stat oStat;
+			std::memset(&oStat, 0, sizeof(oStat));
+			oStat.st_ino = p0DirEntry->d_ino;
+			oStat.st_mode = DTTOIF(p0DirEntry->d_type);
+			nEntrySize = ::fuse_add_direntry(oReq, aBuf.data() + nUsed, nSize - nUsed, p0Name, &oStat, nNextOffset);
+		}
+		if (nEntrySize > nSize - nUsed) {
+			// buffer full, the entry will be the first of the next call
+			p0DirHandle->m_p0PendingEntry = p0DirEntry;
+			break;
+		}
+		nUsed += nEntrySize;
+		p0DirHandle->m_p0PendingEntry = nullptr;
+		p0DirHandle->m_nOffset = nNextOffset;
+	}
+
+	::fuse_reply_buf(oReq, aBuf.data(), nUsed);
+}
+
+void LowFs::readdir(fuse_req_t oReq, fuse_ino_t nIno, size_t nSize, off_t nOffset, struct fuse_file_info* p0FI)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_READDIR, getCallerPid(oReq), nIno, nullptr, nSize, nOffset);
+
+	oLog.log_msg("\nlow:readdir(ino=%llu, size=%d, offset=%lld, fi=0x%08x)\n"
+				, static_cast<unsigned long long>(nIno), nSize, nOffset, p0FI);
+
+	p0LowFs->readDir(oReq, nIno, nSize, nOffset, p0FI, false);
+}
+
+#if FUSE_USE_VERSION < 35
+#else
+void LowFs::readdirplus(fuse_req_t oReq, fuse_ino_t nIno, size_t nSize, off_t nOffset, struct fuse_file_info* p0FI)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_READDIR, getCallerPid(oReq), nIno, nullptr, nSize, nOffset);
+
+	oLog.log_msg("\nlow:readdirplus(ino=%llu, size=%d, offset=%lld, fi=0x%08x)\n"
+				, static_cast<unsigned long long>(nIno), nSize, nOffset, p0FI);
+
+	p0LowFs->readDir(oReq, nIno, nSize, nOffset, p0FI, true);
+}
+#endif
+
+void LowFs::releasedir(fuse_req_t oReq, fuse_ino_t nIno, struct fuse_file_info* p0FI)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_RELEASEDIR, getCallerPid(oReq), nIno, nullptr);
+
+	oLog.log_msg("\nlow:releasedir(ino=%llu, fi=0x%08x)\n", static_cast<unsigned long long>(nIno), p0FI);
+	oLog.log_fi(p0FI);
+
+	p0LowFs->removeOpenHandle(p0FI->fh);
+	DirHandle* p0DirHandle = reinterpret_cast<DirHandle*>(static_cast<uintptr_t>(p0FI->fh));
+	::closedir(p0DirHandle->m_p0DirStream);
+	delete p0DirHandle;
+	::fuse_reply_err(oReq, 0);
+}
+
+void LowFs::fsyncdir(fuse_req_t oReq, fuse_ino_t nIno, int nDataSync, struct fuse_file_info* p0FI)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_FSYNCDIR, getCallerPid(oReq), nIno, nullptr, nDataSync);
+
+	oLog.log_msg("\nlow:fsyncdir(ino=%llu, datasync=%d, fi=0x%08x)\n", static_cast<unsigned long long>(nIno), nDataSync, p0FI);
+
+	DirHandle* p0DirHandle = reinterpret_cast<DirHandle*>(static_cast<uintptr_t>(p0FI->fh));
+	const int nFd = ::dirfd(p0DirHandle->m_p0DirStream);
+	const int nRes = ((nDataSync != 0) ? ::fdatasync(nFd) : ::fsync(nFd));
+	if (nRes != 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:fsyncdir fsync"));
+		return; //--------------------------------------------------------------
+	}
+	::fuse_reply_err(oReq, 0);
+}
+
+void LowFs::access(fuse_req_t oReq, fuse_ino_t nIno, int nMask)
+{
+	LowFs* p0LowFs = LowFs::this_(oReq);
+	auto& oLog = *(p0LowFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_ACCESS, getCallerPid(oReq), nIno, nullptr, nMask);
+
+	oLog.log_msg("\nlow:access(ino=%llu, mask=0%o)\n", static_cast<unsigned long long>(nIno), nMask);
+
+	const std::string sProcPath = getProcPath(p0LowFs->getInode(nIno).m_nFd);
+	if (::access(sProcPath.c_str(), nMask) != 0) {
+		::fuse_reply_err(oReq, - oLog.log_error("low:access access"));
+		return; //--------------------------------------------------------------
+	}
+	::fuse_reply_err(oReq, 0);
+}
+
+} // namespace fspf
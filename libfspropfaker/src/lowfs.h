@@ -0,0 +1,226 @@
+/*
+ * Copyright © 2020  Stefano Marsili, <stemars@gmx.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+/*
+ * File:   lowfs.h
+ */
+
+#ifndef FSPF_LOW_FS_H
+#define FSPF_LOW_FS_H
+
+#include "fakefs.h"
+#include "iouring.h"
+
+#include "fusepp/Fuse.h"
+
+#include <fuse_lowlevel.h>
+
+#include <memory>
+#include <string>
+#include <functional>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+
+#include <stdint.h>
+#include <dirent.h>
+#include <sys/types.h>
+
+namespace fspf
+{
+
+using std::unique_ptr;
+using std::shared_ptr;
+using std::weak_ptr;
+
+class FsPropFaker;
+class FsDispatcher;
+
+/** File system property faker on the low level (inode based) fuse API.
+ * The kernel's node ids are the addresses of the entries of an inode
+ * table, each holding a descriptor of the underlying file opened with
+ * O_PATH. Requests are therefore served relative to the descriptor of
+ * the node, libfuse doesn't have to keep track of the paths.
+ */
+class LowFs : public FakeFs
+{
+public:
+	// returns object and empty string or null and error string
+	static std::pair<shared_ptr<LowFs>, std::string> createInstance(FsPropFaker* p0FsPropFaker
+																	, std::function<void()>&& oCallback) noexcept;
+	~LowFs() noexcept;
+
+	std::string mount(int nArgC, char** aArgV) noexcept override;
+	int loop() noexcept override;
+	void teardown() noexcept override;
+	std::string dispatch(FsDispatcher& oDispatcher, std::function<void()>&& oOnEnd) noexcept override;
+	void exitSession() noexcept override;
+
+protected:
+	LowFs(FsPropFaker* p0FsPropFaker, std::function<void()>&& oCallback) noexcept;
+	std::string initInstance() noexcept;
+private:
+	// a file or folder known to the kernel
+	struct Inode
+	{
+		int m_nFd = -1; // opened with O_PATH
+		ino_t m_nIno = 0;
+		dev_t m_nDev = 0;
+		uint64_t m_nLookups = 0; // how many times the kernel was told about it, protected by m_oInodesMutex
+		std::atomic<int64_t> m_nOpenMTimeNs{-1}; // the modification time at the last open, used by auto cache
+		std::mutex m_oBackingMutex;
+		int32_t m_nBackingOpens = 0; // the open handles if passthrough is enabled, protected by m_oBackingMutex
+		int m_nBackingId = 0; // if not 0 the kernel reads and writes the file directly, protected by m_oBackingMutex
+	};
+	struct InodeKey
+	{
+		ino_t m_nIno;
+		dev_t m_nDev;
+		bool operator==(const InodeKey& oOther) const noexcept
+		{
+			return (m_nIno == oOther.m_nIno) && (m_nDev == oOther.m_nDev);
+		}
+	};
+	struct InodeKeyHash
+	{
+		size_t operator()(const InodeKey& oKey) const noexcept
+		{
+			return std::hash<uint64_t>()(static_cast<uint64_t>(oKey.m_nIno) ^ (static_cast<uint64_t>(oKey.m_nDev) << 32));
+		}
+	};
+	// the state of an open directory, stored in fuse_file_info::fh
+	struct DirHandle
+	{
+		DIR* m_p0DirStream = nullptr;
+		struct dirent* m_p0PendingEntry = nullptr; // read but not yet accepted by the reply buffer
+		off_t m_nOffset = 0; // the offset of the next entry, as returned by telldir
+	};
+private:
+	static const struct fuse_lowlevel_ops* getOperations() noexcept;
+	static LowFs* this_(fuse_req_t oReq) noexcept;
+
+	Inode& getInode(fuse_ino_t nIno) noexcept;
+	// looks up the name within the folder and increments the lookup count of the found node
+	// returns 0 if successful, the errno otherwise
+	int lookupEntry(fuse_ino_t nParent, const char* p0Name, struct fuse_entry_param& oEntry) noexcept;
+	void forgetInode(fuse_ino_t nIno, uint64_t nLookups) noexcept;
+	// the path within the mount of an open file descriptor
+	std::string getMountRelPath(int nFd) const noexcept;
+	void replyEntry(fuse_req_t oReq, fuse_ino_t nParent, const char* p0Name) noexcept;
+	void readDir(fuse_req_t oReq, fuse_ino_t nIno, size_t nSize, off_t nOffset, struct fuse_file_info* p0FI, bool bPlus) noexcept;
+	#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 16)
+	// registers the opened file with the kernel so that it reads and writes it directly
+	void openPassthrough(fuse_req_t oReq, Inode& oInode, int nFd, struct fuse_file_info* p0FI) noexcept;
+	// unregisters the file when the last handle of the node is released
+	void releasePassthrough(fuse_req_t oReq, Inode& oInode) noexcept;
+	#endif
+
+	static void init(void* p0Userdata, struct fuse_conn_info* p0Conn);
+	static void destroy(void* p0Userdata);
+	static void lookup(fuse_req_t oReq, fuse_ino_t nParent, const char* p0Name);
+	#if FUSE_USE_VERSION < 35
+	static void forget(fuse_req_t oReq, fuse_ino_t nIno, unsigned long nLookups);
+	#else
+	static void forget(fuse_req_t oReq, fuse_ino_t nIno, uint64_t nLookups);
+	#endif
+	static void forget_multi(fuse_req_t oReq, size_t nCount, struct fuse_forget_data* p0Forgets);
+	static void getattr(fuse_req_t oReq, fuse_ino_t nIno, struct fuse_file_info* p0FI);
+	static void setattr(fuse_req_t oReq, fuse_ino_t nIno, struct ::stat* p0Attr, int nToSet, struct fuse_file_info* p0FI);
+	static void readlink(fuse_req_t oReq, fuse_ino_t nIno);
+	static void mknod(fuse_req_t oReq, fuse_ino_t nParent, const char* p0Name, mode_t nMode, dev_t nDev);
+	static void mkdir(fuse_req_t oReq, fuse_ino_t nParent, const char* p0Name, mode_t nMode);
+	static void unlink(fuse_req_t oReq, fuse_ino_t nParent, const char* p0Name);
+	static void rmdir(fuse_req_t oReq, fuse_ino_t nParent, const char* p0Name);
+	static void symlink(fuse_req_t oReq, const char* p0Link, fuse_ino_t nParent, const char* p0Name);
+	#if FUSE_USE_VERSION < 35
+	static void rename(fuse_req_t oReq, fuse_ino_t nParent, const char* p0Name
+						, fuse_ino_t nNewParent, const char* p0NewName);
+	#else
+	static void rename(fuse_req_t oReq, fuse_ino_t nParent, const char* p0Name
+						, fuse_ino_t nNewParent, const char* p0NewName, unsigned int nFlags);
+	#endif
+	static void link(fuse_req_t oReq, fuse_ino_t nIno, fuse_ino_t nNewParent, const char* p0NewName);
+	static void open(fuse_req_t oReq, fuse_ino_t nIno, struct fuse_file_info* p0FI);
+	static void create(fuse_req_t oReq, fuse_ino_t nParent, const char* p0Name, mode_t nMode, struct fuse_file_info* p0FI);
+	static void read(fuse_req_t oReq, fuse_ino_t nIno, size_t nSize, off_t nOffset, struct fuse_file_info* p0FI);
+	static void write_buf(fuse_req_t oReq, fuse_ino_t nIno, struct fuse_bufvec* p0Buf, off_t nOffset
+						, struct fuse_file_info* p0FI);
+	static void flush(fuse_req_t oReq, fuse_ino_t nIno, struct fuse_file_info* p0FI);
+	static void release(fuse_req_t oReq, fuse_ino_t nIno, struct fuse_file_info* p0FI);
+	static void fsync(fuse_req_t oReq, fuse_ino_t nIno, int nDataSync, struct fuse_file_info* p0FI);
+	static void fallocate(fuse_req_t oReq, fuse_ino_t nIno, int nMode, off_t nOffset, off_t nLength
+						, struct fuse_file_info* p0FI);
+	#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 4)
+	static void copy_file_range(fuse_req_t oReq, fuse_ino_t nInoIn, off_t nOffsetIn, struct fuse_file_info* p0FIIn
+								, fuse_ino_t nInoOut, off_t nOffsetOut, struct fuse_file_info* p0FIOut
+								, size_t nSize, int nFlags);
+	#endif
+	#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+	static void lseek(fuse_req_t oReq, fuse_ino_t nIno, off_t nOffset, int nWhence, struct fuse_file_info* p0FI);
+	#endif
+	static void statfs(fuse_req_t oReq, fuse_ino_t nIno);
+	static void setxattr(fuse_req_t oReq, fuse_ino_t nIno, const char* p0Name, const char* p0Value
+						, size_t nSize, int nFlags);
+	static void getxattr(fuse_req_t oReq, fuse_ino_t nIno, const char* p0Name, size_t nSize);
+	static void listxattr(fuse_req_t oReq, fuse_ino_t nIno, size_t nSize);
+	static void removexattr(fuse_req_t oReq, fuse_ino_t nIno, const char* p0Name);
+	static void opendir(fuse_req_t oReq, fuse_ino_t nIno, struct fuse_file_info* p0FI);
+	static void readdir(fuse_req_t oReq, fuse_ino_t nIno, size_t nSize, off_t nOffset, struct fuse_file_info* p0FI);
+	#if FUSE_USE_VERSION < 35
+	#else
+	static void readdirplus(fuse_req_t oReq, fuse_ino_t nIno, size_t nSize, off_t nOffset, struct fuse_file_info* p0FI);
+	#endif
+	static void releasedir(fuse_req_t oReq, fuse_ino_t nIno, struct fuse_file_info* p0FI);
+	static void fsyncdir(fuse_req_t oReq, fuse_ino_t nIno, int nDataSync, struct fuse_file_info* p0FI);
+	static void access(fuse_req_t oReq, fuse_ino_t nIno, int nMask);
+private:
+	// the root folder, its fd is owned by m_p0FsPropFaker
+	Inode m_oRoot;
+	// Key: the underlying inode, Value: the node, whose address is the fuse_ino_t.
+	std::mutex m_oInodesMutex;
+	std::unordered_map<InodeKey, unique_ptr<Inode>, InodeKeyHash> m_oInodes;
+
+	double m_fEntryTimeout;
+	double m_fAttrTimeout;
+	double m_fNegativeTimeout;
+
+	#ifdef FSPROPFAKER_WITH_IO_URING
+	// if not null reads, writes, syncs and closes are asynchronous
+	unique_ptr<IoUring> m_refIoUring;
+	#endif
+	#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 16)
+	bool m_bPassthrough = false; // set by init if requested and supported by the kernel
+	std::atomic<bool> m_bPassthroughDenied{false}; // the kernel refused it for lack of privileges
+	#endif
+
+	struct fuse_session* m_p0Session = nullptr;
+	#if FUSE_USE_VERSION < 35
+	char* m_p0MountPoint = nullptr; // allocated by libfuse
+	struct fuse_chan* m_p0Chan = nullptr;
+	#else
+	struct fuse_conn_info_opts* m_p0ConnInfoOpts = nullptr; // allocated by libfuse
+	#endif
+	std::mutex m_oSessionMutex; // protects m_p0Session from being destroyed while exitSession() uses it
+
+private:
+	LowFs() = delete;
+	LowFs(const LowFs& oSource) = delete;
+	LowFs& operator=(const LowFs& oSource) = delete;
+};
+
+} // namespace fspf
+
+#endif /* FSPF_LOW_FS_H */
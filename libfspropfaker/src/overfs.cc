@@ -28,18 +28,24 @@
 #include "overfs.h"
 
 #include "fspropfaker.h"
-#include "fsutil.h"
+#include "fuseloop.h"
+#include "fsdispatcher.h"
 
 #include <iostream>
 #include <cassert>
 #include <memory>
 #include <string>
 #include <cstdlib>
+#include <cstring>
+#include <chrono>
 
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <sys/xattr.h>
 
 
@@ -50,11 +56,21 @@ using std::weak_ptr;
 namespace fspf
 {
 
-static std::string getFullPath(const char* p0Path) noexcept
+// Fuse paths are absolute (the mount point being the root), the *at() functions
+// need them relative to the root folder's file descriptor.
+static inline const char* getRelPath(const char* p0Path) noexcept
 {
-	OverFs* p0OverFs = OverFs::this_();
-	FsPropFaker* p0FsPropFaker = p0OverFs->getFsPropFaker();
-	return p0FsPropFaker->getRootPath() + p0Path;
+	assert(p0Path[0] == '/');
+	return ((p0Path[1] == '\0') ? "." : p0Path + 1);
+}
+// the process that made the current request, only used by the trace
+static inline pid_t getCallerPid() noexcept
+{
+	#ifdef FSPROPFAKER_WITHOUT_LOGGING
+	return 0;
+	#else
+	return ::fuse_get_context()->pid;
+	#endif
 }
 
 std::pair<shared_ptr<OverFs>, std::string> OverFs::createInstance(FsPropFaker* p0FsPropFaker
@@ -71,129 +87,193 @@ std::pair<shared_ptr<OverFs>, std::string> OverFs::createInstance(FsPropFaker* p
 
 OverFs::OverFs(FsPropFaker* p0FsPropFaker, std::function<void()>&& oCallback) noexcept
 : Fusepp::Fuse<OverFs>()
-, m_p0FsPropFaker(p0FsPropFaker)
-, m_sMountName(p0FsPropFaker->getMountName())
-, m_sRootPath(p0FsPropFaker->getRootPath())
-, m_sLogFilePath(p0FsPropFaker->getLogFilePath())
-, m_nBlockSize(p0FsPropFaker->getBlockSize())
-, m_oCallback(std::move(oCallback))
+, FakeFs(p0FsPropFaker, std::move(oCallback))
 {
+	#if FUSE_USE_VERSION < 35
+	// otherwise libfuse 2 drops the requests that only set one of the times
+	static std::once_flag s_oFlagsSet;
+	std::call_once(s_oFlagsSet, [&]() { Operations()->flag_utime_omit_ok = 1; });
+	#endif
 }
-std::string OverFs::initInstance() noexcept
+
+std::string OverFs::mount(int nArgC, char** aArgV) noexcept
 {
-	auto oPair = FsLogger::create(m_sMountName, m_sLogFilePath);
-	if (! oPair.second.empty()) {
-		return oPair.second;
+	assert(m_p0Fuse == nullptr);
+	struct fuse_args oArgs = FUSE_ARGS_INIT(nArgC, aArgV);
+	#if FUSE_USE_VERSION < 35
+	int nMultiThreaded;
+	int nForeground;
+	if (::fuse_parse_cmdline(&oArgs, &m_p0MountPoint, &nMultiThreaded, &nForeground) == -1) {
+		::fuse_opt_free_args(&oArgs);
+		return "Could not parse fuse arguments"; //---------------------------------
+	}
+	const std::string sMountPoint = m_p0MountPoint;
+	m_p0Chan = ::fuse_mount(m_p0MountPoint, &oArgs);
+	if (m_p0Chan == nullptr) {
+		::fuse_opt_free_args(&oArgs);
+		::free(m_p0MountPoint);
+		m_p0MountPoint = nullptr;
+		return "Could not mount " + sMountPoint; //---------------------------------
+	}
+	m_p0Fuse = ::fuse_new(m_p0Chan, &oArgs, Operations(), sizeof(struct fuse_operations), this);
+	::fuse_opt_free_args(&oArgs);
+	if (m_p0Fuse == nullptr) {
+		::fuse_unmount(m_p0MountPoint, m_p0Chan);
+		m_p0Chan = nullptr;
+		::free(m_p0MountPoint);
+		m_p0MountPoint = nullptr;
+		return "Could not create fuse instance"; //---------------------------------
+	}
+	#else
+	struct fuse_cmdline_opts oOpts;
+	if (::fuse_parse_cmdline(&oArgs, &oOpts) != 0) {
+		::fuse_opt_free_args(&oArgs);
+		return "Could not parse fuse arguments"; //---------------------------------
+	}
+	m_p0MountPoint = oOpts.mountpoint;
+	const std::string sMountPoint = m_p0MountPoint;
+	m_p0Fuse = ::fuse_new(&oArgs, Operations(), sizeof(struct fuse_operations), this);
+	::fuse_opt_free_args(&oArgs);
+	if (m_p0Fuse == nullptr) {
+		::free(m_p0MountPoint);
+		m_p0MountPoint = nullptr;
+		return "Could not create fuse instance"; //---------------------------------
+	}
+	if (::fuse_mount(m_p0Fuse, m_p0MountPoint) != 0) {
+		::fuse_destroy(m_p0Fuse);
+		m_p0Fuse = nullptr;
+		::free(m_p0MountPoint);
+		m_p0MountPoint = nullptr;
+		return "Could not mount " + sMountPoint; //---------------------------------
 	}
-	m_refLogger = std::move(oPair.first);
+	#endif
 	return "";
 }
 
-FsPropFaker* OverFs::getFsPropFaker() const noexcept
-{
-	return m_p0FsPropFaker;
-}
-FsLogger* OverFs::getFsLogger() const noexcept
-{
-	return m_refLogger.get();
-}
-
-std::string OverFs::getStatVFS(struct ::statvfs& oStatFs) noexcept
-{
-	const std::string sFullPath{getFullPath(m_sRootPath.c_str())};
-
-	return fspf::getStatVFS(sFullPath, oStatFs);
-}
-
-int64_t OverFs::getRealDiskSizeInBlocks() noexcept
+int OverFs::loop() noexcept
 {
-	struct ::statvfs oStatFs;
-	const std::string sErr = getStatVFS(oStatFs);
-	if (! sErr.empty()) {
-		int64_t nRet;
-		{
-			std::lock_guard<std::mutex> oLock(m_oFsMutex);
-			nRet = m_nRealDiskSizeInBlocks;
-		}
-		return nRet; //---------------------------------------------------------
+	assert(m_p0Fuse != nullptr);
+	const FsPropFaker::Options& oOptions = m_p0FsPropFaker->getOptions();
+	if (oOptions.m_bSingleThreaded) {
+		return ::fuse_loop(m_p0Fuse); //--------------------------------------------
 	}
-
-	const int64_t nFsSizeInFragments = static_cast<int64_t>(oStatFs.f_blocks);
-	//int64_t nFreeFragments = static_cast<int64_t>(oStatFs.f_bavail);
-
-	{
-		std::lock_guard<std::mutex> oLock(m_oFsMutex);
-		m_nRealDiskSizeInBlocks = nFsSizeInFragments;
+	if (oOptions.m_nWorkerThreads > 0) {
+		return fuseLoopFixedThreads(::fuse_get_session(m_p0Fuse), oOptions.m_nWorkerThreads
+									, [&]() { unmountLazily(); }); //-----------
 	}
-	return nFsSizeInFragments;
+	#if FUSE_USE_VERSION < 35
+	return ::fuse_loop_mt(m_p0Fuse);
+	#else
+	struct fuse_loop_config oConfig;
+	oConfig.clone_fd = (oOptions.m_bCloneFd ? 1 : 0);
+	oConfig.max_idle_threads = ((oOptions.m_nMaxIdleThreads >= 0) ? oOptions.m_nMaxIdleThreads : 10);
+	return ::fuse_loop_mt(m_p0Fuse, &oConfig);
+	#endif
 }
-int64_t OverFs::getRealFreeSizeInBlocks() noexcept
+
+std::string OverFs::dispatch(FsDispatcher& oDispatcher, std::function<void()>&& oOnEnd) noexcept
 {
-	struct ::statvfs oStatFs;
-	const std::string sErr = getStatVFS(oStatFs);
-	if (! sErr.empty()) {
-		int64_t nRet;
-		{
-			std::lock_guard<std::mutex> oLock(m_oFsMutex);
-			nRet = m_nRealFreeSizeInBlocks;
-		}
-		return nRet; //---------------------------------------------------------
-	}
-	//const int64_t nFsSizeInFragments = static_cast<int64_t>(oStatFs.f_blocks);
-	const int64_t nFreeFragments = static_cast<int64_t>(oStatFs.f_bavail);
+	assert(m_p0Fuse != nullptr);
+	#if FUSE_USE_VERSION < 35
+	struct fuse_chan* p0Chan = m_p0Chan;
+	#else
+	struct fuse_chan* p0Chan = nullptr;
+	#endif
+	return oDispatcher.addSession(::fuse_get_session(m_p0Fuse), p0Chan, [this, oOnEnd]()
 	{
-		std::lock_guard<std::mutex> oLock(m_oFsMutex);
-		m_nRealFreeSizeInBlocks = nFreeFragments;
-	}
-	return nFreeFragments;
+		teardown();
+		oOnEnd();
+	});
 }
 
-void OverFs::setFakeDiskSizeInBlocks(int64_t nSizeBlocks) noexcept
+void OverFs::teardown() noexcept
 {
-	{
-		std::lock_guard<std::mutex> oLock(m_oFsMutex);
-		m_bUseFakeFixedDiskSize = true;
-		m_nFakeDiskSizeInBlocks = nSizeBlocks;
+	if (m_p0Fuse == nullptr) {
+		return; //--------------------------------------------------------------
 	}
-}
-void OverFs::setFakeDiskSizeDiffInBlocks(int64_t nSizeBlocks) noexcept
-{
+	if (! m_bUnmounted.exchange(true)) {
+		#if FUSE_USE_VERSION < 35
+		::fuse_unmount(m_p0MountPoint, m_p0Chan);
+		#else
+		::fuse_unmount(m_p0Fuse);
+		#endif
+	}
+	#if FUSE_USE_VERSION < 35
+	m_p0Chan = nullptr;
+	#endif
 	{
-		std::lock_guard<std::mutex> oLock(m_oFsMutex);
-		m_bUseFakeFixedDiskSize = false;
-		m_nFakeDiskSizeInBlocks = nSizeBlocks;
+		std::lock_guard<std::mutex> oLock(m_oSessionMutex);
+		::fuse_destroy(m_p0Fuse);
+		m_p0Fuse = nullptr;
 	}
+	::free(m_p0MountPoint);
+	m_p0MountPoint = nullptr;
 }
-void OverFs::setFakeFreeSizeInBlocks(int64_t nSizeBlocks) noexcept
+
+void OverFs::exitSession() noexcept
 {
 	{
-		std::lock_guard<std::mutex> oLock(m_oFsMutex);
-		m_bUseFakeFixedFreeSize = true;
-		m_nFakeFreeSizeInBlocks = nSizeBlocks;
+		std::lock_guard<std::mutex> oLock(m_oSessionMutex);
+		if (m_p0Fuse != nullptr) {
+			::fuse_exit(m_p0Fuse);
+		}
 	}
+	// without open files the kernel then ends the connection,
+	// which wakes up the threads reading the fuse device
+	unmountLazily();
 }
-void OverFs::setFakeFreeSizeDiffInBlocks(int64_t nSizeBlocks) noexcept
+
+std::string OverFs::getFullPath(const char* p0Path) const noexcept
 {
-	{
-		std::lock_guard<std::mutex> oLock(m_oFsMutex);
-		m_bUseFakeFixedFreeSize = false;
-		m_nFakeFreeSizeInBlocks = nSizeBlocks;
-	}
+	return m_sRootPath + p0Path;
 }
 
 
 void* OverFs::init(struct fuse_conn_info * p0Conn
 					#if FUSE_USE_VERSION < 35
 					#else
-					, struct fuse_config *
+					, struct fuse_config * p0Config
 					#endif
 					)
 {
 	OverFs* p0OverFs = OverFs::this_();
 
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_INIT, getCallerPid(), nullptr);
 	oLog.log_msg("\nover:init()\n");
 
+	// let libfuse splice the data returned by read_buf to the fuse device
+	if ((p0Conn->capable & FUSE_CAP_SPLICE_WRITE) != 0) {
+		p0Conn->want |= FUSE_CAP_SPLICE_WRITE;
+	}
+	if ((p0Conn->capable & FUSE_CAP_SPLICE_MOVE) != 0) {
+		p0Conn->want |= FUSE_CAP_SPLICE_MOVE;
+	}
+	// let libfuse splice the requests from the fuse device so that
+	// write_buf can pass them on to the backing file
+	if ((p0Conn->capable & FUSE_CAP_SPLICE_READ) != 0) {
+		p0Conn->want |= FUSE_CAP_SPLICE_READ;
+	}
+	#if FUSE_USE_VERSION < 35
+	#else
+	// let the kernel get the attributes of the entries along with readdir
+	if ((p0Conn->capable & FUSE_CAP_READDIRPLUS) != 0) {
+		p0Conn->want |= FUSE_CAP_READDIRPLUS;
+	}
+	// let the kernel collect small writes in its page cache
+	if (p0OverFs->m_p0FsPropFaker->getOptions().m_bWritebackCache
+			&& ((p0Conn->capable & FUSE_CAP_WRITEBACK_CACHE) != 0)) {
+		p0Conn->want |= FUSE_CAP_WRITEBACK_CACHE;
+		p0OverFs->m_bWritebackCache = true;
+	}
+	#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 11)
+	// closing a file opened read only has nothing to flush
+	p0Config->no_rofd_flush = 1;
+	#else
+	(void)p0Config;
+	#endif
+	#endif
+
 	oLog.log_conn(p0Conn);
 	oLog.log_fuse_context(::fuse_get_context());
 
@@ -212,11 +292,12 @@ int OverFs::getattr(const char* p0Path, struct ::stat* p0StatBuf
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_GETATTR, getCallerPid(), p0Path);
 
 	oLog.log_msg("\nover:getattr(path=\"%s\", statbuf=0x%08x)\n", p0Path, p0StatBuf);
 
-	const std::string sFullPath{getFullPath(p0Path)};
-	const int nRetStat = oLog.log_syscall("lstat", ::lstat(sFullPath.c_str(), p0StatBuf), 0);
+	const int nRetStat = oLog.log_syscall("fstatat", ::fstatat(p0OverFs->m_nRootFd, getRelPath(p0Path), p0StatBuf
+																, AT_SYMLINK_NOFOLLOW), 0);
 
 	oLog.log_stat(p0StatBuf);
 
@@ -227,11 +308,11 @@ int OverFs::readlink(const char* p0Path, char* p0Link, size_t nSize)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_READLINK, getCallerPid(), p0Path);
 
 	oLog.log_msg("\nover:readlink(path=\"%s\", link=\"%s\", size=%d)\n", p0Path, p0Link, nSize);
 
-	const std::string sFullPath{getFullPath(p0Path)};
-	int nRetStat = oLog.log_syscall("readlink", ::readlink(sFullPath.c_str(), p0Link, nSize - 1), 0);
+	int nRetStat = oLog.log_syscall("readlinkat", ::readlinkat(p0OverFs->m_nRootFd, getRelPath(p0Path), p0Link, nSize - 1), 0);
 
 	if (nRetStat >= 0) {
 		p0Link[nRetStat] = '\0';
@@ -246,26 +327,28 @@ int OverFs::mknod(const char* p0Path, mode_t nMode, dev_t nDev)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_MKNOD, getCallerPid(), p0Path, nMode, nDev);
 
 	int nRetStat;
 
 	oLog.log_msg("\nover:mknod(path=\"%s\", mode=0%3o, dev=%lld)\n", p0Path, nMode, nDev);
 
-	const std::string sFullPath{getFullPath(p0Path)};
+	const int nRootFd = p0OverFs->m_nRootFd;
+	const char* p0RelPath = getRelPath(p0Path);
 	// On Linux this could just be 'mknod(path, mode, dev)' but this
 	// tries to be be more portable by honoring the quote in the Linux
 	// mknod man page stating the only portable use of mknod() is to
 	// make a fifo, but saying it should never actually be used for
 	// that.
 	if (S_ISREG(nMode)) {
-		nRetStat = oLog.log_syscall("open", ::open(sFullPath.c_str(), O_CREAT | O_EXCL | O_WRONLY, nMode), 0);
+		nRetStat = oLog.log_syscall("openat", ::openat(nRootFd, p0RelPath, O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, nMode), 0);
 		if (nRetStat >= 0) {
 			nRetStat = oLog.log_syscall("close", ::close(nRetStat), 0);
 		}
 	} else if (S_ISFIFO(nMode)) {
-		nRetStat = oLog.log_syscall("mkfifo", ::mkfifo(sFullPath.c_str(), nMode), 0);
+		nRetStat = oLog.log_syscall("mkfifoat", ::mkfifoat(nRootFd, p0RelPath, nMode), 0);
 	} else {
-		nRetStat = oLog.log_syscall("mknod", ::mknod(sFullPath.c_str(), nMode, nDev), 0);
+		nRetStat = oLog.log_syscall("mknodat", ::mknodat(nRootFd, p0RelPath, nMode, nDev), 0);
 	}
 
 	return nRetStat;
@@ -275,48 +358,45 @@ int OverFs::mkdir(const char* p0Path, mode_t nMode)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_MKDIR, getCallerPid(), p0Path, nMode);
 
 	oLog.log_msg("\nover:mkdir(path=\"%s\", mode=0%3o)\n", p0Path, nMode);
 
-	const std::string sFullPath{getFullPath(p0Path)};
-
-	return oLog.log_syscall("mkdir", ::mkdir(sFullPath.c_str(), nMode), 0);
+	return oLog.log_syscall("mkdirat", ::mkdirat(p0OverFs->m_nRootFd, getRelPath(p0Path), nMode), 0);
 }
 
 int OverFs::unlink(const char* p0Path)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_UNLINK, getCallerPid(), p0Path);
 
 	oLog.log_msg("over:unlink(path=\"%s\")\n", p0Path);
 
-	const std::string sFullPath{getFullPath(p0Path)};
-
-	return oLog.log_syscall("unlink", ::unlink(sFullPath.c_str()), 0);
+	return oLog.log_syscall("unlinkat", ::unlinkat(p0OverFs->m_nRootFd, getRelPath(p0Path), 0), 0);
 }
 
 int OverFs::rmdir(const char* p0Path)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_RMDIR, getCallerPid(), p0Path);
 
 	oLog.log_msg("over:rmdir(path=\"%s\")\n", p0Path);
 
-	const std::string sFullPath{getFullPath(p0Path)};
-
-	return oLog.log_syscall("rmdir", ::rmdir(sFullPath.c_str()), 0);
+	return oLog.log_syscall("unlinkat", ::unlinkat(p0OverFs->m_nRootFd, getRelPath(p0Path), AT_REMOVEDIR), 0);
 }
 
 int OverFs::symlink(const char* p0Path, const char* p0Link)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_SYMLINK, getCallerPid(), p0Link);
+	oTrace.setSecond(0, p0Path);
 
 	oLog.log_msg("\nover:symlink(path=\"%s\", link=\"%s\")\n", p0Path, p0Link);
 
-	const std::string sFullLink{getFullPath(p0Link)};
-
-	return oLog.log_syscall("symlink", ::symlink(p0Path, sFullLink.c_str()), 0);
+	return oLog.log_syscall("symlinkat", ::symlinkat(p0Path, p0OverFs->m_nRootFd, getRelPath(p0Link)), 0);
 }
 
 int OverFs::rename(const char* p0Path, const char* p0NewPath
@@ -328,26 +408,28 @@ int OverFs::rename(const char* p0Path, const char* p0NewPath
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_RENAME, getCallerPid(), p0Path);
+	oTrace.setSecond(0, p0NewPath);
 
 	oLog.log_msg("\nover:rename(fpath=\"%s\", newpath=\"%s\")\n", p0Path, p0NewPath);
 
-	const std::string sFullPath{getFullPath(p0Path)};
-	const std::string sNewFullPath{getFullPath(p0NewPath)};
+	const int nRootFd = p0OverFs->m_nRootFd;
 
-	return oLog.log_syscall("rename", ::rename(sFullPath.c_str(), sNewFullPath.c_str()), 0);
+	return oLog.log_syscall("renameat", ::renameat(nRootFd, getRelPath(p0Path), nRootFd, getRelPath(p0NewPath)), 0);
 }
 
 int OverFs::link(const char* p0Path, const char* p0NewPath)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_LINK, getCallerPid(), p0Path);
+	oTrace.setSecond(0, p0NewPath);
 
 	oLog.log_msg("\nover:link(path=\"%s\", newpath=\"%s\")\n", p0Path, p0NewPath);
 
-	const std::string sFullPath{getFullPath(p0Path)};
-	const std::string sNewFullPath{getFullPath(p0NewPath)};
+	const int nRootFd = p0OverFs->m_nRootFd;
 
-	return oLog.log_syscall("link", ::link(sFullPath.c_str(), sNewFullPath.c_str()), 0);
+	return oLog.log_syscall("linkat", ::linkat(nRootFd, getRelPath(p0Path), nRootFd, getRelPath(p0NewPath), 0), 0);
 }
 
 int OverFs::chmod(const char* p0Path, mode_t nMode
@@ -359,12 +441,11 @@ int OverFs::chmod(const char* p0Path, mode_t nMode
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_CHMOD, getCallerPid(), p0Path, nMode);
 
 	oLog.log_msg("\nover:chmod(fpath=\"%s\", mode=0%03o)\n", p0Path, nMode);
 
-	const std::string sFullPath{getFullPath(p0Path)};
-
-	return oLog.log_syscall("chmod", ::chmod(sFullPath.c_str(), nMode), 0);
+	return oLog.log_syscall("fchmodat", ::fchmodat(p0OverFs->m_nRootFd, getRelPath(p0Path), nMode, 0), 0);
 }
 
 int OverFs::chown(const char* p0Path, uid_t nUId, gid_t nGId
@@ -376,12 +457,11 @@ int OverFs::chown(const char* p0Path, uid_t nUId, gid_t nGId
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_CHOWN, getCallerPid(), p0Path, nUId, nGId);
 
 	oLog.log_msg("\nover:chown(path=\"%s\", uid=%d, gid=%d)\n", p0Path, nUId, nGId);
 
-	const std::string sFullPath{getFullPath(p0Path)};
-
-	return oLog.log_syscall("chown", ::chown(sFullPath.c_str(), nUId, nGId), 0);
+	return oLog.log_syscall("fchownat", ::fchownat(p0OverFs->m_nRootFd, getRelPath(p0Path), nUId, nGId, 0), 0);
 }
 
 int OverFs::truncate(const char* p0Path, off_t nNewSize
@@ -393,44 +473,98 @@ int OverFs::truncate(const char* p0Path, off_t nNewSize
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_TRUNCATE, getCallerPid(), p0Path, nNewSize);
 
 	oLog.log_msg("\nover:truncate(path=\"%s\", newsize=%lld)\n", p0Path, nNewSize);
 
-	const std::string sFullPath{getFullPath(p0Path)};
-
-	return oLog.log_syscall("truncate", ::truncate(sFullPath.c_str(), nNewSize), 0);
+	// There is no truncateat(), open the file relative to the root instead.
+	// O_NONBLOCK prevents hanging on fifos, it's ignored for regular files.
+	const int nFD = oLog.log_syscall("openat", ::openat(p0OverFs->m_nRootFd, getRelPath(p0Path)
+														, O_WRONLY | O_NONBLOCK | O_CLOEXEC), 0);
+	if (nFD < 0) {
+		return nFD; //----------------------------------------------------------
+	}
+	const int nRetStat = oLog.log_syscall("ftruncate", ::ftruncate(nFD, nNewSize), 0);
+	::close(nFD);
+	return nRetStat;
 }
 
-int OverFs::utime(const char* p0Path, struct utimbuf *ubuf)
+int OverFs::utimens(const char* p0Path, const struct timespec aTimes[2]
+					#if FUSE_USE_VERSION < 35
+					#else
+					, struct fuse_file_info* p0FI
+					#endif
+					)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_UTIMENS, getCallerPid(), p0Path, aTimes[0].tv_sec, aTimes[1].tv_sec);
 
-	oLog.log_msg("\nover:utime(path=\"%s\", ubuf=0x%08x)\n", p0Path, ubuf);
-
-	const std::string sFullPath{getFullPath(p0Path)};
+	oLog.log_msg("\nover:utimens(path=\"%s\", atime=%lld.%09ld, mtime=%lld.%09ld)\n"
+				, p0Path, static_cast<long long>(aTimes[0].tv_sec), aTimes[0].tv_nsec
+				, static_cast<long long>(aTimes[1].tv_sec), aTimes[1].tv_nsec);
 
-	return oLog.log_syscall("utime", ::utime(sFullPath.c_str(), ubuf), 0);
+	// UTIME_NOW and UTIME_OMIT in tv_nsec are passed on as they are
+	#if FUSE_USE_VERSION < 35
+	#else
+	if (p0FI != nullptr) {
+		return oLog.log_syscall("futimens", ::futimens(p0FI->fh, aTimes), 0); //--
+	}
+	#endif
+	return oLog.log_syscall("utimensat", ::utimensat(p0OverFs->m_nRootFd, getRelPath(p0Path), aTimes
+													, AT_SYMLINK_NOFOLLOW), 0);
 }
 
 int OverFs::open(const char* p0Path, struct fuse_file_info* p0FI)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_OPEN, getCallerPid(), p0Path, p0FI->flags);
 
 	oLog.log_msg("\nover:open(path\"%s\", fi=0x%08x)\n", p0Path, p0FI);
 
-	const std::string sFullPath{getFullPath(p0Path)};
-
 	int nRetStat = 0;
 
 	// if the open call succeeds, my nRetStat is the file descriptor,
 	// else it's -errno.  I'm making sure that in that case the saved
 	// file descriptor is exactly -1.
-	int fd = oLog.log_syscall("open", ::open(sFullPath.c_str(), p0FI->flags), 0);
+	int fd = oLog.log_syscall("openat", ::openat(p0OverFs->m_nRootFd, getRelPath(p0Path)
+												, p0OverFs->getUnderlyingOpenFlags(p0FI->flags)), 0);
 	if (fd < 0) {
 		nRetStat = oLog.log_error("open");
+	} else {
+		p0OverFs->addOpenHandle(fd, p0Path);
+	}
+	// not the descriptor
+	oLog.setTraceResult(nRetStat);
+
+	p0FI->fh = fd;
+
+	oLog.log_fi(p0FI);
+
+	return nRetStat;
+}
+
+int OverFs::create(const char* p0Path, mode_t nMode, struct fuse_file_info* p0FI)
+{
+	OverFs* p0OverFs = OverFs::this_();
+	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_CREATE, getCallerPid(), p0Path, nMode, p0FI->flags);
+
+	oLog.log_msg("\nover:create(path=\"%s\", mode=0%03o, fi=0x%08x)\n", p0Path, nMode, p0FI);
+
+	int nRetStat = 0;
+
+	// Creating and opening in one go spares fuse the mknod + open sequence.
+	int fd = oLog.log_syscall("openat", ::openat(p0OverFs->m_nRootFd, getRelPath(p0Path)
+												, p0OverFs->getUnderlyingOpenFlags(p0FI->flags) | O_CREAT, nMode), 0);
+	if (fd < 0) {
+		nRetStat = oLog.log_error("create");
+	} else {
+		p0OverFs->addOpenHandle(fd, p0Path);
 	}
+	// not the descriptor
+	oLog.setTraceResult(nRetStat);
 
 	p0FI->fh = fd;
 
@@ -443,6 +577,7 @@ int OverFs::read(const char* p0Path, char* p0Buf, size_t nSize, off_t nOffset, s
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_READ, getCallerPid(), p0Path, nSize, nOffset);
 
 	oLog.log_msg("\nover:read(path=\"%s\", buf=0x%08x, size=%d, offset=%lld, fi=0x%08x)\n"
 				, p0Path, p0Buf, nSize, nOffset, p0FI);
@@ -452,11 +587,46 @@ int OverFs::read(const char* p0Path, char* p0Buf, size_t nSize, off_t nOffset, s
 	return oLog.log_syscall("pread", ::pread(p0FI->fh, p0Buf, nSize, nOffset), 0);
 }
 
+int OverFs::read_buf(const char* p0Path, struct fuse_bufvec** pp0Buf, size_t nSize, off_t nOffset
+					, struct fuse_file_info* p0FI)
+{
+	OverFs* p0OverFs = OverFs::this_();
+	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_READ, getCallerPid(), p0Path, nSize, nOffset);
+
+	oLog.log_msg("\nover:read_buf(path=\"%s\", bufp=0x%08x, size=%d, offset=%lld, fi=0x%08x)\n"
+				, p0Path, pp0Buf, nSize, nOffset, p0FI);
+	oLog.log_fi(p0FI);
+
+	// Instead of reading the data ourselves, tell fuse where it is.
+	// libfuse then splices it from the backing file to the fuse device
+	// without copying it to and from user space.
+	// The buffer vector is freed by libfuse with free().
+	auto p0BufVec = static_cast<struct fuse_bufvec*>(::malloc(sizeof(struct fuse_bufvec)));
+	if (p0BufVec == nullptr) {
+		return oLog.log_errno("over:read_buf malloc", ENOMEM); //-------------
+	}
+	p0BufVec->count = 1;
+	p0BufVec->idx = 0;
+	p0BufVec->off = 0;
+	struct fuse_buf& oBuf = p0BufVec->buf[0];
+	oBuf.size = nSize;
+	oBuf.flags = static_cast<enum fuse_buf_flags>(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
+	oBuf.mem = nullptr;
+	oBuf.fd = static_cast<int>(p0FI->fh);
+	oBuf.pos = nOffset;
+
+	*pp0Buf = p0BufVec;
+
+	return 0;
+}
+
 int OverFs::write(const char* p0Path, const char* p0Buf, size_t nSize, off_t nOffset
 				, struct fuse_file_info* p0FI)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_WRITE, getCallerPid(), p0Path, nSize, nOffset);
 
 	oLog.log_msg("\nover:write(path=\"%s\", buf=0x%08x, size=%d, offset=%lld, fi=0x%08x)\n"
 				, p0Path, p0Buf, nSize, nOffset, p0FI);
@@ -466,78 +636,50 @@ int OverFs::write(const char* p0Path, const char* p0Buf, size_t nSize, off_t nOf
 	return oLog.log_syscall("pwrite", ::pwrite(p0FI->fh, p0Buf, nSize, nOffset), 0);
 }
 
-int OverFs::statfs(const char* p0Path, struct ::statvfs* p0StatFs)
+int OverFs::write_buf(const char* p0Path, struct fuse_bufvec* p0Buf, off_t nOffset, struct fuse_file_info* p0FI)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
 
-	oLog.log_msg("\nover:statfs(path=\"%s\", statv=0x%08x)\n", p0Path, p0StatFs);
-
-	const std::string sFullPath{getFullPath(p0Path)};
+	const size_t nSize = ::fuse_buf_size(p0Buf);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_WRITE, getCallerPid(), p0Path, nSize, nOffset);
 
-	// get stats for underlying filesystem
-	const int nRetStat = oLog.log_syscall("statvfs", ::statvfs(sFullPath.c_str(), p0StatFs), 0);
-
-	if (nRetStat == -1) {
-		oLog.log_retstat("statvfs", nRetStat);
-		return -1; //-----------------------------------------------------------
-	}
-	oLog.log_statvfs(p0StatFs);
+	oLog.log_msg("\nover:write_buf(path=\"%s\", buf=0x%08x, size=%d, offset=%lld, fi=0x%08x)\n"
+				, p0Path, p0Buf, nSize, nOffset, p0FI);
+	oLog.log_fi(p0FI);
 
-	const unsigned long nFragmentSize = p0StatFs->f_frsize;
-	if (p0OverFs->m_nBlockSize != static_cast<int64_t>(nFragmentSize)) {
-		oLog.log_msg("\ninternal error block size\n");
-		errno = EOVERFLOW;
-		return -1; //-----------------------------------------------------------
+	// If the data is still in the fuse device's pipe it is spliced
+	// directly into the backing file, otherwise it is written from memory.
+	struct fuse_bufvec oDst;
+	oDst.count = 1;
+	oDst.idx = 0;
+	oDst.off = 0;
+	struct fuse_buf& oBuf = oDst.buf[0];
+	oBuf.size = nSize;
+	oBuf.flags = static_cast<enum fuse_buf_flags>(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
+	oBuf.mem = nullptr;
+	oBuf.fd = static_cast<int>(p0FI->fh);
+	oBuf.pos = nOffset;
+
+	const ssize_t nRetStat = ::fuse_buf_copy(&oDst, p0Buf, FUSE_BUF_SPLICE_NONBLOCK);
+	oLog.log_retstat("fuse_buf_copy", static_cast<int>(nRetStat));
+	if (nRetStat < 0) {
+		// fuse_buf_copy returns -errno
+		oLog.log_errno("over:write_buf fuse_buf_copy", static_cast<int>(- nRetStat));
 	}
+	return static_cast<int>(nRetStat);
+}
 
-	int64_t nFsSizeInFragments = static_cast<int64_t>(p0StatFs->f_blocks);
-	int64_t nFreeFragments = static_cast<int64_t>(p0StatFs->f_bavail);
-	int64_t nFreeishFragments = static_cast<int64_t>(p0StatFs->f_bfree);
-	const int64_t nDeltaFree = nFreeishFragments - nFreeFragments;
-
-	bool bUseFakeFixedDiskSize;
-	bool bUseFakeFixedFreeSize;
-	int64_t nFakeDiskSizeInBlocks;
-	int64_t nFakeFreeSizeInBlocks;
-	{
-		std::lock_guard<std::mutex> oLock(p0OverFs->m_oFsMutex);
-		// store real data
-		p0OverFs->m_nRealDiskSizeInBlocks = nFsSizeInFragments;
-		p0OverFs->m_nRealFreeSizeInBlocks = nFreeFragments;
-		// modifying data
-		bUseFakeFixedDiskSize = p0OverFs->m_bUseFakeFixedDiskSize;
-		bUseFakeFixedFreeSize = p0OverFs->m_bUseFakeFixedFreeSize;
-		nFakeDiskSizeInBlocks = p0OverFs->m_nFakeDiskSizeInBlocks;
-		nFakeFreeSizeInBlocks = p0OverFs->m_nFakeFreeSizeInBlocks;
-	}
-	if (bUseFakeFixedDiskSize) {
-		nFsSizeInFragments = nFakeDiskSizeInBlocks;
-	} else if (nFakeDiskSizeInBlocks != 0) {
-		nFsSizeInFragments += nFakeDiskSizeInBlocks;
-		if (nFsSizeInFragments < 0) {
-			nFsSizeInFragments = 0;
-		}
-	}
-	if (bUseFakeFixedFreeSize) {
-		nFreeFragments = std::min(nFakeFreeSizeInBlocks, nFsSizeInFragments);
-	} else if (nFakeFreeSizeInBlocks != 0) {
-		nFreeFragments += nFakeFreeSizeInBlocks;
-		if (nFreeFragments < 0) {
-			nFreeFragments= 0;
-		} else if (nFreeFragments > nFsSizeInFragments) {
-			nFreeFragments = nFsSizeInFragments;
-		}
-	}
+int OverFs::statfs(const char* p0Path, struct ::statvfs* p0StatFs)
+{
+	OverFs* p0OverFs = OverFs::this_();
+	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_STATFS, getCallerPid(), p0Path);
 
-	p0StatFs->f_blocks = static_cast<fsblkcnt_t>(nFsSizeInFragments);
-	p0StatFs->f_bavail = static_cast<fsblkcnt_t>(nFreeFragments);
-	p0StatFs->f_bfree = static_cast<fsblkcnt_t>(nFreeFragments + nDeltaFree);
-	oLog.log_msg("\n     new f_blocks %lld \n", p0StatFs->f_blocks);
-	oLog.log_msg("     new f_bavail %lld \n", p0StatFs->f_bavail);
-	oLog.log_msg("     new f_bfree %lld \n", p0StatFs->f_bfree);
-	oLog.log_msg("     nRetStat %d \n", nRetStat);
+	oLog.log_msg("\nover:statfs(path=\"%s\", statv=0x%08x)\n", p0Path, p0StatFs);
 
+	const int nRetStat = p0OverFs->getFakeStatVFS(*p0StatFs);
+	oLog.setTraceResult(nRetStat);
 	return nRetStat;
 }
 
@@ -545,6 +687,7 @@ int OverFs::flush(const char* p0Path, struct fuse_file_info* p0FI)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_FLUSH, getCallerPid(), p0Path);
 
 	oLog.log_msg("\nover:flush(path=\"%s\", fi=0x%08x)\n", p0Path, p0FI);
 	// no need to get fpath on this one, since I work from p0FI->fh not the path
@@ -557,10 +700,12 @@ int OverFs::release(const char* p0Path, struct fuse_file_info* p0FI)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_RELEASE, getCallerPid(), p0Path);
 
 	oLog.log_msg("\nover:release(path=\"%s\", fi=0x%08x)\n", p0Path, p0FI);
 	oLog.log_fi(p0FI);
 
+	p0OverFs->removeOpenHandle(p0FI->fh);
 	// We need to close the file.  Had we allocated any resources
 	// (buffers etc) we'd need to free them here as well.
 	return oLog.log_syscall("close", ::close(p0FI->fh), 0);
@@ -570,6 +715,7 @@ int OverFs::fsync(const char* p0Path, int nDataSync, struct fuse_file_info* p0FI
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_FSYNC, getCallerPid(), p0Path, nDataSync);
 
 	oLog.log_msg("\nover:fsync(path=\"%s\", datasync=%d, fi=0x%08x)\n", p0Path, nDataSync, p0FI);
 	oLog.log_fi(p0FI);
@@ -583,15 +729,86 @@ int OverFs::fsync(const char* p0Path, int nDataSync, struct fuse_file_info* p0FI
 	return oLog.log_syscall("fsync", ::fsync(p0FI->fh), 0);
 }
 
+int OverFs::fallocate(const char* p0Path, int nMode, off_t nOffset, off_t nLength, struct fuse_file_info* p0FI)
+{
+	OverFs* p0OverFs = OverFs::this_();
+	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_FALLOCATE, getCallerPid(), p0Path, nMode, nOffset, nLength);
+
+	oLog.log_msg("\nover:fallocate(path=\"%s\", mode=0x%08x, offset=%lld, length=%lld, fi=0x%08x)\n"
+				, p0Path, nMode, nOffset, nLength, p0FI);
+	oLog.log_fi(p0FI);
+
+	// The mode (ex. FALLOC_FL_PUNCH_HOLE, FALLOC_FL_ZERO_RANGE) is passed on as is,
+	// if the underlying file system doesn't support it the error is returned.
+	return oLog.log_syscall("fallocate", ::fallocate(p0FI->fh, nMode, nOffset, nLength), 0);
+}
+
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 4)
+ssize_t OverFs::copy_file_range(const char* p0PathIn, struct fuse_file_info* p0FIIn, off_t nOffsetIn
+								, const char* p0PathOut, struct fuse_file_info* p0FIOut, off_t nOffsetOut
+								, size_t nSize, int nFlags)
+{
+	OverFs* p0OverFs = OverFs::this_();
+	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_COPY_FILE_RANGE, getCallerPid(), p0PathIn, nOffsetIn, nOffsetOut, nSize);
+	oTrace.setSecond(0, p0PathOut);
+
+	oLog.log_msg("\nover:copy_file_range(path_in=\"%s\", fi_in=0x%08x, offset_in=%lld"
+				", path_out=\"%s\", fi_out=0x%08x, offset_out=%lld, size=%d, flags=0x%08x)\n"
+				, p0PathIn, p0FIIn, nOffsetIn, p0PathOut, p0FIOut, nOffsetOut, nSize, nFlags);
+	oLog.log_fi(p0FIIn);
+	oLog.log_fi(p0FIOut);
+
+	// The copy is done by the kernel within the underlying file system,
+	// which might even share the extents (reflink) instead of copying.
+	loff_t nOffIn = nOffsetIn;
+	loff_t nOffOut = nOffsetOut;
+	const ssize_t nRes = ::copy_file_range(p0FIIn->fh, &nOffIn, p0FIOut->fh, &nOffOut, nSize
+											, static_cast<unsigned int>(nFlags));
+	if (nRes < 0) {
+		return oLog.log_error("copy_file_range"); //---------------------------
+	}
+	oLog.log_msg("    copy_file_range returned %lld\n", nRes);
+	oLog.setTraceResult(nRes);
+	return nRes;
+}
+#endif
+
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+off_t OverFs::lseek(const char* p0Path, off_t nOffset, int nWhence, struct fuse_file_info* p0FI)
+{
+	OverFs* p0OverFs = OverFs::this_();
+	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_LSEEK, getCallerPid(), p0Path, nOffset, nWhence);
+
+	oLog.log_msg("\nover:lseek(path=\"%s\", offset=%lld, whence=%d, fi=0x%08x)\n"
+				, p0Path, nOffset, nWhence, p0FI);
+	oLog.log_fi(p0FI);
+
+	// Only called by the kernel for SEEK_DATA and SEEK_HOLE.
+	const off_t nRes = ::lseek(p0FI->fh, nOffset, nWhence);
+	if (nRes < 0) {
+		return oLog.log_error("lseek"); //-------------------------------------
+	}
+	oLog.log_msg("    lseek returned %lld\n", nRes);
+	oLog.setTraceResult(nRes);
+	return nRes;
+}
+#endif
+
 int OverFs::setxattr(const char* p0Path, const char* p0Name, const char* p0Value, size_t nSize, int nFlags)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_SETXATTR, getCallerPid(), p0Path, nSize, nFlags);
+	oTrace.setSecond(0, p0Name);
 
 	oLog.log_msg("\nover:setxattr(path=\"%s\", name=\"%s\", value=\"%s\", size=%d, flags=0x%08x)\n"
 				, p0Path, p0Name, p0Value, nSize, nFlags);
 
-	const std::string sFullPath{getFullPath(p0Path)};
+	// there are no *at() variants of the xattr functions
+	const std::string sFullPath{p0OverFs->getFullPath(p0Path)};
 
 	return oLog.log_syscall("lsetxattr", ::lsetxattr(sFullPath.c_str(), p0Name, p0Value, nSize, nFlags), 0);
 }
@@ -600,11 +817,13 @@ int OverFs::getxattr(const char* p0Path, const char* p0Name, char* p0Value, size
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_GETXATTR, getCallerPid(), p0Path, nSize);
+	oTrace.setSecond(0, p0Name);
 
 	oLog.log_msg("\nover:getxattr(path = \"%s\", name = \"%s\", value = 0x%08x, size = %d)\n"
 				, p0Path, p0Name, p0Value, nSize);
 
-	const std::string sFullPath{getFullPath(p0Path)};
+	const std::string sFullPath{p0OverFs->getFullPath(p0Path)};
 
 	const int nRetStat = oLog.log_syscall("lgetxattr", ::lgetxattr(sFullPath.c_str(), p0Name, p0Value, nSize), 0);
 	if (nRetStat >= 0) {
@@ -618,11 +837,12 @@ int OverFs::listxattr(const char* p0Path, char* p0List, size_t nSize)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_LISTXATTR, getCallerPid(), p0Path, nSize);
 
 	oLog.log_msg("\nover:listxattr(path=\"%s\", list=0x%08x, size=%d)\n"
 				, p0Path, p0List, nSize);
 
-	const std::string sFullPath{getFullPath(p0Path)};
+	const std::string sFullPath{p0OverFs->getFullPath(p0Path)};
 
 	const int nRetStat = oLog.log_syscall("llistxattr", ::llistxattr(sFullPath.c_str(), p0List, nSize), 0);
 	if (nRetStat >= 0) {
@@ -643,10 +863,12 @@ int OverFs::removexattr(const char* p0Path, const char* p0Name)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_REMOVEXATTR, getCallerPid(), p0Path);
+	oTrace.setSecond(0, p0Name);
 
 	oLog.log_msg("\nover:removexattr(path=\"%s\", name=\"%s\")\n", p0Path, p0Name);
 
-	const std::string sFullPath{getFullPath(p0Path)};
+	const std::string sFullPath{p0OverFs->getFullPath(p0Path)};
 
 	return oLog.log_syscall("lremovexattr", ::lremovexattr(sFullPath.c_str(), p0Name), 0);
 }
@@ -655,20 +877,35 @@ int OverFs::opendir(const char* p0Path, struct fuse_file_info* p0FI)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_OPENDIR, getCallerPid(), p0Path);
 
 	oLog.log_msg("\nover:opendir(path=\"%s\", fi=0x%08x)\n", p0Path, p0FI);
 
-	const std::string sFullPath{getFullPath(p0Path)};
-
 	int nRetStat = 0;
 
-	DIR* p0DirStream = ::opendir(sFullPath.c_str());
-	oLog.log_msg("    opendir returned 0x%p\n", p0DirStream);
-	if (p0DirStream == nullptr) {
-		nRetStat = oLog.log_error("over:opendir opendir");
+	DirHandle* p0DirHandle = nullptr;
+	const int nDirFd = ::openat(p0OverFs->m_nRootFd, getRelPath(p0Path), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (nDirFd < 0) {
+		nRetStat = oLog.log_error("over:opendir openat");
+	} else {
+		DIR* p0DirStream = ::fdopendir(nDirFd);
+		oLog.log_msg("    fdopendir returned 0x%p\n", p0DirStream);
+		if (p0DirStream == nullptr) {
+			nRetStat = oLog.log_error("over:opendir fdopendir");
+			::close(nDirFd);
+		} else {
+			p0DirHandle = new (std::nothrow) DirHandle{};
+			if (p0DirHandle == nullptr) {
+				::closedir(p0DirStream);
+				nRetStat = -ENOMEM;
+			} else {
+				p0DirHandle->m_p0DirStream = p0DirStream;
+				p0OverFs->addOpenHandle(reinterpret_cast<uint64_t>(p0DirHandle), p0Path);
+			}
+		}
 	}
 
-	p0FI->fh = reinterpret_cast<uint64_t>(p0DirStream);
+	p0FI->fh = reinterpret_cast<uint64_t>(p0DirHandle);
 
 	oLog.log_fi(p0FI);
 
@@ -679,60 +916,104 @@ int OverFs::readdir(const char* p0Path, void* p0Buf, fuse_fill_dir_t filler, off
 					, struct fuse_file_info* p0FI
 					#if FUSE_USE_VERSION < 35
 					#else
-					, enum fuse_readdir_flags
+					, enum fuse_readdir_flags eFlags
 					#endif
 					)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_READDIR, getCallerPid(), p0Path, 0, nOffset);
 
 	oLog.log_msg("\nover:readdir(path=\"%s\", buf=0x%08x, filler=0x%08x, offset=%lld, fi=0x%08x)\n"
 				, p0Path, p0Buf, filler, nOffset, p0FI);
 
-	int nRetStat = 0;
 	// once again, no need for fullpath -- but note that I need to cast p0FI->fh
-	DIR* p0DirStream = reinterpret_cast<DIR *>(static_cast<uintptr_t>(p0FI->fh));
-
-	// Every directory contains at least two entries: . and ..  If my
-	// first call to the system readdir() returns nullptr I've got an
-	// error; near as I can tell, that's the only condition under
-	// which I can get an error from readdir()
-	struct dirent* p0DirEntry = ::readdir(p0DirStream);
-	oLog.log_msg("    readdir returned 0x%p\n", p0DirEntry);
-	if (p0DirEntry == nullptr) {
-		nRetStat = oLog.log_error("over:readdir readdir");
-		return nRetStat;
-	}
-
-	// This will copy the entire directory into the buffer.  The loop exits
-	// when either the system readdir() returns nullptr, or filler()
-	// returns something non-zero.  The first case just means I've
-	// read the whole directory; the second means the buffer is full.
-	do {
+	DirHandle* p0DirHandle = reinterpret_cast<DirHandle*>(static_cast<uintptr_t>(p0FI->fh));
+	DIR* p0DirStream = p0DirHandle->m_p0DirStream;
+
+	// The kernel passes the offset of the last entry it received (0 at the
+	// start). If it isn't where the previous call stopped (rewinddir, seekdir
+	// or a retry) the stream is repositioned and the pending entry dropped.
+	if (nOffset != p0DirHandle->m_nOffset) {
+		::seekdir(p0DirStream, nOffset);
+		p0DirHandle->m_p0PendingEntry = nullptr;
+		p0DirHandle->m_nOffset = nOffset;
+	}
+
+	#if FUSE_USE_VERSION < 35
+	#else
+	const bool bPlus = ((eFlags & FUSE_READDIR_PLUS) != 0);
+	const int nDirFd = ::dirfd(p0DirStream);
+	#endif
+	struct ::stat oStat;
+	// Entries are passed to filler() with the offset of the following
+	// entry until the buffer is full. The entry that didn't fit is kept
+	// for the next call so that only one buffer's worth of the directory
+	// is held at any time, whatever its size.
+	// The inode and the file type come with the entry for free, so that
+	// the kernel doesn't need to ask for them. When readdirplus is requested
+	// the full attributes are fetched relative to the open directory,
+	// which spares the kernel a lookup and a getattr per entry.
+	while (true) {
+		struct dirent* p0DirEntry = p0DirHandle->m_p0PendingEntry;
+		if (p0DirEntry == nullptr) {
+			errno = 0;
+			p0DirEntry = ::readdir(p0DirStream);
+			if (p0DirEntry == nullptr) {
+				if (errno != 0) {
+					return oLog.log_error("over:readdir readdir"); //-----------
+				}
+				break;
+			}
+		}
+		const off_t nNextOffset = ::telldir(p0DirStream);
+
 		oLog.log_msg("calling filler with name %s\n", p0DirEntry->d_name);
-		if (filler(p0Buf, p0DirEntry->d_name, nullptr, 0) != 0) {
-			oLog.log_msg("    ERROR over:readdir filler:  buffer full");
-			return -ENOMEM;
+		std::memset(&oStat, 0, sizeof(oStat));
+		oStat.st_ino = p0DirEntry->d_ino;
+		oStat.st_mode = DTTOIF(p0DirEntry->d_type);
+		#if FUSE_USE_VERSION < 35
+		// The libfuse 2 high level API has no readdirplus, it only passes
+		// the file type (and the inode with use_ino) to the kernel. A full
+		// fstatat per entry would be thrown away, the kernel still does
+		// a lookup per entry.
+		const int nFillRes = filler(p0Buf, p0DirEntry->d_name, &oStat, nNextOffset);
+		#else
+		auto eFillFlags = static_cast<enum fuse_fill_dir_flags>(0);
+		if (bPlus && (::fstatat(nDirFd, p0DirEntry->d_name, &oStat, AT_SYMLINK_NOFOLLOW) == 0)) {
+			eFillFlags = FUSE_FILL_DIR_PLUS;
+		}
+		const int nFillRes = filler(p0Buf, p0DirEntry->d_name, &oStat, nNextOffset, eFillFlags);
+		#endif
+		if (nFillRes != 0) {
+			// buffer full, the entry will be the first of the next call
+			p0DirHandle->m_p0PendingEntry = p0DirEntry;
+			break;
 		}
-	} while ((p0DirEntry = ::readdir(p0DirStream)) != nullptr);
+		p0DirHandle->m_p0PendingEntry = nullptr;
+		p0DirHandle->m_nOffset = nNextOffset;
+	}
 
 	oLog.log_fi(p0FI);
 
-	return nRetStat;
+	return 0;
 }
 
 int OverFs::releasedir(const char* p0Path, struct fuse_file_info* p0FI)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_RELEASEDIR, getCallerPid(), p0Path);
 
 	oLog.log_msg("\nover:releasedir(path=\"%s\", fi=0x%08x)\n", p0Path, p0FI);
 
 	oLog.log_fi(p0FI);
 
-	DIR* p0DirStream = reinterpret_cast<DIR *>(static_cast<uintptr_t>(p0FI->fh));
+	DirHandle* p0DirHandle = reinterpret_cast<DirHandle*>(static_cast<uintptr_t>(p0FI->fh));
 
-	::closedir(p0DirStream);
+	p0OverFs->removeOpenHandle(p0FI->fh);
+	::closedir(p0DirHandle->m_p0DirStream);
+	delete p0DirHandle;
 
 	int nRetStat = 0;
 	return nRetStat;
@@ -742,6 +1023,7 @@ int OverFs::fsyncdir(const char* p0Path, int nDataSync, struct fuse_file_info* p
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_FSYNCDIR, getCallerPid(), p0Path, nDataSync);
 
 	oLog.log_msg("\nover:fsyncdir(path=\"%s\", datasync=%d, fi=0x%08x)\n", p0Path, nDataSync, p0FI);
 	oLog.log_fi(p0FI);
@@ -754,6 +1036,7 @@ void OverFs::destroy(void* p0Userdata)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_DESTROY, getCallerPid(), nullptr);
 
 	oLog.log_msg("\nover:destroy(userdata=0x%08x)\n", p0Userdata);
 }
@@ -762,12 +1045,11 @@ int OverFs::access(const char* p0Path, int nMask)
 {
 	OverFs* p0OverFs = OverFs::this_();
 	auto& oLog = *(p0OverFs->m_refLogger);
+	FsLogger::TraceOp oTrace(oLog, TRACE_OP_ACCESS, getCallerPid(), p0Path, nMask);
 
 	oLog.log_msg("\nover:access(path=\"%s\", mask=0%o)\n", p0Path, nMask);
 
-	const std::string sFullPath{getFullPath(p0Path)};
-
-	int nRetStat = ::access(sFullPath.c_str(), nMask);
+	int nRetStat = ::faccessat(p0OverFs->m_nRootFd, getRelPath(p0Path), nMask, 0);
 
 	if (nRetStat < 0) {
 		nRetStat = oLog.log_error("over:access access");
@@ -24,13 +24,16 @@
 #include "fusepp/Fuse.h"
 #include "fusepp/Fuse.cpp"
 
-#include "fslogger.h"
+#include "fakefs.h"
 
 #include <memory>
 #include <string>
 #include <functional>
 #include <mutex>
 
+#include <dirent.h>
+#include <sys/statvfs.h>
+
 namespace fspf
 {
 
@@ -39,10 +42,11 @@ using std::shared_ptr;
 using std::weak_ptr;
 
 class FsPropFaker;
+class FsDispatcher;
 
-/** File system property faker.
+/** File system property faker on the high level (path based) fuse API.
  */
-class OverFs : public Fusepp::Fuse<OverFs>
+class OverFs : public Fusepp::Fuse<OverFs>, public FakeFs
 {
 public:
 	// returns object and empty string or null and error string
@@ -87,15 +91,32 @@ public:
 	#else
 	static int truncate(const char* p0Path, off_t nNewSize, fuse_file_info *);
 	#endif
-	static int utime(const char* p0Path, struct utimbuf *ubuf);
+	#if FUSE_USE_VERSION < 35
+	static int utimens(const char* p0Path, const struct timespec aTimes[2]);
+	#else
+	static int utimens(const char* p0Path, const struct timespec aTimes[2], struct fuse_file_info* p0FI);
+	#endif
 	static int open(const char* p0Path, struct fuse_file_info* p0FI);
+	static int create(const char* p0Path, mode_t nMode, struct fuse_file_info* p0FI);
 	static int read(const char* p0Path, char* p0Buf, size_t nSize, off_t nOffset, struct fuse_file_info* p0FI);
+	static int read_buf(const char* p0Path, struct fuse_bufvec** pp0Buf, size_t nSize, off_t nOffset
+						, struct fuse_file_info* p0FI);
 	static int write(const char* p0Path, const char* p0Buf, size_t nSize, off_t nOffset
 					, struct fuse_file_info* p0FI);
+	static int write_buf(const char* p0Path, struct fuse_bufvec* p0Buf, off_t nOffset, struct fuse_file_info* p0FI);
 	static int statfs(const char* p0Path, struct ::statvfs* p0StatFs);
 	static int flush(const char* p0Path, struct fuse_file_info* p0FI);
 	static int release(const char* p0Path, struct fuse_file_info* p0FI);
 	static int fsync(const char* p0Path, int nDataSync, struct fuse_file_info* p0FI);
+	static int fallocate(const char* p0Path, int nMode, off_t nOffset, off_t nLength, struct fuse_file_info* p0FI);
+	#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 4)
+	static ssize_t copy_file_range(const char* p0PathIn, struct fuse_file_info* p0FIIn, off_t nOffsetIn
+									, const char* p0PathOut, struct fuse_file_info* p0FIOut, off_t nOffsetOut
+									, size_t nSize, int nFlags);
+	#endif
+	#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+	static off_t lseek(const char* p0Path, off_t nOffset, int nWhence, struct fuse_file_info* p0FI);
+	#endif
 	static int setxattr(const char* p0Path, const char* p0Name, const char* p0Value, size_t nSize, int nFlags);
 	static int getxattr(const char* p0Path, const char* p0Name, char* p0Value, size_t nSize);
 	static int listxattr(const char* p0Path, char* p0List, size_t nSize);
@@ -114,41 +135,32 @@ public:
 	static int access(const char* p0Path, int nMask);
 
 
-	FsPropFaker* getFsPropFaker() const noexcept;
-	FsLogger* getFsLogger() const noexcept;
-
-	int64_t getRealDiskSizeInBlocks() noexcept;
-	int64_t getRealFreeSizeInBlocks() noexcept;
-
-	void setFakeDiskSizeInBlocks(int64_t nSizeBlocks) noexcept;
-	void setFakeDiskSizeDiffInBlocks(int64_t nSizeBlocks) noexcept;
-	void setFakeFreeSizeInBlocks(int64_t nSizeBlocks) noexcept;
-	void setFakeFreeSizeDiffInBlocks(int64_t nSizeBlocks) noexcept;
+	std::string mount(int nArgC, char** aArgV) noexcept override;
+	int loop() noexcept override;
+	void teardown() noexcept override;
+	std::string dispatch(FsDispatcher& oDispatcher, std::function<void()>&& oOnEnd) noexcept override;
+	void exitSession() noexcept override;
 
 protected:
 	OverFs(FsPropFaker* p0FsPropFaker, std::function<void()>&& oCallback) noexcept;
-	std::string initInstance() noexcept;
 private:
-	std::string getStatVFS(struct ::statvfs& oStatFs) noexcept;
+	// the state of an open directory, stored in fuse_file_info::fh
+	struct DirHandle
+	{
+		DIR* m_p0DirStream = nullptr;
+		struct dirent* m_p0PendingEntry = nullptr; // read but not yet accepted by the filler
+		off_t m_nOffset = 0; // the offset of the next entry, as returned by telldir
+	};
 private:
-	//friend class FsPropFaker;
-	FsPropFaker* m_p0FsPropFaker;
-	const std::string& m_sMountName;
-	const std::string& m_sRootPath;
-	const std::string& m_sLogFilePath;
-	int64_t m_nBlockSize;
-
-	unique_ptr<FsLogger> m_refLogger;
-
-	std::function<void()> m_oCallback;
-
-	std::mutex m_oFsMutex;
-		int64_t m_nRealDiskSizeInBlocks = -1; // if negative not determined yet.
-		int64_t m_nRealFreeSizeInBlocks = -1; // if negative not determined yet.
-		bool m_bUseFakeFixedDiskSize = false; // if false m_nFakeDiskSizeInBlocks must be added to real disk size.
-		bool m_bUseFakeFixedFreeSize = false; // if false m_nFakeFreeSizeInBlocks must be added to real free size.
-		int64_t m_nFakeDiskSizeInBlocks = 0; // 1000000 bytes.
-		int64_t m_nFakeFreeSizeInBlocks = 0; // 1000000 bytes.
+	// only used by the functions that have no *at() variant
+	std::string getFullPath(const char* p0Path) const noexcept;
+private:
+	struct fuse* m_p0Fuse = nullptr;
+	char* m_p0MountPoint = nullptr; // allocated by libfuse
+	#if FUSE_USE_VERSION < 35
+	struct fuse_chan* m_p0Chan = nullptr;
+	#endif
+	std::mutex m_oSessionMutex; // protects m_p0Fuse from being destroyed while exitSession() uses it
 
 private:
 	OverFs() = delete;
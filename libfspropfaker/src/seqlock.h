@@ -0,0 +1,127 @@
+/*
+ * Copyright © 2020  Stefano Marsili, <stemars@gmx.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+/*
+ * File:   seqlock.h
+ */
+
+#ifndef FSPF_SEQ_LOCK_H
+#define FSPF_SEQ_LOCK_H
+
+#include <atomic>
+#include <mutex>
+#include <type_traits>
+
+#include <string.h>
+#include <stdint.h>
+
+namespace fspf
+{
+
+/** Sequence lock holding a value.
+ * Readers never block and never make writers wait: they copy the value and
+ * retry if a writer modified it in the meantime. Writers are serialized
+ * among themselves by a mutex.
+ * The value is stored in atomic words so that a torn read, which is
+ * discarded anyway, is not a data race.
+ * @param T The type of the value. Must be trivially copyable.
+ */
+template <typename T>
+class SeqLock
+{
+	static_assert(std::is_trivially_copyable<T>::value, "SeqLock needs a trivially copyable type");
+public:
+	explicit SeqLock(const T& oValue = T{}) noexcept
+	{
+		storeWords(oValue);
+	}
+	/** Returns a consistent copy of the value.
+	 * @return The value.
+	 */
+	T load() const noexcept
+	{
+		uint64_t aWords[s_nTotWords];
+		while (true) {
+			const uint32_t nSeqBefore = m_nSeq.load(std::memory_order_acquire);
+			if ((nSeqBefore & 1) != 0) {
+				// a writer is in progress
+				continue;
+			}
+			for (int32_t nIdx = 0; nIdx < s_nTotWords; ++nIdx) {
+				aWords[nIdx] = m_aWords[nIdx].load(std::memory_order_relaxed);
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (m_nSeq.load(std::memory_order_relaxed) == nSeqBefore) {
+				break;
+			}
+		}
+		T oValue;
+		::memcpy(&oValue, aWords, sizeof(T));
+		return oValue;
+	}
+	/** Replaces the value.
+	 * @param oValue The new value.
+	 */
+	void store(const T& oValue) noexcept
+	{
+		std::lock_guard<std::mutex> oLock(m_oWriterMutex);
+		write(oValue);
+	}
+	/** Modifies the value.
+	 * The modification of concurrent writers is not lost.
+	 * @param oModify The function modifying a copy of the current value. Cannot be null.
+	 */
+	template <typename F>
+	void update(F&& oModify) noexcept
+	{
+		std::lock_guard<std::mutex> oLock(m_oWriterMutex);
+		T oValue = load();
+		oModify(oValue);
+		write(oValue);
+	}
+private:
+	void write(const T& oValue) noexcept
+	{
+		const uint32_t nSeq = m_nSeq.load(std::memory_order_relaxed);
+		m_nSeq.store(nSeq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		storeWords(oValue);
+		m_nSeq.store(nSeq + 2, std::memory_order_release);
+	}
+	void storeWords(const T& oValue) noexcept
+	{
+		uint64_t aWords[s_nTotWords] = {};
+		::memcpy(aWords, &oValue, sizeof(T));
+		for (int32_t nIdx = 0; nIdx < s_nTotWords; ++nIdx) {
+			m_aWords[nIdx].store(aWords[nIdx], std::memory_order_relaxed);
+		}
+	}
+private:
+	static constexpr int32_t s_nTotWords = static_cast<int32_t>((sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+	std::atomic<uint32_t> m_nSeq{0}; // odd while a writer is modifying the value
+	std::atomic<uint64_t> m_aWords[s_nTotWords];
+	std::mutex m_oWriterMutex;
+private:
+	SeqLock(const SeqLock& oSource) = delete;
+	SeqLock& operator=(const SeqLock& oSource) = delete;
+};
+
+template <typename T>
+constexpr int32_t SeqLock<T>::s_nTotWords;
+
+} // namespace fspf
+
+#endif /* FSPF_SEQ_LOCK_H */
@@ -23,10 +23,25 @@
 
 #include "fspropfaker.h"
 #include "fsutil.h"
+#include "fstrace.h"
+#include "logring.h"
 
 #include "testutil.h"
 
 #include <iostream>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <unordered_map>
+
+#include <fuse_common.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 namespace fspf
 {
@@ -80,8 +95,6 @@ TEST_CASE("PropFaker, testConstruct")
 	sError = refFaker->unmount();
 	REQUIRE(sError.empty());
 
-	::sleep(1);
-
 	REQUIRE(! fileExists(refFaker->getMountPath() + "/some.txt"));
 
 	REQUIRE(! fileExists(refFaker->getMountPath() + "/other.txt"));
@@ -148,6 +161,118 @@ TEST_CASE("PropFaker, testFakeSize")
 	//REQUIRE(oStatFs.f_blocks == nRealSizeInBlocks);
 }
 
+TEST_CASE("PropFaker, testFakeSizeConcurrent")
+{
+	const std::string sMountName = "fspf-conc";
+	const std::string sFsFolderPath = "/tmp/fspropfaker-conc/conc-base";
+	const std::string sMountPath = "/tmp/fspropfaker-conc/conc-mount";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd("rm -rf /tmp/fspropfaker-conc", sResult, sError);
+	REQUIRE(bOk);
+	makePath(sFsFolderPath);
+	makePath(sMountPath);
+
+	auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "");
+	auto& refFaker = oResult.m_refFaker;
+	sError = std::move(oResult.m_sError);
+	REQUIRE(refFaker);
+	REQUIRE(sError.empty());
+
+	refFaker->setFakeDiskSizeInBlocks(100);
+
+	// statfs must always see one of the values set, never a mix
+	std::atomic<bool> bStop{false};
+	std::thread oSetter([&]()
+	{
+		int64_t nSize = 100;
+		while (! bStop) {
+			nSize = ((nSize == 100) ? 200 : 100);
+			refFaker->setFakeDiskSizeInBlocks(nSize);
+			refFaker->setFakeDiskSizeDiffInBlocks(0);
+			refFaker->setFakeDiskSizeInBlocks(nSize);
+		}
+	});
+	int32_t nTotBad = 0;
+	for (int32_t nCount = 0; nCount < 2000; ++nCount) {
+		struct ::statvfs oStatFs;
+		sError = getStatVFS(refFaker->getMountPath(), oStatFs);
+		if (! sError.empty()) {
+			break;
+		}
+		if ((oStatFs.f_blocks != 100) && (oStatFs.f_blocks != 200)
+				&& (static_cast<int64_t>(oStatFs.f_blocks) != refFaker->getRealDiskSizeInBlocks())) {
+			++nTotBad;
+		}
+	}
+	bStop = true;
+	oSetter.join();
+	REQUIRE(sError.empty());
+	REQUIRE(nTotBad == 0);
+
+	sError = refFaker->unmount();
+	REQUIRE(sError.empty());
+}
+
+TEST_CASE("PropFaker, testRealStatsCache")
+{
+	const std::string sMountName = "fspf-cache";
+	const std::string sFsFolderPath = "/tmp/fspropfaker-cache/cache-base";
+	const std::string sMountPath = "/tmp/fspropfaker-cache/cache-mount";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd("rm -rf /tmp/fspropfaker-cache", sResult, sError);
+	REQUIRE(bOk);
+	makePath(sFsFolderPath);
+	makePath(sMountPath);
+
+	FsPropFaker::Options oOptions;
+	// the poller doesn't refresh during the test
+	oOptions.m_fRealStatsTTL = 3600.0;
+	auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "", oOptions);
+	auto& refFaker = oResult.m_refFaker;
+	sError = std::move(oResult.m_sError);
+	REQUIRE(refFaker);
+	REQUIRE(sError.empty());
+
+	const int64_t nRealSizeInBlocks = refFaker->getRealDiskSizeInBlocks();
+	REQUIRE(nRealSizeInBlocks > 0);
+
+	struct ::statvfs oStatFs;
+	sError = getStatVFS(refFaker->getMountPath(), oStatFs);
+	REQUIRE(sError.empty());
+	REQUIRE(static_cast<int64_t>(oStatFs.f_blocks) == nRealSizeInBlocks);
+	const int64_t nCachedFree = static_cast<int64_t>(oStatFs.f_bfree);
+
+	// use some space of the underlying file system behind the faker's back
+	constexpr off_t nAllocBytes = 64 * 1024 * 1024;
+	const int nFd = ::open((sFsFolderPath + "/big.bin").c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+	REQUIRE(nFd >= 0);
+	REQUIRE(::posix_fallocate(nFd, 0, nAllocBytes) == 0);
+	REQUIRE(::fsync(nFd) == 0);
+	REQUIRE(::close(nFd) == 0);
+	const int64_t nAllocBlocks = nAllocBytes / static_cast<int64_t>(oStatFs.f_frsize);
+
+	// within the TTL the cached value
+	sError = getStatVFS(refFaker->getMountPath(), oStatFs);
+	REQUIRE(sError.empty());
+	REQUIRE(static_cast<int64_t>(oStatFs.f_bfree) == nCachedFree);
+
+	// the new value once refreshed
+	refFaker->refreshRealStats();
+	sError = getStatVFS(refFaker->getMountPath(), oStatFs);
+	REQUIRE(sError.empty());
+	REQUIRE(nCachedFree - static_cast<int64_t>(oStatFs.f_bfree) >= nAllocBlocks / 2);
+
+	refFaker->setFakeDiskSizeInBlocks(100);
+	sError = getStatVFS(refFaker->getMountPath(), oStatFs);
+	REQUIRE(sError.empty());
+	REQUIRE(oStatFs.f_blocks == 100);
+
+	sError = refFaker->unmount();
+	REQUIRE(sError.empty());
+}
+
 TEST_CASE("PropFaker, testFakeFree")
 {
 	const std::string sMountName = "fspf-size";
@@ -194,6 +319,1086 @@ TEST_CASE("PropFaker, testFakeFree")
 	REQUIRE(oStatFs.f_bavail == 10);
 }
 
+#ifndef FSPROPFAKER_WITHOUT_LOGGING
+TEST_CASE("PropFaker, testRequestSizes")
+{
+	const std::string sMountName = "fspf-sizes";
+	const std::string sFsFolderPath = "/tmp/fspropfaker-sizes/sizes-base";
+	const std::string sMountPath = "/tmp/fspropfaker-sizes/sizes-mount";
+	const std::string sLogFilePath = "/tmp/fspropfaker-sizes/sizes.log";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd("rm -rf /tmp/fspropfaker-sizes", sResult, sError);
+	REQUIRE(bOk);
+	makePath(sFsFolderPath);
+	makePath(sMountPath);
+
+	FsPropFaker::Options oOptions;
+	oOptions.m_nMaxRead = 16 * 1024;
+	oOptions.m_nMaxWrite = 16 * 1024;
+	auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, sLogFilePath, oOptions);
+	auto& refFaker = oResult.m_refFaker;
+	sError = std::move(oResult.m_sError);
+	REQUIRE(refFaker);
+	REQUIRE(sError.empty());
+
+	const std::string sFilePath = refFaker->getMountPath() + "/sizes.bin";
+	std::vector<char> aData(256 * 1024);
+	for (size_t nIdx = 0; nIdx < aData.size(); ++nIdx) {
+		aData[nIdx] = static_cast<char>(nIdx % 251);
+	}
+	int nFd = ::open(sFilePath.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+	REQUIRE(nFd >= 0);
+	REQUIRE(::write(nFd, aData.data(), aData.size()) == static_cast<ssize_t>(aData.size()));
+	REQUIRE(::close(nFd) == 0);
+
+	std::vector<char> aRead(aData.size());
+	nFd = ::open(sFilePath.c_str(), O_RDONLY);
+	REQUIRE(nFd >= 0);
+	REQUIRE(::read(nFd, aRead.data(), aRead.size()) == static_cast<ssize_t>(aRead.size()));
+	REQUIRE(::close(nFd) == 0);
+	REQUIRE(aRead == aData);
+
+	sError = refFaker->unmount();
+	REQUIRE(sError.empty());
+	// flushes and closes the log
+	refFaker.reset();
+
+	bOk = execCmd((std::string{"cat "} + sLogFilePath).c_str(), sResult, sError);
+	REQUIRE(bOk);
+	// big_writes is on by default, the kernel splits the write at max_write
+	REQUIRE(getMaxLoggedSize(sResult, "over:write_buf(") == oOptions.m_nMaxWrite);
+	const int64_t nMaxReadSize = getMaxLoggedSize(sResult, "over:read_buf(");
+	REQUIRE(nMaxReadSize > 0);
+	REQUIRE(nMaxReadSize <= oOptions.m_nMaxRead);
+}
+#endif // FSPROPFAKER_WITHOUT_LOGGING
+
+TEST_CASE("PropFaker, testWorkerThreads")
+{
+	const std::string sMountName = "fspf-work";
+	const std::string sFsFolderPath = "/tmp/fspropfaker-work/work-base";
+	const std::string sMountPath = "/tmp/fspropfaker-work/work-mount";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd("rm -rf /tmp/fspropfaker-work", sResult, sError);
+	REQUIRE(bOk);
+	makePath(sFsFolderPath);
+	std::string sCmd = std::string{"touch "} + sFsFolderPath + "/some.txt";
+	bOk = execCmd(sCmd.c_str(), sResult, sError);
+	REQUIRE(bOk);
+	makePath(sMountPath);
+
+	FsPropFaker::Options oOptions;
+	oOptions.m_nWorkerThreads = 4;
+	auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "", oOptions);
+	auto& refFaker = oResult.m_refFaker;
+	sError = std::move(oResult.m_sError);
+	REQUIRE(refFaker);
+	REQUIRE(sError.empty());
+
+	REQUIRE(fileExists(refFaker->getMountPath() + "/some.txt"));
+
+	sError = refFaker->unmount();
+	REQUIRE(sError.empty());
+
+	REQUIRE(! fileExists(refFaker->getMountPath() + "/some.txt"));
+}
+
+TEST_CASE("PropFaker, testFallocate")
+{
+	const std::string sMountName = "fspf-falloc";
+	const std::string sFsFolderPath = "/tmp/fspropfaker-falloc/falloc-base";
+	const std::string sMountPath = "/tmp/fspropfaker-falloc/falloc-mount";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd("rm -rf /tmp/fspropfaker-falloc", sResult, sError);
+	REQUIRE(bOk);
+	makePath(sFsFolderPath);
+	makePath(sMountPath);
+
+	FsPropFaker::Options oOptions;
+	auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "", oOptions);
+	auto& refFaker = oResult.m_refFaker;
+	sError = std::move(oResult.m_sError);
+	REQUIRE(refFaker);
+	REQUIRE(sError.empty());
+
+	const std::string sFilePath = refFaker->getMountPath() + "/sparse.bin";
+	const std::string sBackingPath = sFsFolderPath + "/sparse.bin";
+	constexpr off_t nSize = 1024 * 1024;
+	const int nFd = ::open(sFilePath.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+	REQUIRE(nFd >= 0);
+	// preallocated by the underlying file system
+	REQUIRE(::fallocate(nFd, 0, 0, nSize) == 0);
+	struct ::stat oStat;
+	REQUIRE(::stat(sBackingPath.c_str(), &oStat) == 0);
+	REQUIRE(oStat.st_size == nSize);
+	REQUIRE(oStat.st_blocks * 512 >= nSize);
+	// the mode is passed on, the hole is punched into the backing file
+	REQUIRE(::fallocate(nFd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, nSize / 2, nSize / 2) == 0);
+	REQUIRE(::stat(sBackingPath.c_str(), &oStat) == 0);
+	REQUIRE(oStat.st_size == nSize);
+	REQUIRE(oStat.st_blocks * 512 < nSize);
+	#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+	// SEEK_HOLE finds the hole of the backing file instead of the end of the file
+	const int nBackingFd = ::open(sBackingPath.c_str(), O_RDONLY);
+	REQUIRE(nBackingFd >= 0);
+	const off_t nBackingHole = ::lseek(nBackingFd, 0, SEEK_HOLE);
+	REQUIRE(::close(nBackingFd) == 0);
+	REQUIRE(nBackingHole >= 0);
+	REQUIRE(::lseek(nFd, 0, SEEK_HOLE) == nBackingHole);
+	#endif
+	REQUIRE(::close(nFd) == 0);
+
+	sError = refFaker->unmount();
+	REQUIRE(sError.empty());
+}
+
+TEST_CASE("PropFaker, testCopyFileRange")
+{
+	const std::string sMountName = "fspf-copy";
+	const std::string sFsFolderPath = "/tmp/fspropfaker-copy/copy-base";
+	const std::string sMountPath = "/tmp/fspropfaker-copy/copy-mount";
+	const std::string sLogFilePath = "/tmp/fspropfaker-copy/copy.log";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd("rm -rf /tmp/fspropfaker-copy", sResult, sError);
+	REQUIRE(bOk);
+	makePath(sFsFolderPath);
+	makePath(sMountPath);
+
+	FsPropFaker::Options oOptions;
+	auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, sLogFilePath, oOptions);
+	auto& refFaker = oResult.m_refFaker;
+	sError = std::move(oResult.m_sError);
+	REQUIRE(refFaker);
+	REQUIRE(sError.empty());
+
+	const std::string& sMount = refFaker->getMountPath();
+	std::vector<char> aData(64 * 1024);
+	for (size_t nIdx = 0; nIdx < aData.size(); ++nIdx) {
+		aData[nIdx] = static_cast<char>(nIdx % 251);
+	}
+	int nFdIn = ::open((sMount + "/source.bin").c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+	REQUIRE(nFdIn >= 0);
+	REQUIRE(::write(nFdIn, aData.data(), aData.size()) == static_cast<ssize_t>(aData.size()));
+	const int nFdOut = ::open((sMount + "/copy.bin").c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+	REQUIRE(nFdOut >= 0);
+	loff_t nOffIn = 0;
+	loff_t nOffOut = 0;
+	size_t nTotCopied = 0;
+	while (nTotCopied < aData.size()) {
+		const ssize_t nCopied = ::copy_file_range(nFdIn, &nOffIn, nFdOut, &nOffOut, aData.size() - nTotCopied, 0);
+		REQUIRE(nCopied > 0);
+		nTotCopied += static_cast<size_t>(nCopied);
+	}
+	REQUIRE(::close(nFdOut) == 0);
+	REQUIRE(::close(nFdIn) == 0);
+
+	std::vector<char> aRead(aData.size());
+	nFdIn = ::open((sFsFolderPath + "/copy.bin").c_str(), O_RDONLY);
+	REQUIRE(nFdIn >= 0);
+	REQUIRE(::read(nFdIn, aRead.data(), aRead.size()) == static_cast<ssize_t>(aRead.size()));
+	REQUIRE(::close(nFdIn) == 0);
+	REQUIRE(aRead == aData);
+
+	sError = refFaker->unmount();
+	REQUIRE(sError.empty());
+	// flushes and closes the log
+	refFaker.reset();
+
+	#if (FUSE_VERSION >= FUSE_MAKE_VERSION(3, 4)) && ! defined(FSPROPFAKER_WITHOUT_LOGGING)
+	// the copy was delegated to the backing files, not done with reads and writes
+	bOk = execCmd((std::string{"cat "} + sLogFilePath).c_str(), sResult, sError);
+	REQUIRE(bOk);
+	REQUIRE(sResult.find("over:copy_file_range(path_in=\"/source.bin\"") != std::string::npos);
+	REQUIRE(sResult.find("over:read_buf(path=\"/source.bin\"") == std::string::npos);
+	#endif
+}
+
+TEST_CASE("PropFaker, testUtimens")
+{
+	const std::string sMountName = "fspf-time";
+	const std::string sFsFolderPath = "/tmp/fspropfaker-time/time-base";
+	const std::string sMountPath = "/tmp/fspropfaker-time/time-mount";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd("rm -rf /tmp/fspropfaker-time", sResult, sError);
+	REQUIRE(bOk);
+	makePath(sFsFolderPath);
+	std::string sCmd = std::string{"touch "} + sFsFolderPath + "/some.txt";
+	bOk = execCmd(sCmd.c_str(), sResult, sError);
+	REQUIRE(bOk);
+	makePath(sMountPath);
+
+	auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "");
+	auto& refFaker = oResult.m_refFaker;
+	sError = std::move(oResult.m_sError);
+	REQUIRE(refFaker);
+	REQUIRE(sError.empty());
+
+	const std::string sMountFilePath = refFaker->getMountPath() + "/some.txt";
+	struct ::timespec aTimes[2];
+	aTimes[0].tv_sec = 0;
+	aTimes[0].tv_nsec = UTIME_OMIT;
+	aTimes[1].tv_sec = 1600000000;
+	aTimes[1].tv_nsec = 123456789;
+	REQUIRE(::utimensat(AT_FDCWD, sMountFilePath.c_str(), aTimes, 0) == 0);
+
+	struct ::stat oStat;
+	REQUIRE(::stat((sFsFolderPath + "/some.txt").c_str(), &oStat) == 0);
+	REQUIRE(oStat.st_mtim.tv_sec == 1600000000);
+	REQUIRE(oStat.st_mtim.tv_nsec == 123456789);
+
+	sError = refFaker->unmount();
+	REQUIRE(sError.empty());
+}
+
+TEST_CASE("PropFaker, testReaddirTypes")
+{
+	const std::string sMountName = "fspf-dir";
+	const std::string sFsFolderPath = "/tmp/fspropfaker-dir/dir-base";
+	const std::string sMountPath = "/tmp/fspropfaker-dir/dir-mount";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd("rm -rf /tmp/fspropfaker-dir", sResult, sError);
+	REQUIRE(bOk);
+	makePath(sFsFolderPath + "/sub");
+	std::string sCmd = std::string{"touch "} + sFsFolderPath + "/some.txt";
+	bOk = execCmd(sCmd.c_str(), sResult, sError);
+	REQUIRE(bOk);
+	makePath(sMountPath);
+
+	auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "");
+	auto& refFaker = oResult.m_refFaker;
+	sError = std::move(oResult.m_sError);
+	REQUIRE(refFaker);
+	REQUIRE(sError.empty());
+
+	DIR* p0Dir = ::opendir(refFaker->getMountPath().c_str());
+	REQUIRE(p0Dir != nullptr);
+	int32_t nFound = 0;
+	struct dirent* p0Entry;
+	while ((p0Entry = ::readdir(p0Dir)) != nullptr) {
+		const std::string sName = p0Entry->d_name;
+		if (sName == "sub") {
+			REQUIRE(p0Entry->d_type == DT_DIR);
+			++nFound;
+		} else if (sName == "some.txt") {
+			REQUIRE(p0Entry->d_type == DT_REG);
+			++nFound;
+		}
+	}
+	::closedir(p0Dir);
+	REQUIRE(nFound == 2);
+
+	sError = refFaker->unmount();
+	REQUIRE(sError.empty());
+}
+
+TEST_CASE("PropFaker, testReaddirLarge")
+{
+	const std::string sMountName = "fspf-large";
+	const std::string sFsFolderPath = "/tmp/fspropfaker-large/large-base";
+	const std::string sMountPath = "/tmp/fspropfaker-large/large-mount";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd("rm -rf /tmp/fspropfaker-large", sResult, sError);
+	REQUIRE(bOk);
+	makePath(sFsFolderPath);
+	// many more entries than fit in one readdir buffer
+	const int32_t nTotFiles = 5000;
+	std::string sCmd = std::string{"cd "} + sFsFolderPath + " && seq -f 'file%06g.txt' 1 " + std::to_string(nTotFiles)
+						+ " | xargs touch";
+	bOk = execCmd(sCmd.c_str(), sResult, sError);
+	REQUIRE(bOk);
+	makePath(sMountPath);
+
+	auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "");
+	auto& refFaker = oResult.m_refFaker;
+	sError = std::move(oResult.m_sError);
+	REQUIRE(refFaker);
+	REQUIRE(sError.empty());
+
+	DIR* p0Dir = ::opendir(refFaker->getMountPath().c_str());
+	REQUIRE(p0Dir != nullptr);
+	int32_t nFound = 0;
+	while (::readdir(p0Dir) != nullptr) {
+		++nFound;
+	}
+	// after a rewind the whole directory is listed again
+	::rewinddir(p0Dir);
+	int32_t nFoundAgain = 0;
+	while (::readdir(p0Dir) != nullptr) {
+		++nFoundAgain;
+	}
+	::closedir(p0Dir);
+	REQUIRE(nFound == nTotFiles + 2);
+	REQUIRE(nFoundAgain == nTotFiles + 2);
+
+	sError = refFaker->unmount();
+	REQUIRE(sError.empty());
+}
+
+TEST_CASE("PropFaker, testUnmountOpenFile")
+{
+	const std::string sMountName = "fspf-umount";
+	const std::string sFsFolderPath = "/tmp/fspropfaker-umount/umount-base";
+	const std::string sMountPath = "/tmp/fspropfaker-umount/umount-mount";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd("rm -rf /tmp/fspropfaker-umount", sResult, sError);
+	REQUIRE(bOk);
+	makePath(sFsFolderPath);
+	std::string sCmd = std::string{"touch "} + sFsFolderPath + "/some.txt";
+	bOk = execCmd(sCmd.c_str(), sResult, sError);
+	REQUIRE(bOk);
+	makePath(sMountPath);
+
+	auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "");
+	auto& refFaker = oResult.m_refFaker;
+	sError = std::move(oResult.m_sError);
+	REQUIRE(refFaker);
+	REQUIRE(sError.empty());
+
+	const int nFd = ::open((refFaker->getMountPath() + "/some.txt").c_str(), O_RDONLY);
+	REQUIRE(nFd >= 0);
+
+	// the open file keeps the file system alive until the connection is aborted
+	const auto oUnmountResult = refFaker->unmount(200);
+	::close(nFd);
+	REQUIRE(! oUnmountResult.m_sError.empty());
+	REQUIRE(oUnmountResult.m_aOpenPaths.size() == 1);
+	REQUIRE(oUnmountResult.m_aOpenPaths[0] == "/some.txt");
+
+	REQUIRE(! fileExists(refFaker->getMountPath() + "/some.txt"));
+}
+
+TEST_CASE("PropFaker, testSharedDispatcher")
+{
+	const std::string sBasePath = "/tmp/fspropfaker-disp";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd(("rm -rf " + sBasePath).c_str(), sResult, sError);
+	REQUIRE(bOk);
+
+	auto oDispResult = FsDispatcher::create(2);
+	REQUIRE(oDispResult.m_refDispatcher);
+	REQUIRE(oDispResult.m_sError.empty());
+	FsPropFaker::Options oOptions;
+	oOptions.m_refDispatcher = oDispResult.m_refDispatcher;
+
+	constexpr int32_t nTotFakers = 4;
+	std::vector<unique_ptr<FsPropFaker>> aFakers;
+	for (int32_t nIdx = 0; nIdx < nTotFakers; ++nIdx) {
+		const std::string sIdx = std::to_string(nIdx);
+		const std::string sFsFolderPath = sBasePath + "/base" + sIdx;
+		const std::string sMountPath = sBasePath + "/mount" + sIdx;
+		makePath(sFsFolderPath);
+		makePath(sMountPath);
+		bOk = execCmd(("touch " + sFsFolderPath + "/file" + sIdx + ".txt").c_str(), sResult, sError);
+		REQUIRE(bOk);
+		auto oResult = FsPropFaker::create("fspf-disp" + sIdx, sFsFolderPath, sMountPath, "", oOptions);
+		REQUIRE(oResult.m_refFaker);
+		REQUIRE(oResult.m_sError.empty());
+		oResult.m_refFaker->setFakeDiskSizeInBlocks(100 + nIdx);
+		aFakers.push_back(std::move(oResult.m_refFaker));
+	}
+	REQUIRE(oDispResult.m_refDispatcher->getTotSessions() == nTotFakers);
+
+	for (int32_t nIdx = 0; nIdx < nTotFakers; ++nIdx) {
+		auto& refFaker = aFakers[nIdx];
+		const std::string sIdx = std::to_string(nIdx);
+		REQUIRE(fileExists(refFaker->getMountPath() + "/file" + sIdx + ".txt"));
+		struct ::statvfs oStatFs;
+		sError = getStatVFS(refFaker->getMountPath(), oStatFs);
+		REQUIRE(sError.empty());
+		REQUIRE(oStatFs.f_blocks == static_cast<fsblkcnt_t>(100 + nIdx));
+	}
+
+	for (int32_t nIdx = 0; nIdx < nTotFakers; ++nIdx) {
+		auto& refFaker = aFakers[nIdx];
+		sError = refFaker->unmount();
+		REQUIRE(sError.empty());
+		REQUIRE(! fileExists(refFaker->getMountPath() + "/file" + std::to_string(nIdx) + ".txt"));
+	}
+	REQUIRE(oDispResult.m_refDispatcher->getTotSessions() == 0);
+}
+
+TEST_CASE("PropFaker, testLowLevel")
+{
+	const std::string sMountName = "fspf-low";
+	const std::string sFsFolderPath = "/tmp/fspropfaker-low/low-base";
+	const std::string sMountPath = "/tmp/fspropfaker-low/low-mount";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd("rm -rf /tmp/fspropfaker-low", sResult, sError);
+	REQUIRE(bOk);
+	makePath(sFsFolderPath + "/sub");
+	std::string sCmd = std::string{"touch "} + sFsFolderPath + "/sub/some.txt";
+	bOk = execCmd(sCmd.c_str(), sResult, sError);
+	REQUIRE(bOk);
+	makePath(sMountPath);
+
+	FsPropFaker::Options oOptions;
+	oOptions.m_bLowLevel = true;
+	auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "", oOptions);
+	auto& refFaker = oResult.m_refFaker;
+	sError = std::move(oResult.m_sError);
+	REQUIRE(refFaker);
+	REQUIRE(sError.empty());
+
+	const std::string& sMount = refFaker->getMountPath();
+	REQUIRE(fileExists(sMount + "/sub/some.txt"));
+
+	const std::string sNewFilePath = sMount + "/sub/new.txt";
+	const int nFd = ::open(sNewFilePath.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+	REQUIRE(nFd >= 0);
+	REQUIRE(::write(nFd, "hello", 5) == 5);
+	REQUIRE(::close(nFd) == 0);
+	REQUIRE(::rename(sNewFilePath.c_str(), (sMount + "/renamed.txt").c_str()) == 0);
+
+	struct ::stat oStat;
+	REQUIRE(::stat((sFsFolderPath + "/renamed.txt").c_str(), &oStat) == 0);
+	REQUIRE(oStat.st_size == 5);
+	REQUIRE(::stat((sMount + "/renamed.txt").c_str(), &oStat) == 0);
+	REQUIRE(oStat.st_size == 5);
+
+	DIR* p0Dir = ::opendir((sMount + "/sub").c_str());
+	REQUIRE(p0Dir != nullptr);
+	int32_t nFound = 0;
+	struct dirent* p0Entry;
+	while ((p0Entry = ::readdir(p0Dir)) != nullptr) {
+		if (std::string(p0Entry->d_name) == "some.txt") {
+			REQUIRE(p0Entry->d_type == DT_REG);
+			++nFound;
+		}
+	}
+	::closedir(p0Dir);
+	REQUIRE(nFound == 1);
+
+	refFaker->setFakeDiskSizeInBlocks(1000);
+	struct ::statvfs oStatFs;
+	sError = getStatVFS(sMount, oStatFs);
+	REQUIRE(sError.empty());
+	REQUIRE(oStatFs.f_blocks == 1000);
+
+	sError = refFaker->unmount();
+	REQUIRE(sError.empty());
+
+	REQUIRE(! fileExists(sMount + "/renamed.txt"));
+}
+
+#ifndef FSPROPFAKER_WITHOUT_LOGGING
+TEST_CASE("PropFaker, testLowLevelFlush")
+{
+	const std::string sMountName = "fspf-lowflush";
+	const std::string sFsFolderPath = "/tmp/fspropfaker-lowflush/lowflush-base";
+	const std::string sMountPath = "/tmp/fspropfaker-lowflush/lowflush-mount";
+	const std::string sLogFilePath = "/tmp/fspropfaker-lowflush/lowflush.log";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd("rm -rf /tmp/fspropfaker-lowflush", sResult, sError);
+	REQUIRE(bOk);
+	makePath(sFsFolderPath);
+	makePath(sMountPath);
+
+	FsPropFaker::Options oOptions;
+	oOptions.m_bLowLevel = true;
+	auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, sLogFilePath, oOptions);
+	auto& refFaker = oResult.m_refFaker;
+	sError = std::move(oResult.m_sError);
+	REQUIRE(refFaker);
+	REQUIRE(sError.empty());
+
+	const std::string& sMount = refFaker->getMountPath();
+	// opened read only, then again writable
+	int nFd = ::open((sMount + "/flushed.txt").c_str(), O_CREAT | O_RDONLY, 0644);
+	REQUIRE(nFd >= 0);
+	REQUIRE(::close(nFd) == 0);
+	nFd = ::open((sMount + "/flushed.txt").c_str(), O_WRONLY | O_TRUNC);
+	REQUIRE(nFd >= 0);
+	REQUIRE(::write(nFd, "hello", 5) == 5);
+	REQUIRE(::close(nFd) == 0);
+
+	struct ::stat oStat;
+	REQUIRE(::stat((sFsFolderPath + "/flushed.txt").c_str(), &oStat) == 0);
+	REQUIRE(oStat.st_size == 5);
+
+	sError = refFaker->unmount();
+	REQUIRE(sError.empty());
+	// flushes and closes the log
+	refFaker.reset();
+
+	bOk = execCmd((std::string{"cat "} + sLogFilePath).c_str(), sResult, sError);
+	REQUIRE(bOk);
+	// the close of the writable descriptor reached the backing file
+	REQUIRE(sResult.find("low:flush(") != std::string::npos);
+	REQUIRE(sResult.find("low:flush close") == std::string::npos);
+}
+#endif // FSPROPFAKER_WITHOUT_LOGGING
+
+TEST_CASE("PropFaker, testLargeRequests")
+{
+	const std::string sMountName = "fspf-large";
+	const std::string sFsFolderPath = "/tmp/fspropfaker-large/large-base";
+	const std::string sMountPath = "/tmp/fspropfaker-large/large-mount";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd("rm -rf /tmp/fspropfaker-large", sResult, sError);
+	REQUIRE(bOk);
+	makePath(sFsFolderPath);
+	makePath(sMountPath);
+
+	FsPropFaker::Options oOptions;
+	oOptions.m_nMaxWrite = 1024 * 1024;
+	#if FUSE_USE_VERSION < 35
+	auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "", oOptions);
+	REQUIRE(! oResult.m_refFaker);
+	REQUIRE(! oResult.m_sError.empty());
+	#else
+	for (const bool bLowLevel : {false, true}) {
+		oOptions.m_bLowLevel = bLowLevel;
+		const std::string sLogFilePath = std::string{"/tmp/fspropfaker-large/large-"} + (bLowLevel ? "low" : "over") + ".log";
+		auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, sLogFilePath, oOptions);
+		auto& refFaker = oResult.m_refFaker;
+		sError = std::move(oResult.m_sError);
+		REQUIRE(refFaker);
+		REQUIRE(sError.empty());
+
+		const std::string sFilePath = refFaker->getMountPath() + "/big.bin";
+		std::vector<char> aData(4 * 1024 * 1024);
+		for (size_t nIdx = 0; nIdx < aData.size(); ++nIdx) {
+			aData[nIdx] = static_cast<char>(nIdx % 251);
+		}
+		int nFd = ::open(sFilePath.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+		REQUIRE(nFd >= 0);
+		REQUIRE(::write(nFd, aData.data(), aData.size()) == static_cast<ssize_t>(aData.size()));
+		REQUIRE(::close(nFd) == 0);
+
+		std::vector<char> aRead(aData.size());
+		nFd = ::open(sFilePath.c_str(), O_RDONLY);
+		REQUIRE(nFd >= 0);
+		size_t nTotRead = 0;
+		while (nTotRead < aRead.size()) {
+			const ssize_t nRead = ::read(nFd, aRead.data() + nTotRead, aRead.size() - nTotRead);
+			REQUIRE(nRead > 0);
+			nTotRead += static_cast<size_t>(nRead);
+		}
+		REQUIRE(::close(nFd) == 0);
+		REQUIRE(aRead == aData);
+
+		sError = refFaker->unmount();
+		REQUIRE(sError.empty());
+		// flushes and closes the log
+		refFaker.reset();
+
+		#ifndef FSPROPFAKER_WITHOUT_LOGGING
+		// the kernel sent write requests bigger than the 128 KiB of libfuse 2,
+		// the size was negotiated and didn't fall back
+		bOk = execCmd((std::string{"cat "} + sLogFilePath).c_str(), sResult, sError);
+		REQUIRE(bOk);
+		const int64_t nMaxWriteSize = getMaxLoggedSize(sResult, (bLowLevel ? "low:write_buf(" : "over:write_buf("));
+		REQUIRE(nMaxWriteSize > 128 * 1024);
+		REQUIRE(nMaxWriteSize <= oOptions.m_nMaxWrite);
+		#endif
+	}
+	#endif
+}
+
+TEST_CASE("PropFaker, testIoUring")
+{
+	const std::string sMountName = "fspf-uring";
+	const std::string sFsFolderPath = "/tmp/fspropfaker-uring/uring-base";
+	const std::string sMountPath = "/tmp/fspropfaker-uring/uring-mount";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd("rm -rf /tmp/fspropfaker-uring", sResult, sError);
+	REQUIRE(bOk);
+	makePath(sFsFolderPath);
+	makePath(sMountPath);
+
+	FsPropFaker::Options oOptions;
+	oOptions.m_bIoUring = true;
+	auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "", oOptions);
+	REQUIRE(! oResult.m_refFaker);
+	REQUIRE(! oResult.m_sError.empty());
+
+	#ifdef FSPROPFAKER_WITH_IO_URING
+	oOptions.m_bLowLevel = true;
+	oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "", oOptions);
+	auto& refFaker = oResult.m_refFaker;
+	sError = std::move(oResult.m_sError);
+	REQUIRE(refFaker);
+	REQUIRE(sError.empty());
+
+	const std::string& sMount = refFaker->getMountPath();
+	constexpr int32_t nTotThreads = 4;
+	constexpr int32_t nTotBlocks = 64;
+	std::atomic<int32_t> nFailed{0};
+	std::vector<std::thread> aThreads;
+	for (int32_t nThread = 0; nThread < nTotThreads; ++nThread) {
+		aThreads.emplace_back([&, nThread]()
+		{
+			const std::string sFilePath = sMount + "/file" + std::to_string(nThread);
+			const int nFd = ::open(sFilePath.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+			if (nFd < 0) {
+				++nFailed;
+				return; //------------------------------------------------------
+			}
+			std::vector<char> aBlock(4096, static_cast<char>('a' + nThread));
+			for (int32_t nBlock = 0; nBlock < nTotBlocks; ++nBlock) {
+				if (::pwrite(nFd, aBlock.data(), aBlock.size(), nBlock * 4096) != 4096) {
+					++nFailed;
+				}
+			}
+			if (::fdatasync(nFd) != 0) {
+				++nFailed;
+			}
+			std::vector<char> aRead(4096);
+			for (int32_t nBlock = 0; nBlock < nTotBlocks; ++nBlock) {
+				if ((::pread(nFd, aRead.data(), aRead.size(), nBlock * 4096) != 4096) || (aRead != aBlock)) {
+					++nFailed;
+				}
+			}
+			if (::close(nFd) != 0) {
+				++nFailed;
+			}
+		});
+	}
+	for (auto& oThread : aThreads) {
+		oThread.join();
+	}
+	REQUIRE(nFailed == 0);
+
+	struct ::stat oStat;
+	REQUIRE(::stat((sFsFolderPath + "/file0").c_str(), &oStat) == 0);
+	REQUIRE(oStat.st_size == nTotBlocks * 4096);
+
+	sError = refFaker->unmount();
+	REQUIRE(sError.empty());
+	#endif
+}
+
+TEST_CASE("PropFaker, testWritebackCache")
+{
+	const std::string sMountName = "fspf-wb";
+	const std::string sFsFolderPath = "/tmp/fspropfaker-wb/wb-base";
+	const std::string sMountPath = "/tmp/fspropfaker-wb/wb-mount";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd("rm -rf /tmp/fspropfaker-wb", sResult, sError);
+	REQUIRE(bOk);
+	makePath(sFsFolderPath);
+	makePath(sMountPath);
+
+	FsPropFaker::Options oOptions;
+	oOptions.m_bWritebackCache = true;
+	#if FUSE_USE_VERSION < 35
+	auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "", oOptions);
+	REQUIRE(! oResult.m_refFaker);
+	REQUIRE(! oResult.m_sError.empty());
+	#else
+	for (const bool bLowLevel : {false, true}) {
+		oOptions.m_bLowLevel = bLowLevel;
+		auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "", oOptions);
+		auto& refFaker = oResult.m_refFaker;
+		sError = std::move(oResult.m_sError);
+		REQUIRE(refFaker);
+		REQUIRE(sError.empty());
+
+		const std::string sFilePath = refFaker->getMountPath() + "/log.txt";
+		// many small appends
+		int nFd = ::open(sFilePath.c_str(), O_CREAT | O_WRONLY | O_APPEND | O_TRUNC, 0644);
+		REQUIRE(nFd >= 0);
+		for (int32_t nLine = 0; nLine < 1000; ++nLine) {
+			REQUIRE(::write(nFd, "0123456789\n", 11) == 11);
+		}
+		REQUIRE(::close(nFd) == 0);
+
+		struct ::stat oStat;
+		REQUIRE(::stat((sFsFolderPath + "/log.txt").c_str(), &oStat) == 0);
+		REQUIRE(oStat.st_size == 11000);
+
+		// a partial page written through a write only file
+		nFd = ::open(sFilePath.c_str(), O_WRONLY);
+		REQUIRE(nFd >= 0);
+		REQUIRE(::pwrite(nFd, "ab", 2, 5) == 2);
+		REQUIRE(::close(nFd) == 0);
+
+		nFd = ::open((sFsFolderPath + "/log.txt").c_str(), O_RDONLY);
+		REQUIRE(nFd >= 0);
+		char aBuf[12];
+		REQUIRE(::read(nFd, aBuf, 11) == 11);
+		REQUIRE(std::string(aBuf, 11) == "01234ab789\n");
+		REQUIRE(::close(nFd) == 0);
+		REQUIRE(::stat((sFsFolderPath + "/log.txt").c_str(), &oStat) == 0);
+		REQUIRE(oStat.st_size == 11000);
+
+		sError = refFaker->unmount();
+		REQUIRE(sError.empty());
+	}
+	#endif
+}
+
+TEST_CASE("PropFaker, testPassthrough")
+{
+	const std::string sMountName = "fspf-pass";
+	const std::string sFsFolderPath = "/tmp/fspropfaker-pass/pass-base";
+	const std::string sMountPath = "/tmp/fspropfaker-pass/pass-mount";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd("rm -rf /tmp/fspropfaker-pass", sResult, sError);
+	REQUIRE(bOk);
+	makePath(sFsFolderPath);
+	makePath(sMountPath);
+
+	FsPropFaker::Options oOptions;
+	oOptions.m_bPassthrough = true;
+	auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "", oOptions);
+	REQUIRE(! oResult.m_refFaker);
+	REQUIRE(! oResult.m_sError.empty());
+
+	#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 16)
+	// whether the kernel accepts it or not the data must be the same
+	oOptions.m_bLowLevel = true;
+	oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "", oOptions);
+	auto& refFaker = oResult.m_refFaker;
+	sError = std::move(oResult.m_sError);
+	REQUIRE(refFaker);
+	REQUIRE(sError.empty());
+
+	const std::string sFilePath = refFaker->getMountPath() + "/pass.txt";
+	int nFd = ::open(sFilePath.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+	REQUIRE(nFd >= 0);
+	REQUIRE(::write(nFd, "passthrough", 11) == 11);
+	char aBuf[16];
+	REQUIRE(::pread(nFd, aBuf, sizeof(aBuf), 4) == 7);
+	REQUIRE(std::string(aBuf, 7) == "through");
+	REQUIRE(::close(nFd) == 0);
+
+	struct ::stat oStat;
+	REQUIRE(::stat((sFsFolderPath + "/pass.txt").c_str(), &oStat) == 0);
+	REQUIRE(oStat.st_size == 11);
+
+	refFaker->setFakeDiskSizeInBlocks(1000);
+	struct ::statvfs oStatFs;
+	sError = getStatVFS(refFaker->getMountPath(), oStatFs);
+	REQUIRE(sError.empty());
+	REQUIRE(oStatFs.f_blocks == 1000);
+
+	sError = refFaker->unmount();
+	REQUIRE(sError.empty());
+	#endif
+}
+
+TEST_CASE("PropFaker, testLogRing")
+{
+	LogRing oRing(1024);
+	constexpr int32_t nTotThreads = 4;
+	constexpr int32_t nTotRecords = 5000;
+	// a record spanning several slots
+	const std::string sLong(300, 'x');
+	std::atomic<bool> bProducing{true};
+	std::string sOut;
+	std::thread oConsumer([&]()
+	{
+		while (bProducing) {
+			oRing.popAll(sOut);
+		}
+		oRing.popAll(sOut);
+	});
+	std::vector<std::thread> aProducers;
+	for (int32_t nThread = 0; nThread < nTotThreads; ++nThread) {
+		aProducers.emplace_back([&, nThread]()
+		{
+			for (int32_t nRecord = 0; nRecord < nTotRecords; ++nRecord) {
+				std::string sRecord = std::to_string(nThread) + ":" + std::to_string(nRecord);
+				if (nRecord % 100 == 0) {
+					sRecord += sLong;
+				}
+				sRecord += "\n";
+				while (! oRing.tryPush(sRecord.data(), sRecord.size())) {
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+	for (auto& oThread : aProducers) {
+		oThread.join();
+	}
+	bProducing = false;
+	oConsumer.join();
+
+	// each thread's records complete and in order
+	std::vector<int32_t> aNext(nTotThreads, 0);
+	size_t nStart = 0;
+	while (nStart < sOut.size()) {
+		const size_t nEnd = sOut.find('\n', nStart);
+		REQUIRE(nEnd != std::string::npos);
+		const std::string sRecord = sOut.substr(nStart, nEnd - nStart);
+		const size_t nColon = sRecord.find(':');
+		REQUIRE(nColon != std::string::npos);
+		const int32_t nThread = std::stoi(sRecord.substr(0, nColon));
+		REQUIRE(((nThread >= 0) && (nThread < nTotThreads)));
+		const int32_t nRecord = aNext[nThread]++;
+		std::string sExpected = std::to_string(nRecord);
+		if (nRecord % 100 == 0) {
+			sExpected += sLong;
+		}
+		REQUIRE(sRecord.substr(nColon + 1) == sExpected);
+		nStart = nEnd + 1;
+	}
+	for (int32_t nThread = 0; nThread < nTotThreads; ++nThread) {
+		REQUIRE(aNext[nThread] == nTotRecords);
+	}
+}
+
+#ifndef FSPROPFAKER_WITHOUT_LOGGING
+TEST_CASE("PropFaker, testBinaryTrace")
+{
+	const std::string sMountName = "fspf-trace";
+	const std::string sFsFolderPath = "/tmp/fspropfaker-trace/trace-base";
+	const std::string sMountPath = "/tmp/fspropfaker-trace/trace-mount";
+	const std::string sLogFilePath = "/tmp/fspropfaker-trace/trace.bin";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd("rm -rf /tmp/fspropfaker-trace", sResult, sError);
+	REQUIRE(bOk);
+	makePath(sFsFolderPath);
+	makePath(sMountPath);
+
+	FsPropFaker::Options oOptions;
+	oOptions.m_bBinaryTrace = true;
+	auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, sLogFilePath, oOptions);
+	auto& refFaker = oResult.m_refFaker;
+	sError = std::move(oResult.m_sError);
+	REQUIRE(refFaker);
+	REQUIRE(sError.empty());
+
+	const std::string& sMount = refFaker->getMountPath();
+	const std::string sNewFilePath = sMount + "/new.txt";
+	int nFd = ::open(sNewFilePath.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+	REQUIRE(nFd >= 0);
+	REQUIRE(::write(nFd, "hello", 5) == 5);
+	REQUIRE(::close(nFd) == 0);
+	REQUIRE(::rename(sNewFilePath.c_str(), (sMount + "/renamed.txt").c_str()) == 0);
+	struct ::stat oStat;
+	REQUIRE(::stat((sMount + "/missing.txt").c_str(), &oStat) != 0);
+
+	sError = refFaker->unmount();
+	REQUIRE(sError.empty());
+	// flushes and closes the trace
+	refFaker.reset();
+
+	FILE* p0File = ::fopen(sLogFilePath.c_str(), "rb");
+	REQUIRE(p0File != nullptr);
+	TraceHeader oHeader;
+	REQUIRE(::fread(&oHeader, sizeof(oHeader), 1, p0File) == 1);
+	REQUIRE(::memcmp(oHeader.m_aMagic, s_aTraceMagic, sizeof(oHeader.m_aMagic)) == 0);
+	REQUIRE(oHeader.m_nVersion == s_nTraceVersion);
+	REQUIRE(oHeader.m_nRecordSize == sizeof(TraceRecord));
+	REQUIRE(oHeader.m_nBackend == TRACE_BACKEND_OVER);
+	REQUIRE(std::string(oHeader.m_aMountName) == sMountName);
+
+	std::unordered_map<uint32_t, std::string> oPaths;
+	std::vector<TraceRecord> aOps;
+	TraceRecord oRecord;
+	while (::fread(&oRecord, sizeof(oRecord), 1, p0File) == 1) {
+		if (oRecord.m_nType == TRACE_RECORD_TYPE_PATH) {
+			const size_t nLen = static_cast<size_t>(oRecord.m_nResult);
+			const size_t nPaddedLen = (nLen + sizeof(TraceRecord) - 1) / sizeof(TraceRecord) * sizeof(TraceRecord);
+			std::vector<char> aPath(nPaddedLen);
+			REQUIRE(::fread(aPath.data(), nPaddedLen, 1, p0File) == 1);
+			// a path is stored once
+			REQUIRE(oPaths.find(oRecord.m_nPathId) == oPaths.end());
+			oPaths[oRecord.m_nPathId] = std::string(aPath.data(), nLen);
+		} else {
+			REQUIRE(oRecord.m_nType == TRACE_RECORD_TYPE_OP);
+			// the path is defined before it is used
+			REQUIRE(((oRecord.m_nPathId == 0) || (oPaths.find(oRecord.m_nPathId) != oPaths.end())));
+			REQUIRE(((oRecord.m_nPath2Id == 0) || (oPaths.find(oRecord.m_nPath2Id) != oPaths.end())));
+			aOps.push_back(oRecord);
+		}
+	}
+	::fclose(p0File);
+
+	// a record is written when the op ends, the ops can overlap
+	// (ex. the release after close), the order of the start times is undefined
+	bool bCreated = false;
+	bool bWritten = false;
+	bool bRenamed = false;
+	bool bMissing = false;
+	for (const auto& oOp : aOps) {
+		REQUIRE(oOp.m_nOp < TRACE_OP_TOT);
+		const std::string sPath = ((oOp.m_nPathId != 0) ? oPaths[oOp.m_nPathId] : "");
+		if ((oOp.m_nOp == TRACE_OP_CREATE) && (sPath == "/new.txt")) {
+			REQUIRE(oOp.m_nResult == 0);
+			REQUIRE((oOp.m_aArgs[0] & 0777) == 0644);
+			bCreated = true;
+		} else if ((oOp.m_nOp == TRACE_OP_WRITE) && (sPath == "/new.txt")) {
+			REQUIRE(oOp.m_aArgs[0] == 5);
+			REQUIRE(oOp.m_aArgs[1] == 0);
+			REQUIRE(oOp.m_nResult >= 0);
+			REQUIRE(oOp.m_nPid == static_cast<uint32_t>(::getpid()));
+			bWritten = true;
+		} else if ((oOp.m_nOp == TRACE_OP_RENAME) && (sPath == "/new.txt")) {
+			REQUIRE(oPaths[oOp.m_nPath2Id] == "/renamed.txt");
+			REQUIRE(oOp.m_nResult == 0);
+			bRenamed = true;
+		} else if ((oOp.m_nOp == TRACE_OP_GETATTR) && (sPath == "/missing.txt")) {
+			REQUIRE(oOp.m_nResult == -ENOENT);
+			bMissing = true;
+		}
+	}
+	REQUIRE(bCreated);
+	REQUIRE(bWritten);
+	REQUIRE(bRenamed);
+	REQUIRE(bMissing);
+
+	// the decoder reproduces the records in the order of the file
+	const std::string sTool = FSPROPFAKER_TRACE_TOOL;
+	bOk = execCmd((sTool + " --csv " + sLogFilePath).c_str(), sResult, sError);
+	REQUIRE(bOk);
+	std::string sExpected = "time_ns,duration_ns,thread,pid,op,ino,path,ino2,path2,arg0,arg1,arg2,result\n";
+	for (const auto& oOp : aOps) {
+		sExpected += std::to_string(oOp.m_nTimeNs) + "," + std::to_string(oOp.m_nDurationNs)
+					+ "," + std::to_string(oOp.m_nThread) + "," + std::to_string(oOp.m_nPid)
+					+ "," + getTraceOpInfo(oOp.m_nOp).m_p0Name + "," + std::to_string(oOp.m_nIno)
+					+ "," + ((oOp.m_nPathId != 0) ? oPaths[oOp.m_nPathId] : "")
+					+ "," + std::to_string(oOp.m_nIno2) + "," + ((oOp.m_nPath2Id != 0) ? oPaths[oOp.m_nPath2Id] : "")
+					+ "," + std::to_string(oOp.m_aArgs[0]) + "," + std::to_string(oOp.m_aArgs[1])
+					+ "," + std::to_string(oOp.m_aArgs[2]) + "," + std::to_string(oOp.m_nResult) + "\n";
+	}
+	REQUIRE(sResult == sExpected);
+
+	bOk = execCmd((sTool + " " + sLogFilePath).c_str(), sResult, sError);
+	REQUIRE(bOk);
+	REQUIRE(sResult.find("# " + sMountName + " (over) started at ") == 0);
+	REQUIRE(sResult.find("over:create(path=\"/new.txt\", mode=0") != std::string::npos);
+	REQUIRE(sResult.find("over:rename(path=\"/new.txt\", new=\"/renamed.txt\"") != std::string::npos);
+	REQUIRE(sResult.find("over:getattr(path=\"/missing.txt\") returned " + std::to_string(-ENOENT) + " (") != std::string::npos);
+}
+
+TEST_CASE("PropFaker, testLogLevels")
+{
+	const std::string sMountName = "fspf-levels";
+	const std::string sFsFolderPath = "/tmp/fspropfaker-levels/levels-base";
+	const std::string sMountPath = "/tmp/fspropfaker-levels/levels-mount";
+	const std::string sLogFilePath = "/tmp/fspropfaker-levels/levels.log";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd("rm -rf /tmp/fspropfaker-levels", sResult, sError);
+	REQUIRE(bOk);
+	makePath(sFsFolderPath);
+	makePath(sMountPath);
+
+	FsPropFaker::Options oOptions;
+	oOptions.m_eLogLevel = FsPropFaker::LOG_LEVEL_OPS;
+	oOptions.m_nLogCategories = FsPropFaker::LOG_CATEGORY_STATFS;
+	auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, sLogFilePath, oOptions);
+	auto& refFaker = oResult.m_refFaker;
+	sError = std::move(oResult.m_sError);
+	REQUIRE(refFaker);
+	REQUIRE(sError.empty());
+	REQUIRE(refFaker->getLogLevel() == FsPropFaker::LOG_LEVEL_OPS);
+	REQUIRE(refFaker->getLogCategories() == FsPropFaker::LOG_CATEGORY_STATFS);
+
+	const std::string& sMount = refFaker->getMountPath();
+	int nFd = ::open((sMount + "/quiet.txt").c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+	REQUIRE(nFd >= 0);
+	REQUIRE(::write(nFd, "hello", 5) == 5);
+	REQUIRE(::close(nFd) == 0);
+	struct ::stat oStat;
+	REQUIRE(::stat((sMount + "/missing.txt").c_str(), &oStat) != 0);
+	struct ::statvfs oStatFs;
+	sError = getStatVFS(sMount, oStatFs);
+	REQUIRE(sError.empty());
+
+	refFaker->setLogLevel(FsPropFaker::LOG_LEVEL_FULL);
+	refFaker->setLogCategories(FsPropFaker::LOG_CATEGORY_ALL);
+	nFd = ::open((sMount + "/loud.txt").c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+	REQUIRE(nFd >= 0);
+	REQUIRE(::write(nFd, "hello", 5) == 5);
+	REQUIRE(::close(nFd) == 0);
+
+	sError = refFaker->unmount();
+	REQUIRE(sError.empty());
+	// flushes and closes the log
+	refFaker.reset();
+
+	bOk = execCmd((std::string{"cat "} + sLogFilePath).c_str(), sResult, sError);
+	REQUIRE(bOk);
+	// the statfs summary but not the dump of the structure
+	REQUIRE(sResult.find("over:statfs(") != std::string::npos);
+	REQUIRE(sResult.find("f_bsize") == std::string::npos);
+	// the requests of the other categories only if they failed
+	REQUIRE(sResult.find("over:create(path=\"/quiet.txt\"") == std::string::npos);
+	REQUIRE(sResult.find("(path=\"/quiet.txt\", buf=") == std::string::npos);
+	REQUIRE(sResult.find("over:getattr(path=\"/missing.txt\") ERROR") != std::string::npos);
+	// after the change everything
+	REQUIRE(sResult.find("over:create(path=\"/loud.txt\"") != std::string::npos);
+	REQUIRE(sResult.find("st_mode") != std::string::npos);
+}
+#endif // FSPROPFAKER_WITHOUT_LOGGING
+
+TEST_CASE("PropFaker, testInvalidOptions")
+{
+	const std::string sMountName = "fspf-opts";
+	const std::string sFsFolderPath = "/tmp/fspropfaker-opts/opts-base";
+	const std::string sMountPath = "/tmp/fspropfaker-opts/opts-mount";
+	std::string sResult;
+	std::string sError;
+	bool bOk = execCmd("rm -rf /tmp/fspropfaker-opts", sResult, sError);
+	REQUIRE(bOk);
+	makePath(sFsFolderPath);
+	makePath(sMountPath);
+
+	FsPropFaker::Options oOptions;
+	oOptions.m_bKernelCache = true;
+	oOptions.m_bAutoCache = true;
+	auto oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "", oOptions);
+	REQUIRE(! oResult.m_refFaker);
+	REQUIRE(! oResult.m_sError.empty());
+
+	oOptions = FsPropFaker::Options{};
+	oOptions.m_nMaxWrite = 100;
+	oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "", oOptions);
+	REQUIRE(! oResult.m_refFaker);
+	REQUIRE(! oResult.m_sError.empty());
+
+	oOptions = FsPropFaker::Options{};
+	oOptions.m_bSingleThreaded = true;
+	oOptions.m_nWorkerThreads = 2;
+	oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "", oOptions);
+	REQUIRE(! oResult.m_refFaker);
+	REQUIRE(! oResult.m_sError.empty());
+
+	oOptions = FsPropFaker::Options{};
+	oOptions.m_fRealStatsTTL = -1.0;
+	oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "", oOptions);
+	REQUIRE(! oResult.m_refFaker);
+	REQUIRE(! oResult.m_sError.empty());
+
+	oOptions = FsPropFaker::Options{};
+	oOptions.m_fRealStatsTTL = 1e300;
+	oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "", oOptions);
+	REQUIRE(! oResult.m_refFaker);
+	REQUIRE(! oResult.m_sError.empty());
+
+	oOptions = FsPropFaker::Options{};
+	oOptions.m_nMountTimeoutMillisec = 0;
+	oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "", oOptions);
+	REQUIRE(! oResult.m_refFaker);
+	REQUIRE(! oResult.m_sError.empty());
+
+	oOptions = FsPropFaker::Options{};
+	oOptions.m_nLogCategories = 0x100;
+	oResult = FsPropFaker::create(sMountName, sFsFolderPath, sMountPath, "", oOptions);
+	REQUIRE(! oResult.m_refFaker);
+	REQUIRE(! oResult.m_sError.empty());
+}
 
 
 } // namespace testing
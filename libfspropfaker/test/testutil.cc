@@ -24,6 +24,7 @@
 #include <iostream>
 #include <cassert>
 #include <array>
+#include <algorithm>
 
 #include <string.h>
 #include <stdlib.h>
@@ -116,4 +117,21 @@ bool fileExists(const std::string& sPath) noexcept
 	return ((oInfo.st_mode & S_IFREG) != 0);
 }
 
+int64_t getMaxLoggedSize(const std::string& sLog, const std::string& sCall) noexcept
+{
+	static const std::string s_sSize = "size=";
+	int64_t nMaxSize = -1;
+	std::string::size_type nPos = 0;
+	while ((nPos = sLog.find(sCall, nPos)) != std::string::npos) {
+		nPos += sCall.size();
+		const auto nEndPos = sLog.find('\n', nPos);
+		const auto nSizePos = sLog.find(s_sSize, nPos);
+		if ((nSizePos == std::string::npos) || (nSizePos > nEndPos)) {
+			continue; // while ----
+		}
+		nMaxSize = std::max<int64_t>(nMaxSize, ::strtoll(sLog.c_str() + nSizePos + s_sSize.size(), nullptr, 10));
+	}
+	return nMaxSize;
+}
+
 } // namespace fspf
@@ -24,6 +24,8 @@
 #include <string>
 #include <vector>
 
+#include <stdint.h>
+
 namespace fspf
 {
 
@@ -37,6 +39,13 @@ bool execCmd(const char* sCmd, std::string& sResult, std::string& sError) noexce
 
 bool fileExists(const std::string& sPath) noexcept;
 
+/* The biggest size of the logged calls.
+ * @param sLog The content of the text log.
+ * @param sCall The start of the call's log line. Example: "over:write_buf(".
+ * @return The biggest `size=` argument or -1 if the call wasn't logged.
+ */
+int64_t getMaxLoggedSize(const std::string& sLog, const std::string& sCall) noexcept;
+
 } // namespace fspf
 
 #endif /* FSPF_TEST_UTIL_H */
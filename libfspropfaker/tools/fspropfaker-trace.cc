@@ -0,0 +1,268 @@
+/*
+ * Copyright © 2020  Stefano Marsili, <stemars@gmx.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+/*
+ * File:   fspropfaker-trace.cc
+ */
+
+/* Decodes the binary trace written by fspropfaker when
+ * FsPropFaker::Options::m_bBinaryTrace is set.
+ */
+
+#include "fstrace.h"
+
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+
+namespace fspf
+{
+
+static void printUsage() noexcept
+{
+	std::cout << "Usage: fspropfaker-trace [--csv] TRACEFILE" << '\n';
+	std::cout << "Prints the requests recorded in a binary trace of fspropfaker as text" << '\n';
+	std::cout << "or, with --csv, as comma separated values." << '\n';
+}
+
+// quotes the string if it contains characters special to csv
+static std::string csvField(const std::string& sField) noexcept
+{
+	if (sField.find_first_of(",\"\n\r") == std::string::npos) {
+		return sField; //-------------------------------------------------------
+	}
+	std::string sQuoted = "\"";
+	for (const char c : sField) {
+		if (c == '"') {
+			sQuoted += '"';
+		}
+		sQuoted += c;
+	}
+	sQuoted += '"';
+	return sQuoted;
+}
+
+class TraceDecoder
+{
+public:
+	TraceDecoder(FILE* p0File, bool bCsv) noexcept
+	: m_p0File(p0File)
+	, m_bCsv(bCsv)
+	{
+	}
+	// returns empty string if successful, the error otherwise
+	std::string decode() noexcept
+	{
+		TraceHeader oHeader;
+		if (::fread(&oHeader, sizeof(oHeader), 1, m_p0File) != 1) {
+			return "Not a trace file: too short"; //----------------------------
+		}
+		if (::memcmp(oHeader.m_aMagic, s_aTraceMagic, sizeof(oHeader.m_aMagic)) != 0) {
+			return "Not a trace file"; //---------------------------------------
+		}
+		if (oHeader.m_nVersion != s_nTraceVersion) {
+			return "Unsupported trace version " + std::to_string(oHeader.m_nVersion); //--
+		}
+		if (oHeader.m_nRecordSize != sizeof(TraceRecord)) {
+			return "Unexpected record size " + std::to_string(oHeader.m_nRecordSize); //--
+		}
+		m_bLowLevel = (oHeader.m_nBackend == TRACE_BACKEND_LOW);
+		oHeader.m_aMountName[sizeof(oHeader.m_aMountName) - 1] = '\0';
+		printHeader(oHeader);
+
+		TraceRecord oRecord;
+		size_t nRead;
+		while ((nRead = ::fread(&oRecord, 1, sizeof(oRecord), m_p0File)) == sizeof(oRecord)) {
+			if (oRecord.m_nType == TRACE_RECORD_TYPE_PATH) {
+				if (! readPath(oRecord)) {
+					// the faker was killed while writing
+					nRead = 1;
+					break; // while ----
+				}
+			} else if (oRecord.m_nType == TRACE_RECORD_TYPE_OP) {
+				if (m_bCsv) {
+					printCsvOp(oRecord);
+				} else {
+					printTextOp(oRecord);
+				}
+			} else {
+				return "Corrupted trace: unknown record type " + std::to_string(oRecord.m_nType); //--
+			}
+		}
+		if (::ferror(m_p0File) != 0) {
+			return std::string("Could not read trace: ") + ::strerror(errno); //--
+		}
+		if (nRead > 0) {
+			std::cerr << "Warning: the trace is truncated" << '\n';
+		}
+		return "";
+	}
+private:
+	bool readPath(const TraceRecord& oRecord) noexcept
+	{
+		const size_t nLen = static_cast<size_t>(std::max<int32_t>(0, oRecord.m_nResult));
+		const size_t nPaddedLen = (nLen + sizeof(TraceRecord) - 1) / sizeof(TraceRecord) * sizeof(TraceRecord);
+		std::vector<char> aPath(nPaddedLen);
+		if ((nPaddedLen > 0) && (::fread(aPath.data(), nPaddedLen, 1, m_p0File) != 1)) {
+			return false; //----------------------------------------------------
+		}
+		m_oPaths[oRecord.m_nPathId] = std::string(aPath.data(), nLen);
+		return true;
+	}
+	const std::string& getPath(uint32_t nPathId) noexcept
+	{
+		static const std::string s_sUnknown = "?";
+		auto itFind = m_oPaths.find(nPathId);
+		if (itFind == m_oPaths.end()) {
+			return s_sUnknown; //-----------------------------------------------
+		}
+		return itFind->second;
+	}
+	void printHeader(const TraceHeader& oHeader) noexcept
+	{
+		if (m_bCsv) {
+			std::cout << "time_ns,duration_ns,thread,pid,op,ino,path,ino2,path2,arg0,arg1,arg2,result" << '\n';
+			return; //----------------------------------------------------------
+		}
+		const time_t nStartSec = static_cast<time_t>(oHeader.m_nStartTimeNs / 1000000000);
+		struct ::tm oTm;
+		char aStart[64];
+		::strftime(aStart, sizeof(aStart), "%Y-%m-%d %H:%M:%S", ::localtime_r(&nStartSec, &oTm));
+		std::cout << "# " << oHeader.m_aMountName << " (" << (m_bLowLevel ? "low" : "over") << ")"
+				<< " started at " << aStart << '\n';
+	}
+	void printTextOp(const TraceRecord& oRecord) noexcept
+	{
+		char aTime[64];
+		::snprintf(aTime, sizeof(aTime), "%" PRIu64 ".%09" PRIu64
+					, oRecord.m_nTimeNs / 1000000000, oRecord.m_nTimeNs % 1000000000);
+		std::string sLine = std::string(aTime) + " thread=" + std::to_string(oRecord.m_nThread)
+							+ " pid=" + std::to_string(oRecord.m_nPid) + (m_bLowLevel ? " low:" : " over:");
+		if (oRecord.m_nOp >= TRACE_OP_TOT) {
+			sLine += "op" + std::to_string(oRecord.m_nOp) + "(";
+			std::cout << sLine << ")" << '\n';
+			return; //----------------------------------------------------------
+		}
+		const TraceOpInfo& oInfo = getTraceOpInfo(oRecord.m_nOp);
+		sLine += std::string(oInfo.m_p0Name) + "(";
+		std::string sSep;
+		if (m_bLowLevel) {
+			sLine += "ino=" + std::to_string(oRecord.m_nIno);
+			sSep = ", ";
+		}
+		if (oRecord.m_nPathId != 0) {
+			sLine += sSep + (m_bLowLevel ? "name=\"" : "path=\"") + getPath(oRecord.m_nPathId) + "\"";
+			sSep = ", ";
+		}
+		if (oInfo.m_p0Path2Name != nullptr) {
+			if (oRecord.m_nIno2 != 0) {
+				sLine += sSep + oInfo.m_p0Path2Name + "_ino=" + std::to_string(oRecord.m_nIno2);
+				sSep = ", ";
+			}
+			if (oRecord.m_nPath2Id != 0) {
+				sLine += sSep + oInfo.m_p0Path2Name + "=\"" + getPath(oRecord.m_nPath2Id) + "\"";
+				sSep = ", ";
+			}
+		}
+		for (int32_t nIdx = 0; nIdx < 3; ++nIdx) {
+			const char* p0ArgName = oInfo.m_aArgNames[nIdx];
+			if (p0ArgName == nullptr) {
+				continue; // for ----
+			}
+			char aArg[32];
+			const int64_t nArg = oRecord.m_aArgs[nIdx];
+			if ((nIdx == 0) && oInfo.m_bOctalArg0) {
+				::snprintf(aArg, sizeof(aArg), "0%" PRIo64, static_cast<uint64_t>(nArg));
+			} else if ((::strcmp(p0ArgName, "flags") == 0) || (::strcmp(p0ArgName, "to_set") == 0)) {
+				::snprintf(aArg, sizeof(aArg), "0x%" PRIx64, static_cast<uint64_t>(nArg));
+			} else {
+				::snprintf(aArg, sizeof(aArg), "%" PRId64, nArg);
+			}
+			sLine += sSep + p0ArgName + "=" + aArg;
+			sSep = ", ";
+		}
+		sLine += ") returned " + std::to_string(oRecord.m_nResult);
+		if (oRecord.m_nResult < 0) {
+			sLine += std::string(" (") + ::strerror(- oRecord.m_nResult) + ")";
+		}
+		sLine += " in " + std::to_string(oRecord.m_nDurationNs) + " ns";
+		std::cout << sLine << '\n';
+	}
+	void printCsvOp(const TraceRecord& oRecord) noexcept
+	{
+		const std::string sOp = ((oRecord.m_nOp < TRACE_OP_TOT) ? std::string(getTraceOpInfo(oRecord.m_nOp).m_p0Name)
+																: "op" + std::to_string(oRecord.m_nOp));
+		std::cout << oRecord.m_nTimeNs << ',' << oRecord.m_nDurationNs
+				<< ',' << oRecord.m_nThread << ',' << oRecord.m_nPid << ',' << sOp
+				<< ',' << oRecord.m_nIno << ',' << ((oRecord.m_nPathId != 0) ? csvField(getPath(oRecord.m_nPathId)) : "")
+				<< ',' << oRecord.m_nIno2 << ',' << ((oRecord.m_nPath2Id != 0) ? csvField(getPath(oRecord.m_nPath2Id)) : "")
+				<< ',' << oRecord.m_aArgs[0] << ',' << oRecord.m_aArgs[1] << ',' << oRecord.m_aArgs[2]
+				<< ',' << oRecord.m_nResult << '\n';
+	}
+private:
+	FILE* m_p0File;
+	const bool m_bCsv;
+	bool m_bLowLevel = false;
+	// Key: the path id, Value: the path or name.
+	std::unordered_map<uint32_t, std::string> m_oPaths;
+};
+
+} // namespace fspf
+
+int main(int nArgC, char** aArgV)
+{
+	bool bCsv = false;
+	const char* p0TracePath = nullptr;
+	for (int nArg = 1; nArg < nArgC; ++nArg) {
+		const char* p0Arg = aArgV[nArg];
+		if (::strcmp(p0Arg, "--csv") == 0) {
+			bCsv = true;
+		} else if ((::strcmp(p0Arg, "-h") == 0) || (::strcmp(p0Arg, "--help") == 0)) {
+			fspf::printUsage();
+			return 0; //--------------------------------------------------------
+		} else if (p0TracePath == nullptr) {
+			p0TracePath = p0Arg;
+		} else {
+			fspf::printUsage();
+			return 1; //--------------------------------------------------------
+		}
+	}
+	if (p0TracePath == nullptr) {
+		fspf::printUsage();
+		return 1; //------------------------------------------------------------
+	}
+	FILE* p0File = ::fopen(p0TracePath, "rb");
+	if (p0File == nullptr) {
+		std::cerr << "Could not open " << p0TracePath << ": " << ::strerror(errno) << '\n';
+		return 1; //------------------------------------------------------------
+	}
+	fspf::TraceDecoder oDecoder(p0File, bCsv);
+	const std::string sError = oDecoder.decode();
+	::fclose(p0File);
+	if (! sError.empty()) {
+		std::cerr << sError << '\n';
+		return 1; //------------------------------------------------------------
+	}
+	return 0;
+}
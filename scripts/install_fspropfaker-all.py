@@ -51,6 +51,12 @@ def main():
 						, default=False, dest="bDontSudo")
 	oParser.add_argument("--sanitize", help="compile libraries with -fsanitize=address (Debug only)", action="store_true"\
 						, default=False, dest="bSanitize")
+	oParser.add_argument("--fuse3", help="build against libfuse 3 instead of libfuse 2", action="store_true"\
+						, default=False, dest="bFuse3")
+	oParser.add_argument("--io-uring", help="build with io_uring support (needs liburing)", action="store_true"\
+						, default=False, dest="bIoUring")
+	oParser.add_argument("--no-logging", help="build without logging (the log file path is ignored)", action="store_true"\
+						, default=False, dest="bNoLogging")
 	oArgs = oParser.parse_args()
 
 	sInstallDir = os.path.abspath(os.path.expanduser(oArgs.sInstallDir))
@@ -86,6 +92,21 @@ def main():
 	else:
 		sSanitize = ""
 	#print("sSanitize:" + sSanitize)
+	#
+	if oArgs.bFuse3:
+		sFuse3 = "--fuse3"
+	else:
+		sFuse3 = ""
+	#
+	if oArgs.bIoUring:
+		sIoUring = "--io-uring"
+	else:
+		sIoUring = ""
+	#
+	if oArgs.bNoLogging:
+		sNoLogging = "--no-logging"
+	else:
+		sNoLogging = ""
 
 	#
 	if oArgs.bDontConfigure:
@@ -113,9 +134,9 @@ def main():
 
 	print("== install libfspropfaker ======" + sInfo + "==")
 	os.chdir("libfspropfaker/scripts")
-	subprocess.check_call("./install_libfspropfaker.py {} {} {} {} {} {} {} {} {} {} {}".format(\
+	subprocess.check_call("./install_libfspropfaker.py {} {} {} {} {} {} {} {} {} {} {} {} {} {}".format(\
 			sBuildStaticLib, sBuildTests, sBuildDocs, sDocsWarningsToLog, sBuildType, sInstallDir\
-			, sNoConfigure, sNoMake, sNoInstall, sSudo, sSanitize).split())
+			, sNoConfigure, sNoMake, sNoInstall, sSudo, sSanitize, sFuse3, sIoUring, sNoLogging).split())
 	os.chdir("../..")
 
 if __name__ == "__main__":
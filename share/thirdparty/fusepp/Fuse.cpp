@@ -65,5 +65,11 @@ template<class T> Fusepp::t_write_buf Fusepp::Fuse<T>::write_buf = nullptr;
 template<class T> Fusepp::t_read_buf Fusepp::Fuse<T>::read_buf = nullptr;
 template<class T> Fusepp::t_flock Fusepp::Fuse<T>::flock = nullptr;
 template<class T> Fusepp::t_fallocate Fusepp::Fuse<T>::fallocate = nullptr;
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 4)
+template<class T> Fusepp::t_copy_file_range Fusepp::Fuse<T>::copy_file_range = nullptr;
+#endif
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+template<class T> Fusepp::t_lseek Fusepp::Fuse<T>::lseek = nullptr;
+#endif
 
 template<class T> struct fuse_operations Fusepp::Fuse<T>::operations_;
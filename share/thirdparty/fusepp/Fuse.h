@@ -33,6 +33,7 @@
 
 #include <fuse.h>
 #include <cstring>
+#include <mutex>
 
 namespace Fusepp
 {
@@ -126,14 +127,31 @@ namespace Fusepp
   typedef int (*t_flock) (const char *, struct fuse_file_info *, int op);
   typedef int (*t_fallocate) (const char *, int, off_t, off_t,
                               struct fuse_file_info *);
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 4)
+  typedef ssize_t (*t_copy_file_range) (const char *path_in,
+                                        struct fuse_file_info *fi_in,
+                                        off_t offset_in, const char *path_out,
+                                        struct fuse_file_info *fi_out,
+                                        off_t offset_out, size_t size,
+                                        int flags);
+#endif
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+  typedef off_t (*t_lseek) (const char *, off_t off, int whence,
+                            struct fuse_file_info *);
+#endif
 
   template <class T> class Fuse 
   {
   public:
     Fuse()
     {
-      memset (&T::operations_, 0, sizeof (struct fuse_operations));
-      load_operations_();
+      // the operations are shared by all instances, fuse_new copies them
+      static std::once_flag s_oLoaded;
+      std::call_once(s_oLoaded, []()
+      {
+        memset (&T::operations_, 0, sizeof (struct fuse_operations));
+        load_operations_();
+      });
     }
 
     // no copy
@@ -198,6 +216,12 @@ namespace Fusepp
       operations_.read_buf = T::read_buf;
       operations_.flock = T::flock;
       operations_.fallocate = T::fallocate;
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 4)
+      operations_.copy_file_range = T::copy_file_range;
+#endif
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+      operations_.lseek = T::lseek;
+#endif
     }
 
     static struct fuse_operations operations_;
@@ -242,6 +266,12 @@ namespace Fusepp
     static t_read_buf read_buf;
     static t_flock flock;
     static t_fallocate fallocate;
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 4)
+    static t_copy_file_range copy_file_range;
+#endif
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+    static t_lseek lseek;
+#endif
   } ;
 }
 